@@ -28,6 +28,10 @@
 #ifndef _ATOMICS_H
 #define _ATOMICS_H
 
+typedef struct {
+    int atomic;
+} atomic_t;
+
 #define atomic_read(x) ((x)->atomic)
 #define atomic_set(x, val) ((x)->atomic = (val))
 #define atomic_inc(x) ((void) __sync_fetch_and_add (&(x)->atomic, 1))
@@ -1141,6 +1141,7 @@ VdpStatus vdp_decoder_render(VdpDecoder decoder,
     uint32_t bitstream_data_size;
     uint32_t bitstream_size;
     int bitstream_data_fd;
+    VdpTime queue_time;
     VdpTime time = 0;
     VdpStatus ret;
 
@@ -1175,6 +1176,11 @@ VdpStatus vdp_decoder_render(VdpDecoder decoder,
 
     tegra_surface_cache_surface_self_remove(surf);
 
+    /* engines may still read the previous frame */
+    host1x_pixelbuffer_sync(surf->pixbuf);
+
+    queue_time = engine_stats_vde_begin();
+
     if (dec->v4l2.presents)
         ret = tegra_decode_h264_v4l2(dec, surf, picture_info,
                                      bitstream_data_fd,
@@ -1185,6 +1191,8 @@ VdpStatus vdp_decoder_render(VdpDecoder decoder,
         ret = tegra_decode_h264(dec, surf, picture_info,
                                 bitstream_data_fd, &bitstream_reader);
 
+    engine_stats_vde_end(queue_time, bitstream_data_size);
+
     tegra_surface_cache_add_surface(&dec->surf_cache, surf);
 
     free_data(bitstream_bo, bitstream_data_fd);
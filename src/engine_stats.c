@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "vdpau_tegra.h"
+
+#define STATS_QUEUE_SIZE        256
+#define STATS_LATENCY_SAMPLES   1024
+
+struct engine_stats_job {
+    struct tegra_fence *fence;
+    VdpTime submit_time;
+    unsigned int size;
+};
+
+struct engine_stats {
+    const char *name;
+    const char *size_unit;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    bool thread_running;
+    bool thread_stop;
+
+    /* jobs of an engine are completed in the order of submission */
+    struct engine_stats_job queue[STATS_QUEUE_SIZE];
+    unsigned int queue_head;
+    unsigned int queue_len;
+    unsigned int in_flight;
+
+    /* accumulated since the last dump */
+    VdpTime period_start;
+    VdpTime busy_time;
+    VdpTime last_complete;
+    uint64_t jobs;
+    uint64_t size;
+    uint64_t dropped;
+    uint64_t depth_sum;
+    unsigned int max_depth;
+    VdpTime latency[STATS_LATENCY_SAMPLES];
+    unsigned int num_latency;
+};
+
+bool tegra_vdpau_engine_stats;
+
+static VdpTime stats_period;
+
+static struct engine_stats engine_stats[TEGRA_ENGINES_NB] = {
+    [TEGRA_ENGINE_GR2D] = {
+        .name = "gr2d",
+        .size_unit = "words",
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+    },
+    [TEGRA_ENGINE_GR3D] = {
+        .name = "gr3d",
+        .size_unit = "words",
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+    },
+    [TEGRA_ENGINE_VDE] = {
+        .name = "vde",
+        .size_unit = "bytes",
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+    },
+};
+
+static int compare_latency(const void *a, const void *b)
+{
+    const VdpTime *la = a, *lb = b;
+
+    return (*la > *lb) - (*la < *lb);
+}
+
+static VdpTime latency_percentile(struct engine_stats *s, unsigned int pct)
+{
+    unsigned int num = s->num_latency;
+
+    if (num > STATS_LATENCY_SAMPLES)
+        num = STATS_LATENCY_SAMPLES;
+
+    if (!num)
+        return 0;
+
+    return s->latency[(num - 1) * pct / 100];
+}
+
+static void engine_stats_dump_locked(struct engine_stats *s, VdpTime now)
+{
+    VdpTime period = now - s->period_start;
+    unsigned int num = s->num_latency;
+
+    if (num > STATS_LATENCY_SAMPLES)
+        num = STATS_LATENCY_SAMPLES;
+
+    qsort(s->latency, num, sizeof(*s->latency), compare_latency);
+
+    InfoMsg("%s: %.1f s, %llu jobs (%llu untracked), busy %.1f%%, "
+            "%.1f %s/job, queue depth avg %.1f max %u, "
+            "latency usec p50 %llu p90 %llu p99 %llu max %llu\n",
+            s->name, period / 1e9,
+            (unsigned long long)s->jobs,
+            (unsigned long long)s->dropped,
+            period ? 100.0 * s->busy_time / period : 0.0,
+            s->jobs ? (double)s->size / s->jobs : 0.0, s->size_unit,
+            s->jobs ? (double)s->depth_sum / s->jobs : 0.0, s->max_depth,
+            latency_percentile(s, 50) / 1000,
+            latency_percentile(s, 90) / 1000,
+            latency_percentile(s, 99) / 1000,
+            latency_percentile(s, 100) / 1000);
+
+    s->period_start = now;
+    s->busy_time = 0;
+    s->jobs = 0;
+    s->size = 0;
+    s->dropped = 0;
+    s->depth_sum = 0;
+    s->max_depth = 0;
+    s->num_latency = 0;
+}
+
+static void engine_stats_queued_locked(struct engine_stats *s)
+{
+    if (!s->period_start)
+        s->period_start = get_time();
+
+    s->in_flight++;
+    s->depth_sum += s->in_flight;
+
+    if (s->max_depth < s->in_flight)
+        s->max_depth = s->in_flight;
+}
+
+static void engine_stats_completed_locked(struct engine_stats *s,
+                                          VdpTime submit_time,
+                                          VdpTime complete_time,
+                                          unsigned int size)
+{
+    VdpTime start = submit_time;
+
+    /* engine is busy with the previous job until it completes */
+    if (start < s->last_complete)
+        start = s->last_complete;
+
+    if (complete_time > start)
+        s->busy_time += complete_time - start;
+
+    if (complete_time > s->last_complete)
+        s->last_complete = complete_time;
+
+    s->latency[s->num_latency++ % STATS_LATENCY_SAMPLES] =
+        complete_time - submit_time;
+    s->in_flight--;
+    s->jobs++;
+    s->size += size;
+
+    if (stats_period && complete_time - s->period_start >= stats_period)
+        engine_stats_dump_locked(s, complete_time);
+}
+
+/*
+ * Fence completion is observed by a thread waiting for the jobs in the
+ * order of submission, so the time is known without relying on the
+ * engine users to wait for the fences in time.
+ */
+static void *engine_stats_thread(void *arg)
+{
+    struct engine_stats *s = arg;
+    struct engine_stats_job job;
+
+    pthread_mutex_lock(&s->lock);
+
+    for (;;) {
+        while (!s->queue_len && !s->thread_stop)
+            pthread_cond_wait(&s->cond, &s->lock);
+
+        if (!s->queue_len)
+            break;
+
+        job = s->queue[s->queue_head];
+        s->queue_head = (s->queue_head + 1) % STATS_QUEUE_SIZE;
+        s->queue_len--;
+
+        pthread_mutex_unlock(&s->lock);
+
+        tegra_stream_wait_fence(job.fence);
+        tegra_stream_put_fence(job.fence);
+
+        pthread_mutex_lock(&s->lock);
+
+        engine_stats_completed_locked(s, job.submit_time, get_time(),
+                                      job.size);
+    }
+
+    pthread_mutex_unlock(&s->lock);
+
+    return NULL;
+}
+
+void engine_stats_init(const char *period)
+{
+    long seconds = strtol(period, NULL, 10);
+
+    /* non-positive period means dump on device destruction only */
+    if (seconds > 0)
+        stats_period = seconds * 1000000000ULL;
+
+    tegra_vdpau_engine_stats = true;
+}
+
+void engine_stats_submit(struct tegra_fence *f, VdpTime submit_time,
+                         unsigned int words)
+{
+    struct engine_stats *s;
+    unsigned int tail;
+    int err;
+
+    if (!tegra_vdpau_engine_stats || !f)
+        return;
+
+    s = &engine_stats[f->gr2d ? TEGRA_ENGINE_GR2D : TEGRA_ENGINE_GR3D];
+
+    pthread_mutex_lock(&s->lock);
+
+    if (!s->thread_running) {
+        s->thread_stop = false;
+
+        err = pthread_create(&s->thread, NULL, engine_stats_thread, s);
+        if (err) {
+            ErrorMsg("failed to create thread %d\n", err);
+            goto unlock;
+        }
+
+        s->thread_running = true;
+    }
+
+    if (s->queue_len == STATS_QUEUE_SIZE) {
+        s->dropped++;
+        goto unlock;
+    }
+
+    tail = (s->queue_head + s->queue_len) % STATS_QUEUE_SIZE;
+
+    s->queue[tail].fence = tegra_stream_ref_fence(f, f->opaque);
+    s->queue[tail].submit_time = submit_time;
+    s->queue[tail].size = words;
+    s->queue_len++;
+
+    engine_stats_queued_locked(s);
+    pthread_cond_signal(&s->cond);
+unlock:
+    pthread_mutex_unlock(&s->lock);
+}
+
+VdpTime engine_stats_vde_begin(void)
+{
+    struct engine_stats *s = &engine_stats[TEGRA_ENGINE_VDE];
+
+    if (!tegra_vdpau_engine_stats)
+        return 0;
+
+    pthread_mutex_lock(&s->lock);
+    engine_stats_queued_locked(s);
+    pthread_mutex_unlock(&s->lock);
+
+    return get_time();
+}
+
+void engine_stats_vde_end(VdpTime queue_time, unsigned int bytes)
+{
+    struct engine_stats *s = &engine_stats[TEGRA_ENGINE_VDE];
+
+    if (!tegra_vdpau_engine_stats)
+        return;
+
+    pthread_mutex_lock(&s->lock);
+    engine_stats_completed_locked(s, queue_time, get_time(), bytes);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* waits for the tracked jobs and prints what was gathered since last dump */
+void engine_stats_dump(void)
+{
+    struct engine_stats *s;
+    bool join;
+    int i;
+
+    if (!tegra_vdpau_engine_stats)
+        return;
+
+    for (i = 0; i < TEGRA_ENGINES_NB; i++) {
+        s = &engine_stats[i];
+
+        pthread_mutex_lock(&s->lock);
+        join = s->thread_running;
+        s->thread_stop = true;
+        s->thread_running = false;
+        pthread_cond_signal(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+
+        if (join)
+            pthread_join(s->thread, NULL);
+
+        pthread_mutex_lock(&s->lock);
+        if (s->period_start)
+            engine_stats_dump_locked(s, get_time());
+        pthread_mutex_unlock(&s->lock);
+    }
+}
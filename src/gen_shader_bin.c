@@ -21,6 +21,7 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
@@ -35,6 +36,16 @@
 
 #include "asm.h"
 
+#define MAX_VARIANTS    32
+#define MAX_DEFINES     8
+#define MAX_NESTING     16
+
+struct shader_variant {
+    char *name;
+    char *defines[MAX_DEFINES];
+    unsigned defines_nb;
+};
+
 static char *vs_path;
 static char *fs_path;
 static char *lnk_path;
@@ -42,6 +53,7 @@ static char *fp_name;
 static char *vp_name;
 static char *lp_name;
 static char *out_name;
+static char *variants_path;
 
 static int parse_command_line(int argc, char *argv[])
 {
@@ -56,6 +68,7 @@ static int parse_command_line(int argc, char *argv[])
             {"lnk",     required_argument, NULL, 0},
             {"name",    required_argument, NULL, 0},
             {"out",     required_argument, NULL, 0},
+            {"variants", required_argument, NULL, 0},
             { /* Sentinel */ }
         };
         int option_index = 0;
@@ -80,6 +93,9 @@ static int parse_command_line(int argc, char *argv[])
             case 4:
                 out_name = optarg;
                 break;
+            case 5:
+                variants_path = optarg;
+                break;
             default:
                 return 0;
             }
@@ -130,26 +146,168 @@ static char *read_file(const char *path)
     return data;
 }
 
-int main(int argc, char *argv[])
+/*
+ * Variants file lists one program per line: the program name followed
+ * by the names defined while assembling it. Lines starting with '#' are
+ * comments.
+ */
+static unsigned read_variants(const char *path,
+                              struct shader_variant *variants)
 {
-    uint32_t in_mask = 0, out_mask = 0;
-    bool t114_mode = false;
-    char *asm_txt;
-    unsigned int i;
-    FILE *out;
-    int err;
+    char *data = read_file(path);
+    char *line, *word, *save_line, *save_word;
+    unsigned variants_nb = 0;
+
+    for (line = strtok_r(data, "\n", &save_line); line;
+         line = strtok_r(NULL, "\n", &save_line)) {
+        struct shader_variant *v = &variants[variants_nb];
+
+        word = strtok_r(line, " \t", &save_word);
+        if (!word || word[0] == '#')
+            continue;
+
+        if (variants_nb == MAX_VARIANTS) {
+            fprintf(stderr, "%s: too many variants, %d maximum\n",
+                    path, MAX_VARIANTS);
+            abort();
+        }
 
-    /* float decimal point is locale-dependent */
-    setlocale(LC_ALL, "C");
+        v->name = word;
+        v->defines_nb = 0;
 
-    if (!parse_command_line(argc, argv))
-        return 1;
+        while ((word = strtok_r(NULL, " \t", &save_word))) {
+            if (v->defines_nb == MAX_DEFINES) {
+                fprintf(stderr, "%s: too many defines for %s, %d maximum\n",
+                        path, v->name, MAX_DEFINES);
+                abort();
+            }
+
+            v->defines[v->defines_nb++] = word;
+        }
+
+        variants_nb++;
+    }
+
+    /* names point into the file data, which is never freed */
+    return variants_nb;
+}
+
+static bool variant_defines(const struct shader_variant *v,
+                            const char *name, size_t len)
+{
+    unsigned i;
+
+    for (i = 0; i < v->defines_nb; i++) {
+        if (strlen(v->defines[i]) == len &&
+            !strncmp(v->defines[i], name, len))
+            return true;
+    }
+
+    return false;
+}
+
+static bool is_directive(const char *p, const char *directive, const char **arg)
+{
+    size_t len = strlen(directive);
+
+    if (strncmp(p, directive, len) || (p[len] && !isspace(p[len])))
+        return false;
+
+    for (p += len; *p == ' ' || *p == '\t'; p++)
+        ;
+
+    *arg = p;
+
+    return true;
+}
+
+/*
+ * Minimal conditional preprocessing of the asm text: '#ifdef NAME',
+ * '#ifndef NAME', '#else' and '#endif' lines select the parts of the
+ * source that belong to the variant. Everything skipped is blanked out,
+ * so that line numbers in parser errors stay correct.
+ */
+static void preprocess(char *txt, const struct shader_variant *v,
+                       const char *path)
+{
+    bool taken[MAX_NESTING];
+    unsigned lineno = 1;
+    unsigned depth = 0;
+    const char *arg;
+    char *line = txt;
+    bool negate;
+    char *p, *end;
+    unsigned i;
+    bool active;
+    bool blank;
+
+    while (*line) {
+        end = strchr(line, '\n');
+        if (!end)
+            end = line + strlen(line);
+
+        for (p = line; *p == ' ' || *p == '\t'; p++)
+            ;
+
+        blank = true;
+
+        negate = is_directive(p, "#ifndef", &arg);
+
+        if (negate || is_directive(p, "#ifdef", &arg)) {
+            size_t len = strcspn(arg, " \t\n");
+
+            if (depth == MAX_NESTING || !len) {
+                fprintf(stderr, "%s:%u: invalid conditional\n",
+                        path, lineno);
+                abort();
+            }
+
+            taken[depth++] = variant_defines(v, arg, len) != negate;
+        } else if (is_directive(p, "#else", &arg)) {
+            if (!depth) {
+                fprintf(stderr, "%s:%u: #else without #if\n", path, lineno);
+                abort();
+            }
+
+            taken[depth - 1] = !taken[depth - 1];
+        } else if (is_directive(p, "#endif", &arg)) {
+            if (!depth) {
+                fprintf(stderr, "%s:%u: #endif without #if\n", path, lineno);
+                abort();
+            }
+
+            depth--;
+        } else {
+            for (active = true, i = 0; i < depth; i++)
+                active &= taken[i];
+
+            blank = !active;
+        }
+
+        if (blank)
+            memset(line, ' ', end - line);
+
+        line = *end ? end + 1 : end;
+        lineno++;
+    }
+
+    if (depth) {
+        fprintf(stderr, "%s: unterminated #if\n", path);
+        abort();
+    }
+}
+
+static int assemble(const struct shader_variant *v)
+{
+    char *asm_txt;
+    int err;
 
     /* parse vertex asm */
     asm_txt = read_file(vs_path);
     if (!asm_txt)
         return 1;
 
+    preprocess(asm_txt, v, vs_path);
     vertex_asm_scan_string(asm_txt);
     err = vertex_asmparse();
     if (err)
@@ -163,6 +321,7 @@ int main(int argc, char *argv[])
     if (!asm_txt)
         return 1;
 
+    preprocess(asm_txt, v, lnk_path);
     linker_asm_scan_string(asm_txt);
     err = linker_asmparse();
     if (err)
@@ -176,6 +335,7 @@ int main(int argc, char *argv[])
     if (!asm_txt)
         return 1;
 
+    preprocess(asm_txt, v, fs_path);
     fragment_asm_scan_string(asm_txt);
     err = fragment_asmparse();
     if (err)
@@ -184,20 +344,20 @@ int main(int argc, char *argv[])
     fragment_asmlex_destroy();
     free(asm_txt);
 
-    out = fopen(out_name, "w");
-    if (!out) {
-        fprintf(stderr, "Failed to open %s: %s\n", out_name, strerror(errno));
-        return 1;
-    }
+    return 0;
+}
 
-    fprintf(out, "/* Autogenerated file */\n\n");
-    fprintf(out, "#include \"shaders/prog.h\"\n\n");
+static void emit_program(FILE *out, const char *name)
+{
+    uint32_t in_mask = 0, out_mask = 0;
+    bool t114_mode = false;
+    unsigned int i;
 
 gen_fp:
     if (t114_mode)
-        fprintf(out, "static uint32_t fs_%s_t114_words[] = {\n", fp_name);
+        fprintf(out, "static uint32_t fs_%s_t114_words[] = {\n", name);
     else
-        fprintf(out, "static uint32_t fs_%s_words[] = {\n", fp_name);
+        fprintf(out, "static uint32_t fs_%s_words[] = {\n", name);
 
     fprintf(out, "    HOST1X_OPCODE_NONINCR(0x541, %d),\n",
             asm_fs_instructions_nb);
@@ -262,7 +422,7 @@ gen_fp:
         goto gen_fp;
     }
 
-    fprintf(out, "static uint32_t vs_%s_words[] = {\n", fp_name);
+    fprintf(out, "static uint32_t vs_%s_words[] = {\n", name);
 
     fprintf(out, "    HOST1X_OPCODE_NONINCR(0x206, %d),\n",
            asm_vs_instructions_nb * 4);
@@ -284,7 +444,7 @@ gen_fp:
             out_mask |= 1 << i;
     }
 
-    fprintf(out, "static uint32_t lnk_%s_words[] = {\n", fp_name);
+    fprintf(out, "static uint32_t lnk_%s_words[] = {\n", name);
 
     fprintf(out, "    HOST1X_OPCODE_INCR(0x300, %d),\n",
            asm_linker_instructions_nb * 2);
@@ -296,23 +456,89 @@ gen_fp:
 
     fprintf(out, "};\n\n");
 
-    fprintf(out, "static struct shader_program prog_%s = {\n", fp_name);
-    fprintf(out, "    .vs_prog_words = vs_%s_words,\n", fp_name);
-    fprintf(out, "    .vs_prog_words_nb = ARRAY_SIZE(vs_%s_words),\n", fp_name);
+    fprintf(out, "static struct shader_program prog_%s = {\n", name);
+    fprintf(out, "    .vs_prog_words = vs_%s_words,\n", name);
+    fprintf(out, "    .vs_prog_words_nb = ARRAY_SIZE(vs_%s_words),\n", name);
     fprintf(out, "    .vs_attrs_in_mask = %u,\n", in_mask);
     fprintf(out, "    .vs_attrs_out_mask = %u,\n", out_mask);
     fprintf(out, "\n");
-    fprintf(out, "    .fs_prog_words_t114 = fs_%s_t114_words,\n", fp_name);
-    fprintf(out, "    .fs_prog_words = fs_%s_words,\n", fp_name);
-    fprintf(out, "    .fs_prog_words_nb = ARRAY_SIZE(fs_%s_words),\n", fp_name);
+    fprintf(out, "    .fs_prog_words_t114 = fs_%s_t114_words,\n", name);
+    fprintf(out, "    .fs_prog_words = fs_%s_words,\n", name);
+    fprintf(out, "    .fs_prog_words_nb = ARRAY_SIZE(fs_%s_words),\n", name);
     fprintf(out, "    .fs_alu_buf_size = %u,\n", asm_alu_buffer_size);
     fprintf(out, "    .fs_pseq_to_dw = %u,\n", asm_pseq_to_dw_exec_nb);
     fprintf(out, "    .fs_pseq_inst_nb = %u,\n", asm_fs_instructions_nb);
     fprintf(out, "\n");
-    fprintf(out, "    .linker_words = lnk_%s_words,\n", fp_name);
-    fprintf(out, "    .linker_words_nb = ARRAY_SIZE(lnk_%s_words),\n", fp_name);
+    fprintf(out, "    .linker_words = lnk_%s_words,\n", name);
+    fprintf(out, "    .linker_words_nb = ARRAY_SIZE(lnk_%s_words),\n", name);
     fprintf(out, "    .linker_inst_nb = %u,\n", asm_linker_instructions_nb);
     fprintf(out, "    .used_tram_rows_nb = %u,\n", asm_linker_used_tram_rows_nb);
+    fprintf(out, "};\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct shader_variant variants[MAX_VARIANTS];
+    unsigned variants_nb = 1;
+    unsigned int i, k;
+    FILE *out;
+    int err;
+
+    /* float decimal point is locale-dependent */
+    setlocale(LC_ALL, "C");
+
+    if (!parse_command_line(argc, argv))
+        return 1;
+
+    if (variants_path) {
+        variants_nb = read_variants(variants_path, variants);
+        if (!variants_nb) {
+            fprintf(stderr, "%s: no variants\n", variants_path);
+            return 1;
+        }
+    } else {
+        variants[0].name = fp_name;
+        variants[0].defines_nb = 0;
+    }
+
+    out = fopen(out_name, "w");
+    if (!out) {
+        fprintf(stderr, "Failed to open %s: %s\n", out_name, strerror(errno));
+        return 1;
+    }
+
+    fprintf(out, "/* Autogenerated file */\n\n");
+    fprintf(out, "#include \"shaders/prog.h\"\n\n");
+
+    for (i = 0; i < variants_nb; i++) {
+        err = assemble(&variants[i]);
+        if (err) {
+            fprintf(stderr, "Failed to assemble %s\n", variants[i].name);
+            fclose(out);
+            unlink(out_name);
+            return err;
+        }
+
+        emit_program(out, variants[i].name);
+    }
+
+    if (!variants_path)
+        return 0;
+
+    fprintf(out, "static struct shader_program_variant %s_variants[] = {\n",
+            fp_name);
+
+    for (i = 0; i < variants_nb; i++) {
+        fprintf(out, "    { ");
+
+        for (k = 0; k < variants[i].defines_nb; k++)
+            fprintf(out, "%sSHADER_VARIANT_%s", k ? " | " : "",
+                    variants[i].defines[k]);
+
+        fprintf(out, "%s, &prog_%s },\n",
+                variants[i].defines_nb ? "" : "0", variants[i].name);
+    }
+
     fprintf(out, "};\n");
 
     return 0;
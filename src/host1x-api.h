@@ -85,6 +85,9 @@ struct host1x_pixelbuffer {
         uint32_t bos_offset[3];
     };
     bool guard_enabled;
+    /* last jobs of each engine that accessed pixbuf */
+    struct tegra_fence *gr2d_fence;
+    struct tegra_fence *gr3d_fence;
 };
 
 #define PIXBUF_GUARD_AREA_SIZE    0x4000
@@ -122,6 +125,14 @@ int host1x_pixelbuffer_check_guard(struct host1x_pixelbuffer *pixbuf);
 
 void host1x_pixelbuffer_disable_bo_guard(void);
 
+void host1x_pixelbuffer_depend(struct host1x_pixelbuffer *pixbuf, bool gr2d);
+
+int host1x_pixelbuffer_submit(struct tegra_stream *stream, bool gr2d,
+                              struct host1x_pixelbuffer *src,
+                              struct host1x_pixelbuffer *dst);
+
+int host1x_pixelbuffer_sync(struct host1x_pixelbuffer *pixbuf);
+
 int host1x_gr2d_clear(struct tegra_stream *stream,
                       struct host1x_pixelbuffer *pixbuf,
                       uint32_t color);
@@ -169,7 +180,8 @@ int host1x_gr2d_surface_blit(struct tegra_stream *stream,
                              unsigned int dx, unsigned int dy,
                              unsigned int dst_width, int dst_height);
 
-#define FX10(f)	            (((int32_t)((f) * 256.0f + 0.5f)) & 0x3ff)
+#define FX10(f)	            (((int32_t)((f) * 256.0f +                     \
+                                    ((f) < 0.0f ? -0.5f : 0.5f))) & 0x3ff)
 #define FX10_L(f)           FX10(f)
 #define FX10_H(f)           (FX10(f) << 10)
 #define FX10x2(low, high)   (FX10_H(high) | FX10_L(low))
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "vdpau_tegra.h"
+
+FILE *host1x_capture_file;
+
+static pthread_mutex_t capture_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void host1x_capture_open(const char *path)
+{
+    pthread_mutex_lock(&capture_lock);
+
+    if (!host1x_capture_file) {
+        host1x_capture_file = fopen(path, "w");
+        if (!host1x_capture_file)
+            ErrorMsg("failed to open %s: %s\n", path, strerror(errno));
+        else
+            DebugMsg("capturing jobs to %s\n", path);
+    }
+
+    pthread_mutex_unlock(&capture_lock);
+}
+
+void host1x_capture_job(const uint32_t *words, unsigned int num_words,
+                        const uint32_t *reloc_words, unsigned int num_relocs)
+{
+    struct host1x_capture_record rec;
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+
+    rec.magic = HOST1X_CAPTURE_MAGIC;
+    rec.class_id = 0;
+    rec.timestamp = (uint64_t)tp.tv_sec * 1000000000ull + tp.tv_nsec;
+    rec.num_words = num_words;
+    rec.num_relocs = num_relocs;
+
+    /* jobs start with SETCL of the engine's class */
+    if (num_words && (words[0] >> 28) == 0x0)
+        rec.class_id = (words[0] >> 6) & 0x3ff;
+
+    pthread_mutex_lock(&capture_lock);
+
+    /* flushed per job to keep the capture of a crashed process */
+    if (fwrite(&rec, sizeof(rec), 1, host1x_capture_file) != 1 ||
+        fwrite(words, sizeof(*words), num_words,
+               host1x_capture_file) != num_words ||
+        fwrite(reloc_words, sizeof(*reloc_words), num_relocs,
+               host1x_capture_file) != num_relocs ||
+        fflush(host1x_capture_file))
+    {
+        ErrorMsg("failed to write job: %s\n", strerror(errno));
+    }
+
+    pthread_mutex_unlock(&capture_lock);
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef HOST1X_CAPTURE_H
+#define HOST1X_CAPTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Jobs captured with VDPAU_TEGRA_CAPTURE=<file> are stored as a sequence
+ * of records in host byte order. Each record is a header followed by the
+ * command words of the job and the word indices of its relocations.
+ */
+#define HOST1X_CAPTURE_MAGIC    0x4a583148 /* "H1XJ" */
+
+struct host1x_capture_record {
+    uint32_t magic;
+    uint32_t class_id;      /* class set by the first SETCL of the job */
+    uint64_t timestamp;     /* CLOCK_MONOTONIC, in nanoseconds */
+    uint32_t num_words;
+    uint32_t num_relocs;
+};
+
+extern FILE *host1x_capture_file;
+
+static inline bool host1x_capture_enabled(void)
+{
+    return host1x_capture_file != NULL;
+}
+
+void host1x_capture_open(const char *path);
+void host1x_capture_job(const uint32_t *words, unsigned int num_words,
+                        const uint32_t *reloc_words, unsigned int num_relocs);
+
+#endif
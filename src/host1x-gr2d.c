@@ -27,6 +27,198 @@ struct host1x_csc_params csc_rgb_default = {
     .cvr = 0x80, .cub = 0x80, .cyx = 0x80,
 };
 
+/* parameter and relocation slots of the GR2D templates */
+enum {
+    FILL_CONTROLSECOND,
+    FILL_CONTROLMAIN,
+    FILL_DSTST,
+    FILL_COLOR,
+    FILL_TILEMODE,
+    FILL_DSTSIZE,
+    FILL_DSTPS,
+    /* clipped fill only */
+    FILL_CLIP0,
+    FILL_CLIP1,
+};
+
+enum {
+    FILL_DSTBA,
+};
+
+enum {
+    BLIT_CONTROLSECOND,
+    BLIT_CONTROLMAIN,
+    BLIT_TILEMODE,
+    BLIT_DSTST,
+    BLIT_SRCST,
+    BLIT_SRCSIZE,
+    BLIT_DSTSIZE,
+    BLIT_SRCPS,
+    BLIT_DSTPS,
+};
+
+enum {
+    BLIT_DSTBA,
+    BLIT_SRCBA,
+};
+
+enum {
+    SB_VDDA,
+    SB_VDDAINI,
+    SB_HDDA,
+    SB_HDDAINILS,
+    SB_CSCFIRST,
+    SB_CSCSECOND,
+    SB_CSCTHIRD,
+    SB_SBFORMAT,
+    SB_CONTROLSB,
+    SB_CONTROLMAIN,
+    SB_UVSTRIDE,
+    SB_TILEMODE,
+    SB_DSTST,
+    SB_SRCST,
+    SB_SRCSIZE,
+    SB_DSTSIZE,
+};
+
+enum {
+    SB_SRCBA_SB,
+    SB_DSTBA_SB,
+    SB_DSTBA,
+    SB_SRCBA,
+    /* YV12 source only */
+    SB_VBA_TILE,
+    SB_UBA_TILE,
+    SB_UBA,
+    SB_VBA,
+};
+
+static struct tegra_stream_template gr2d_fill_tmpl;
+static struct tegra_stream_template gr2d_fill_clipped_tmpl;
+static struct tegra_stream_template gr2d_blit_tmpl;
+static struct tegra_stream_template gr2d_sb_rgb_tmpl;
+static struct tegra_stream_template gr2d_sb_yuv_tmpl;
+static pthread_once_t gr2d_templates_once = PTHREAD_ONCE_INIT;
+
+static void gr2d_record_fill(struct tegra_stream_template *tmpl, bool clipped)
+{
+    tegra_template_init(tmpl, HOST1X_CLASS_GR2D);
+    tegra_template_push(tmpl, HOST1X_OPCODE_MASK(0x09, 9));
+    tegra_template_push(tmpl, 0x0000003a); /* trigger */
+    tegra_template_push(tmpl, 0x00000000); /* cmdsel */
+    tegra_template_push(tmpl, HOST1X_OPCODE_MASK(0x1e, 7));
+    tegra_template_push_param(tmpl, FILL_CONTROLSECOND);
+    tegra_template_push_param(tmpl, FILL_CONTROLMAIN);
+    tegra_template_push(tmpl, 0x000000cc); /* ropfade */
+
+    if (clipped) {
+        tegra_template_push(tmpl, HOST1X_OPCODE_INCR(0x22, 2));
+        tegra_template_push_param(tmpl, FILL_CLIP0);
+        tegra_template_push_param(tmpl, FILL_CLIP1);
+    }
+
+    tegra_template_push(tmpl, HOST1X_OPCODE_MASK(0x2b, 9));
+    tegra_template_push_reloc(tmpl, FILL_DSTBA);
+    tegra_template_push_param(tmpl, FILL_DSTST);
+    tegra_template_push(tmpl, HOST1X_OPCODE_NONINCR(0x35, 1));
+    tegra_template_push_param(tmpl, FILL_COLOR);
+    tegra_template_push(tmpl, HOST1X_OPCODE_NONINCR(0x46, 1));
+    tegra_template_push_param(tmpl, FILL_TILEMODE);
+    tegra_template_push(tmpl, HOST1X_OPCODE_MASK(0x38, 5));
+    tegra_template_push_param(tmpl, FILL_DSTSIZE);
+    tegra_template_push_param(tmpl, FILL_DSTPS);
+}
+
+static void gr2d_record_blit(struct tegra_stream_template *tmpl)
+{
+    tegra_template_init(tmpl, HOST1X_CLASS_GR2D);
+    tegra_template_push(tmpl, HOST1X_OPCODE_MASK(0x009, 9));
+    tegra_template_push(tmpl, 0x0000003a); /* trigger */
+    tegra_template_push(tmpl, 0x00000000); /* cmdsel */
+    tegra_template_push(tmpl, HOST1X_OPCODE_MASK(0x01e, 0x7));
+    tegra_template_push_param(tmpl, BLIT_CONTROLSECOND);
+    tegra_template_push_param(tmpl, BLIT_CONTROLMAIN);
+    tegra_template_push(tmpl, 0x000000cc); /* ropfade */
+    tegra_template_push(tmpl, HOST1X_OPCODE_NONINCR(0x046, 1));
+    tegra_template_push_param(tmpl, BLIT_TILEMODE);
+    tegra_template_push(tmpl, HOST1X_OPCODE_MASK(0x02b, 0xf149));
+    tegra_template_push_reloc(tmpl, BLIT_DSTBA);
+    tegra_template_push_param(tmpl, BLIT_DSTST);
+    tegra_template_push_reloc(tmpl, BLIT_SRCBA);
+    tegra_template_push_param(tmpl, BLIT_SRCST);
+    tegra_template_push_param(tmpl, BLIT_SRCSIZE);
+    tegra_template_push_param(tmpl, BLIT_DSTSIZE);
+    tegra_template_push_param(tmpl, BLIT_SRCPS);
+    tegra_template_push_param(tmpl, BLIT_DSTPS);
+}
+
+static void gr2d_record_surface_blit(struct tegra_stream_template *tmpl,
+                                     bool yuv)
+{
+    tegra_template_init(tmpl, HOST1X_CLASS_GR2D_SB);
+    tegra_template_push(tmpl, HOST1X_OPCODE_MASK(0x009, 0xF09));
+    tegra_template_push(tmpl, 0x00000038); /* trigger */
+    tegra_template_push(tmpl, 0x00000001); /* cmdsel */
+    tegra_template_push_param(tmpl, SB_VDDA);
+    tegra_template_push_param(tmpl, SB_VDDAINI);
+    tegra_template_push_param(tmpl, SB_HDDA);
+    tegra_template_push_param(tmpl, SB_HDDAINILS);
+
+    if (!yuv) {
+        /* CSC RGB -> RGB coefficients */
+        tegra_template_push(tmpl, HOST1X_OPCODE_MASK(0x15, 0x787));
+        tegra_template_push_param(tmpl, SB_CSCFIRST);
+        tegra_template_push_param(tmpl, SB_CSCSECOND);
+        tegra_template_push_param(tmpl, SB_CSCTHIRD);
+    } else {
+        /* tile mode */
+        tegra_template_push(tmpl, HOST1X_OPCODE_MASK(0x04b, 3));
+        tegra_template_push_reloc(tmpl, SB_VBA_TILE);
+        tegra_template_push_reloc(tmpl, SB_UBA_TILE);
+
+        tegra_template_push(tmpl, HOST1X_OPCODE_MASK(0x15, 0x7E7));
+        tegra_template_push_param(tmpl, SB_CSCFIRST);
+        tegra_template_push_param(tmpl, SB_CSCSECOND);
+        tegra_template_push_param(tmpl, SB_CSCTHIRD);
+
+        /* linear mode */
+        tegra_template_push_reloc(tmpl, SB_UBA);
+        tegra_template_push_reloc(tmpl, SB_VBA);
+    }
+
+    tegra_template_push_param(tmpl, SB_SBFORMAT);
+    tegra_template_push_param(tmpl, SB_CONTROLSB);
+    tegra_template_push(tmpl, 0x00000000); /* controlsecond */
+    tegra_template_push_param(tmpl, SB_CONTROLMAIN);
+
+    tegra_template_push(tmpl, HOST1X_OPCODE_MASK(0x044, 0x35));
+    tegra_template_push_param(tmpl, SB_UVSTRIDE);
+    tegra_template_push_param(tmpl, SB_TILEMODE);
+    tegra_template_push_reloc(tmpl, SB_SRCBA_SB);
+    tegra_template_push_reloc(tmpl, SB_DSTBA_SB);
+
+    tegra_template_push(tmpl, HOST1X_OPCODE_MASK(0x02b, 0x3149));
+    tegra_template_push_reloc(tmpl, SB_DSTBA);
+    tegra_template_push_param(tmpl, SB_DSTST);
+    tegra_template_push_reloc(tmpl, SB_SRCBA);
+    tegra_template_push_param(tmpl, SB_SRCST);
+    tegra_template_push_param(tmpl, SB_SRCSIZE);
+    tegra_template_push_param(tmpl, SB_DSTSIZE);
+}
+
+/*
+ * Commands of a given operation only differ by a few words from frame
+ * to frame, so they are recorded once and replayed with patched slots.
+ */
+static void gr2d_record_templates(void)
+{
+    gr2d_record_fill(&gr2d_fill_tmpl, false);
+    gr2d_record_fill(&gr2d_fill_clipped_tmpl, true);
+    gr2d_record_blit(&gr2d_blit_tmpl);
+    gr2d_record_surface_blit(&gr2d_sb_rgb_tmpl, false);
+    gr2d_record_surface_blit(&gr2d_sb_yuv_tmpl, true);
+}
+
 int host1x_gr2d_clear(struct tegra_stream *stream,
                       struct host1x_pixelbuffer *pixbuf,
                       uint32_t color)
@@ -41,6 +233,8 @@ int host1x_gr2d_clear_rect(struct tegra_stream *stream,
                            unsigned x, unsigned y,
                            unsigned width, unsigned height)
 {
+    uint32_t params[TEGRA_TEMPLATE_MAX_PARAMS];
+    struct tegra_reloc relocs[TEGRA_TEMPLATE_MAX_RELOCS];
     VdpTime time = 0;
     unsigned tiled = 0;
     int err;
@@ -70,43 +264,38 @@ int host1x_gr2d_clear_rect(struct tegra_stream *stream,
         return -EINVAL;
     }
 
+    params[FILL_CONTROLSECOND] = 0x00000000;
+    params[FILL_CONTROLMAIN] =
+            (PIX_BUF_FORMAT_BYTES(pixbuf->format) >> 1) << 16 |
+            1 << 6 | /* srcsld */
+            1 << 2 /* turbofill */;
+    params[FILL_DSTST] = pixbuf->pitch;
+    params[FILL_COLOR] = color;
+    params[FILL_TILEMODE] = tiled << 20;
+    params[FILL_DSTSIZE] = height << 16 | width;
+    params[FILL_DSTPS] = y << 16 | x;
+
+    relocs[FILL_DSTBA] = tegra_reloc(NULL, pixbuf->bo, pixbuf->bo_offset, 0);
+
+    pthread_once(&gr2d_templates_once, gr2d_record_templates);
+
+    host1x_pixelbuffer_depend(pixbuf, true);
+
     err = tegra_stream_begin(stream);
     if (err)
         return err;
 
-    tegra_stream_push_setclass(stream, HOST1X_CLASS_GR2D);
-    tegra_stream_push(stream, HOST1X_OPCODE_MASK(0x09, 9));
-    tegra_stream_push(stream, 0x0000003a);
-    tegra_stream_push(stream, 0x00000000);
-    tegra_stream_push(stream, HOST1X_OPCODE_MASK(0x1e, 7));
-    tegra_stream_push(stream, 0x00000000); /* controlsecond */
-    tegra_stream_push(stream, /* controlmain */
-                      (PIX_BUF_FORMAT_BYTES(pixbuf->format) >> 1) << 16 |
-                      1 << 6 | /* srcsld */
-                      1 << 2 /* turbofill */);
-    tegra_stream_push(stream, 0x000000cc);
-    tegra_stream_push(stream, HOST1X_OPCODE_MASK(0x2b, 9));
-    tegra_stream_push_reloc(stream, pixbuf->bo, pixbuf->bo_offset);
-    tegra_stream_push(stream, pixbuf->pitch);
-    tegra_stream_push(stream, HOST1X_OPCODE_NONINCR(0x35, 1));
-    tegra_stream_push(stream, color);
-    tegra_stream_push(stream, HOST1X_OPCODE_NONINCR(0x46, 1));
-    tegra_stream_push(stream, tiled << 20); /* tilemode */
-    tegra_stream_push(stream, HOST1X_OPCODE_MASK(0x38, 5));
-    tegra_stream_push(stream, height << 16 | width);
-    tegra_stream_push(stream, y << 16 | x);
+    tegra_stream_push_template(stream, &gr2d_fill_tmpl, params, relocs);
 
     err = tegra_stream_end(stream);
     if (err)
         return err;
 
-    err = tegra_stream_flush(stream);
+    err = host1x_pixelbuffer_submit(stream, true, NULL, pixbuf);
     if (err)
         return err;
 
-    host1x_pixelbuffer_check_guard(pixbuf);
-
-    DebugMsg("waited for %llu usec\n", (get_time() - time) / 1000);
+    DebugMsg("submitted in %llu usec\n", (get_time() - time) / 1000);
 
     return 0;
 }
@@ -120,6 +309,8 @@ int host1x_gr2d_clear_rect_clipped(struct tegra_stream *stream,
                                    unsigned clip_x1, unsigned clip_y1,
                                    bool draw_outside)
 {
+    uint32_t params[TEGRA_TEMPLATE_MAX_PARAMS];
+    struct tegra_reloc relocs[TEGRA_TEMPLATE_MAX_RELOCS];
     VdpTime time = 0;
     unsigned tiled = 0;
     int err;
@@ -171,46 +362,41 @@ int host1x_gr2d_clear_rect_clipped(struct tegra_stream *stream,
         return -EINVAL;
     }
 
+    /* clip inside/outside */
+    params[FILL_CONTROLSECOND] = (draw_outside ? 3 : 2) << 21;
+    params[FILL_CONTROLMAIN] =
+            (PIX_BUF_FORMAT_BYTES(pixbuf->format) >> 1) << 16 |
+            1 << 6 /* srcsld */;
+    params[FILL_CLIP0] = clip_y0 << 16 | clip_x0;
+    params[FILL_CLIP1] = clip_y1 << 16 | clip_x1;
+    params[FILL_DSTST] = pixbuf->pitch;
+    params[FILL_COLOR] = color;
+    params[FILL_TILEMODE] = tiled << 20;
+    params[FILL_DSTSIZE] = height << 16 | width;
+    params[FILL_DSTPS] = y << 16 | x;
+
+    relocs[FILL_DSTBA] = tegra_reloc(NULL, pixbuf->bo, pixbuf->bo_offset, 0);
+
+    pthread_once(&gr2d_templates_once, gr2d_record_templates);
+
+    host1x_pixelbuffer_depend(pixbuf, true);
+
     err = tegra_stream_begin(stream);
     if (err)
         return err;
 
-    tegra_stream_push_setclass(stream, HOST1X_CLASS_GR2D);
-    tegra_stream_push(stream, HOST1X_OPCODE_MASK(0x09, 9));
-    tegra_stream_push(stream, 0x0000003a);
-    tegra_stream_push(stream, 0x00000000);
-    tegra_stream_push(stream, HOST1X_OPCODE_MASK(0x1e, 7));
-    tegra_stream_push(stream, /* controlsecond */
-                      (draw_outside ? 3 : 2) << 21 /* clip inside/outside */);
-    tegra_stream_push(stream, /* controlmain */
-                      (PIX_BUF_FORMAT_BYTES(pixbuf->format) >> 1) << 16 |
-                      1 << 6 /* srcsld */);
-    tegra_stream_push(stream, 0x000000cc);
-    tegra_stream_push(stream, HOST1X_OPCODE_INCR(0x22, 2));
-    tegra_stream_push(stream, clip_y0 << 16 | clip_x0);
-    tegra_stream_push(stream, clip_y1 << 16 | clip_x1);
-    tegra_stream_push(stream, HOST1X_OPCODE_MASK(0x2b, 9));
-    tegra_stream_push_reloc(stream, pixbuf->bo, pixbuf->bo_offset);
-    tegra_stream_push(stream, pixbuf->pitch);
-    tegra_stream_push(stream, HOST1X_OPCODE_NONINCR(0x35, 1));
-    tegra_stream_push(stream, color);
-    tegra_stream_push(stream, HOST1X_OPCODE_NONINCR(0x46, 1));
-    tegra_stream_push(stream, tiled << 20); /* tilemode */
-    tegra_stream_push(stream, HOST1X_OPCODE_MASK(0x38, 5));
-    tegra_stream_push(stream, height << 16 | width);
-    tegra_stream_push(stream, y << 16 | x);
+    tegra_stream_push_template(stream, &gr2d_fill_clipped_tmpl,
+                               params, relocs);
 
     err = tegra_stream_end(stream);
     if (err)
         return err;
 
-    err = tegra_stream_flush(stream);
+    err = host1x_pixelbuffer_submit(stream, true, NULL, pixbuf);
     if (err)
         return err;
 
-    host1x_pixelbuffer_check_guard(pixbuf);
-
-    DebugMsg("waited for %llu usec\n", (get_time() - time) / 1000);
+    DebugMsg("submitted in %llu usec\n", (get_time() - time) / 1000);
 
     return 0;
 }
@@ -258,6 +444,8 @@ int host1x_gr2d_blit(struct tegra_stream *stream,
                      unsigned int dx, unsigned int dy,
                      unsigned int width, int height)
 {
+    uint32_t params[TEGRA_TEMPLATE_MAX_PARAMS];
+    struct tegra_reloc relocs[TEGRA_TEMPLATE_MAX_RELOCS];
     VdpTime time = 0;
     unsigned src_tiled = 0;
     unsigned dst_tiled = 0;
@@ -399,58 +587,52 @@ yflip_setup:
         fr_mode = 0; /* DISABLE */
     }
 
-    err = tegra_stream_begin(stream);
-    if (err)
-        return err;
-
-    tegra_stream_push_setclass(stream, HOST1X_CLASS_GR2D);
-
-    tegra_stream_push(stream, HOST1X_OPCODE_MASK(0x009, 9));
-    tegra_stream_push(stream, 0x0000003a); /* trigger */
-    tegra_stream_push(stream, 0x00000000); /* cmdsel */
-
-    tegra_stream_push(stream, HOST1X_OPCODE_MASK(0x01e, 0x7));
-    tegra_stream_push(stream, rotate << 26 | fr_mode << 24); /* controlsecond */
+    params[BLIT_CONTROLSECOND] = rotate << 26 | fr_mode << 24;
     /*
      * [20:20] source color depth (0: mono, 1: same)
      * [17:16] destination color depth (0: 8 bpp, 1: 16 bpp, 2: 32 bpp)
      */
-    tegra_stream_push(stream, /* controlmain */
-                      1 << 20 |
-                      (PIX_BUF_FORMAT_BYTES(dst->format) >> 1) << 16 |
-                      yflip << 14 | ydir << 10 | xdir << 9);
-    tegra_stream_push(stream, 0x000000cc); /* ropfade */
-
-    tegra_stream_push(stream, HOST1X_OPCODE_NONINCR(0x046, 1));
+    params[BLIT_CONTROLMAIN] =
+            1 << 20 |
+            (PIX_BUF_FORMAT_BYTES(dst->format) >> 1) << 16 |
+            yflip << 14 | ydir << 10 | xdir << 9;
     /*
      * [20:20] destination write tile mode (0: linear, 1: tiled)
      * [ 0: 0] tile mode Y/RGB (0: linear, 1: tiled)
      */
-    tegra_stream_push(stream, dst_tiled << 20 | src_tiled); /* tilemode */
-
-    tegra_stream_push(stream, HOST1X_OPCODE_MASK(0x02b, 0xf149));
-    tegra_stream_push_reloc(stream, dst->bo,
-                            dst->bo_offset + dst_offset); /* dstba */
-    tegra_stream_push(stream, dst->pitch); /* dstst */
-    tegra_stream_push_reloc(stream, src->bo,
-                            src->bo_offset + src_offset); /* srcba */
-    tegra_stream_push(stream, src->pitch); /* srcst */
-    tegra_stream_push(stream, src_height << 16 | src_width); /* srcsize */
-    tegra_stream_push(stream, dst_height << 16 | dst_width); /* dstsize */
-    tegra_stream_push(stream, sy << 16 | sx); /* srcps */
-    tegra_stream_push(stream, dy << 16 | dx); /* dstps */
+    params[BLIT_TILEMODE] = dst_tiled << 20 | src_tiled;
+    params[BLIT_DSTST] = dst->pitch;
+    params[BLIT_SRCST] = src->pitch;
+    params[BLIT_SRCSIZE] = src_height << 16 | src_width;
+    params[BLIT_DSTSIZE] = dst_height << 16 | dst_width;
+    params[BLIT_SRCPS] = sy << 16 | sx;
+    params[BLIT_DSTPS] = dy << 16 | dx;
 
-    err = tegra_stream_end(stream);
+    relocs[BLIT_DSTBA] = tegra_reloc(NULL, dst->bo,
+                                     dst->bo_offset + dst_offset, 0);
+    relocs[BLIT_SRCBA] = tegra_reloc(NULL, src->bo,
+                                     src->bo_offset + src_offset, 0);
+
+    pthread_once(&gr2d_templates_once, gr2d_record_templates);
+
+    host1x_pixelbuffer_depend(src, true);
+    host1x_pixelbuffer_depend(dst, true);
+
+    err = tegra_stream_begin(stream);
     if (err)
         return err;
 
-    err = tegra_stream_flush(stream);
+    tegra_stream_push_template(stream, &gr2d_blit_tmpl, params, relocs);
+
+    err = tegra_stream_end(stream);
     if (err)
         return err;
 
-    host1x_pixelbuffer_check_guard(dst);
+    err = host1x_pixelbuffer_submit(stream, true, src, dst);
+    if (err)
+        return err;
 
-    DebugMsg("waited for %llu usec\n", (get_time() - time) / 1000);
+    DebugMsg("submitted in %llu usec\n", (get_time() - time) / 1000);
 
     return 0;
 }
@@ -464,6 +646,11 @@ int host1x_gr2d_surface_blit(struct tegra_stream *stream,
                              unsigned int dx, unsigned int dy,
                              unsigned int dst_width, int dst_height)
 {
+    const struct tegra_stream_template *tmpl;
+    uint32_t params[TEGRA_TEMPLATE_MAX_PARAMS];
+    struct tegra_reloc relocs[TEGRA_TEMPLATE_MAX_RELOCS];
+    uint32_t src_offset, dst_offset;
+    uint32_t uba_offset, vba_offset;
     VdpTime time = 0;
     float inv_scale_x;
     float inv_scale_y;
@@ -619,99 +806,81 @@ coords_check:
     src_height = max(src_height, 0);
     dst_height = max(dst_height, 0);
 
-    err = tegra_stream_begin(stream);
-    if (err)
-        return err;
-
-    tegra_stream_push_setclass(stream, HOST1X_CLASS_GR2D_SB);
-
-    tegra_stream_push(stream, HOST1X_OPCODE_MASK(0x009, 0xF09));
-    tegra_stream_push(stream, 0x00000038); /* trigger */
-    tegra_stream_push(stream, 0x00000001); /* cmdsel */
-    tegra_stream_push(stream, FLOAT_TO_FIXED_6_12(inv_scale_y)); /* vdda */
-    tegra_stream_push(stream, FLOAT_TO_FIXED_0_8(sy)); /* vddaini */
-    tegra_stream_push(stream, FLOAT_TO_FIXED_6_12(inv_scale_x)); /* hdda */
-    tegra_stream_push(stream, FLOAT_TO_FIXED_0_8(sx)); /* hddainils */
-
-    /* CSC RGB -> RGB coefficients */
-    if (src->format != PIX_BUF_FMT_YV12) {
-        tegra_stream_push(stream, HOST1X_OPCODE_MASK(0x15, 0x787));
-
-        tegra_stream_push(stream, csc->yos << 24 | csc->cvr << 12 | csc->cub); /* cscfirst */
-        tegra_stream_push(stream, csc->cyx << 24 | csc->cur << 12 | csc->cug); /* cscsecond */
-        tegra_stream_push(stream, csc->cvb << 16 | csc->cvg); /* cscthird */
-    } else {
-        /* tile mode */
-        tegra_stream_push(stream, HOST1X_OPCODE_MASK(0x04b, 3));
-        tegra_stream_push_reloc(stream, src->bos[2], /* vba */
-                                src->bos_offset[2] + sb_offset(src, sx, sy, true));
-        tegra_stream_push_reloc(stream, src->bos[1], /* uba */
-                                src->bos_offset[1] + sb_offset(src, sx, sy, true));
-
-        tegra_stream_push(stream, HOST1X_OPCODE_MASK(0x15, 0x7E7));
-
-        tegra_stream_push(stream, csc->yos << 24 | csc->cvr << 12 | csc->cub); /* cscfirst */
-        tegra_stream_push(stream, csc->cyx << 24 | csc->cur << 12 | csc->cug); /* cscsecond */
-        tegra_stream_push(stream, csc->cvb << 16 | csc->cvg); /* cscthird */
-
-        /* linear mode */
-        tegra_stream_push_reloc(stream, src->bos[1], /* uba */
-                                src->bos_offset[1] + sb_offset(src, sx, sy, true));
-        tegra_stream_push_reloc(stream, src->bos[2], /* vba */
-                                src->bos_offset[2] + sb_offset(src, sx, sy, true));
-    }
-
-    tegra_stream_push(stream, dst_fmt << 8 | src_fmt); /* sbformat */
-    tegra_stream_push(stream, /* controlsb */
-                      hftype << 20 | vfen << 18 | vftype << 16 |
-                      (3 << 8) /* uvst */ |
-                      ((src->format == PIX_BUF_FMT_YV12) << 5) /* imode */);
-    tegra_stream_push(stream, 0x00000000); /* controlsecond */
+    params[SB_VDDA] = FLOAT_TO_FIXED_6_12(inv_scale_y);
+    params[SB_VDDAINI] = FLOAT_TO_FIXED_0_8(sy);
+    params[SB_HDDA] = FLOAT_TO_FIXED_6_12(inv_scale_x);
+    params[SB_HDDAINILS] = FLOAT_TO_FIXED_0_8(sx);
+    params[SB_CSCFIRST] = csc->yos << 24 | csc->cvr << 12 | csc->cub;
+    params[SB_CSCSECOND] = csc->cyx << 24 | csc->cur << 12 | csc->cug;
+    params[SB_CSCTHIRD] = csc->cvb << 16 | csc->cvg;
+    params[SB_SBFORMAT] = dst_fmt << 8 | src_fmt;
+    params[SB_CONTROLSB] =
+            hftype << 20 | vfen << 18 | vftype << 16 |
+            (3 << 8) /* uvst */ |
+            ((src->format == PIX_BUF_FMT_YV12) << 5) /* imode */;
     /*
      * [20:20] source color depth (0: mono, 1: same)
      * [17:16] destination color depth (0: 8 bpp, 1: 16 bpp, 2: 32 bpp)
      */
-    tegra_stream_push(stream, /* controlmain */
-                      1 << 28 | 1 << 27 |
-                      (PIX_BUF_FORMAT_BYTES(dst->format) >> 1) << 16 |
-                      yflip << 14);
-
-    tegra_stream_push(stream, HOST1X_OPCODE_MASK(0x044, 0x35));
-    tegra_stream_push(stream, src->pitch_uv); /* uvstride */
+    params[SB_CONTROLMAIN] =
+            1 << 28 | 1 << 27 |
+            (PIX_BUF_FORMAT_BYTES(dst->format) >> 1) << 16 |
+            yflip << 14;
+    params[SB_UVSTRIDE] = src->pitch_uv;
     /*
      * [20:20] destination write tile mode (0: linear, 1: tiled)
      * [ 4: 4] tile mode UV (0: linear, 1: tiled)
      * [ 0: 0] tile mode Y/RGB (0: linear, 1: tiled)
      */
-    tegra_stream_push(stream, dst_tiled << 20 | src_tiled << 4 | src_tiled); /* tilemode */
-    tegra_stream_push_reloc(stream, src->bo, /* srcba_sb_surfbase */
-                            src->bo_offset + sb_offset(src, sx, sy, false));
-    tegra_stream_push_reloc(stream, dst->bo, /* dstba_sb_surfbase */
-                            dst->bo_offset + sb_offset(dst, dx, dy, false) +
-                                yflip * dst->pitch * dst_height);
-
-    tegra_stream_push(stream, HOST1X_OPCODE_MASK(0x02b, 0x3149));
-    tegra_stream_push_reloc(stream, dst->bo, /* dstba */
-                            dst->bo_offset + sb_offset(dst, dx, dy, false) +
-                                yflip * dst->pitch * dst_height);
-    tegra_stream_push(stream, dst->pitch); /* dstst */
-    tegra_stream_push_reloc(stream, src->bo, /* srcba */
-                            src->bo_offset + sb_offset(src, sx, sy, false));
-    tegra_stream_push(stream, src->pitch); /* srcst */
-    tegra_stream_push(stream, src_height << 16 | src_width); /* srcsize */
-    tegra_stream_push(stream, dst_height << 16 | dst_width); /* dstsize */
+    params[SB_TILEMODE] = dst_tiled << 20 | src_tiled << 4 | src_tiled;
+    params[SB_DSTST] = dst->pitch;
+    params[SB_SRCST] = src->pitch;
+    params[SB_SRCSIZE] = src_height << 16 | src_width;
+    params[SB_DSTSIZE] = dst_height << 16 | dst_width;
+
+    src_offset = src->bo_offset + sb_offset(src, sx, sy, false);
+    dst_offset = dst->bo_offset + sb_offset(dst, dx, dy, false) +
+                    yflip * dst->pitch * dst_height;
+
+    relocs[SB_SRCBA_SB] = tegra_reloc(NULL, src->bo, src_offset, 0);
+    relocs[SB_DSTBA_SB] = tegra_reloc(NULL, dst->bo, dst_offset, 0);
+    relocs[SB_DSTBA] = tegra_reloc(NULL, dst->bo, dst_offset, 0);
+    relocs[SB_SRCBA] = tegra_reloc(NULL, src->bo, src_offset, 0);
+
+    if (src->format == PIX_BUF_FMT_YV12) {
+        uba_offset = src->bos_offset[1] + sb_offset(src, sx, sy, true);
+        vba_offset = src->bos_offset[2] + sb_offset(src, sx, sy, true);
+
+        relocs[SB_VBA_TILE] = tegra_reloc(NULL, src->bos[2], vba_offset, 0);
+        relocs[SB_UBA_TILE] = tegra_reloc(NULL, src->bos[1], uba_offset, 0);
+        relocs[SB_UBA] = tegra_reloc(NULL, src->bos[1], uba_offset, 0);
+        relocs[SB_VBA] = tegra_reloc(NULL, src->bos[2], vba_offset, 0);
+
+        tmpl = &gr2d_sb_yuv_tmpl;
+    } else {
+        tmpl = &gr2d_sb_rgb_tmpl;
+    }
 
-    err = tegra_stream_end(stream);
+    pthread_once(&gr2d_templates_once, gr2d_record_templates);
+
+    host1x_pixelbuffer_depend(src, true);
+    host1x_pixelbuffer_depend(dst, true);
+
+    err = tegra_stream_begin(stream);
     if (err)
         return err;
 
-    err = tegra_stream_flush(stream);
+    tegra_stream_push_template(stream, tmpl, params, relocs);
+
+    err = tegra_stream_end(stream);
     if (err)
         return err;
 
-    host1x_pixelbuffer_check_guard(dst);
+    err = host1x_pixelbuffer_submit(stream, true, src, dst);
+    if (err)
+        return err;
 
-    DebugMsg("waited for %llu usec\n", (get_time() - time) / 1000);
+    DebugMsg("submitted in %llu usec\n", (get_time() - time) / 1000);
 
     return 0;
 }
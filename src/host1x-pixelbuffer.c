@@ -29,6 +29,8 @@
 
 static bool pixbuf_guard_disabled = true;
 
+static pthread_mutex_t fence_lock = PTHREAD_MUTEX_INITIALIZER;
+
 struct host1x_pixelbuffer *host1x_pixelbuffer_create(struct drm_tegra *drm,
                                                      unsigned width,
                                                      unsigned height,
@@ -174,6 +176,15 @@ struct host1x_pixelbuffer *host1x_pixelbuffer_wrap(struct drm_tegra_bo **bos,
 
 void host1x_pixelbuffer_free(struct host1x_pixelbuffer *pixbuf)
 {
+    /*
+     * Jobs keep BOs alive, but unreferenced BOs go to the BO cache and
+     * could be handed to a new surface while the jobs still write them.
+     */
+    host1x_pixelbuffer_sync(pixbuf);
+
+    tegra_stream_put_fence(pixbuf->gr2d_fence);
+    tegra_stream_put_fence(pixbuf->gr3d_fence);
+
     drm_tegra_bo_unref(pixbuf->bos[0]);
     drm_tegra_bo_unref(pixbuf->bos[1]);
     drm_tegra_bo_unref(pixbuf->bos[2]);
@@ -212,6 +223,10 @@ int host1x_pixelbuffer_load_data(struct drm_tegra *drm,
             return -1;
     } else {
         tmp = pixbuf;
+
+        ret = host1x_pixelbuffer_sync(pixbuf);
+        if (ret < 0)
+            return ret;
     }
 
     ret = drm_tegra_bo_map(tmp->bo, &map);
@@ -340,3 +355,94 @@ void host1x_pixelbuffer_disable_bo_guard(void)
 {
     pixbuf_guard_disabled = true;
 }
+
+/*
+ * Jobs are submitted without waiting for their completion. Jobs of the
+ * same engine are executed in submission order, hence a job only needs
+ * to wait for the jobs of the other engine that accessed its pixbufs.
+ * CPU and display wait for both engines with host1x_pixelbuffer_sync().
+ */
+static struct tegra_fence **pixbuf_fence(struct host1x_pixelbuffer *pixbuf,
+                                         bool gr2d)
+{
+    return gr2d ? &pixbuf->gr2d_fence : &pixbuf->gr3d_fence;
+}
+
+static void pixbuf_wait_fence(struct host1x_pixelbuffer *pixbuf, bool gr2d)
+{
+    struct tegra_fence **slot = pixbuf_fence(pixbuf, gr2d);
+    struct tegra_fence *f;
+
+    pthread_mutex_lock(&fence_lock);
+    f = *slot;
+    if (f)
+        tegra_stream_ref_fence(f, f->opaque);
+    pthread_mutex_unlock(&fence_lock);
+
+    if (!f)
+        return;
+
+    tegra_stream_wait_fence(f);
+
+    /* fence could be replaced by a newer job while we were waiting */
+    pthread_mutex_lock(&fence_lock);
+    if (*slot == f) {
+        tegra_stream_put_fence(f);
+        *slot = NULL;
+    }
+    pthread_mutex_unlock(&fence_lock);
+
+    tegra_stream_put_fence(f);
+}
+
+static void pixbuf_set_fence(struct host1x_pixelbuffer *pixbuf,
+                             struct tegra_fence *f)
+{
+    struct tegra_fence **slot;
+
+    if (!pixbuf)
+        return;
+
+    slot = pixbuf_fence(pixbuf, f->gr2d);
+    if (*slot == f)
+        return;
+
+    tegra_stream_put_fence(*slot);
+    *slot = tegra_stream_ref_fence(f, f->opaque);
+}
+
+void host1x_pixelbuffer_depend(struct host1x_pixelbuffer *pixbuf, bool gr2d)
+{
+    if (pixbuf)
+        pixbuf_wait_fence(pixbuf, !gr2d);
+}
+
+int host1x_pixelbuffer_submit(struct tegra_stream *stream, bool gr2d,
+                              struct host1x_pixelbuffer *src,
+                              struct host1x_pixelbuffer *dst)
+{
+    struct tegra_fence *f;
+
+    /* fence is owned by the stream, NULL on failure */
+    f = tegra_stream_submit(stream, gr2d);
+    if (!f)
+        return -1;
+
+    pthread_mutex_lock(&fence_lock);
+    pixbuf_set_fence(src, f);
+    pixbuf_set_fence(dst, f);
+    pthread_mutex_unlock(&fence_lock);
+
+    return 0;
+}
+
+int host1x_pixelbuffer_sync(struct host1x_pixelbuffer *pixbuf)
+{
+    if (!pixbuf)
+        return 0;
+
+    pixbuf_wait_fence(pixbuf, true);
+    pixbuf_wait_fence(pixbuf, false);
+
+    return host1x_pixelbuffer_check_guard(pixbuf);
+}
@@ -0,0 +1,674 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Offline decoder of jobs captured with VDPAU_TEGRA_CAPTURE=<file>.
+ *
+ * Register writes are tracked per engine, assuming that registers keep
+ * their values between jobs. A write of the value that register already
+ * holds is reported as redundant, a write that changes the value left by
+ * the previous job of the engine is counted as state churn.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host1x.h"
+#include "host1x-capture.h"
+#include "tgr_3d.xml.h"
+
+#define NUM_REGS        0x1000
+#define TOP_REGS        10
+
+enum engine {
+    ENGINE_HOST1X,
+    ENGINE_GR2D,
+    ENGINE_GR3D,
+    ENGINE_UNKNOWN,
+    NUM_ENGINES,
+};
+
+static const char * const engine_names[NUM_ENGINES] = {
+    [ENGINE_HOST1X]  = "host1x",
+    [ENGINE_GR2D]    = "gr2d",
+    [ENGINE_GR3D]    = "gr3d",
+    [ENGINE_UNKNOWN] = "unknown",
+};
+
+struct reg_desc {
+    unsigned int offset;
+    unsigned int count;
+    unsigned int stride;
+    const char *name;
+    /* write has a side effect, e.g. data port or trigger */
+    bool action;
+};
+
+#define REG(offset, name)       { offset, 1, 1, name, false }
+#define ACTION(offset, name)    { offset, 1, 1, name, true }
+#define ARRAY(name)             { TGR3D_##name(0), TGR3D_##name##__LEN, \
+                                  TGR3D_##name##__ESIZE, #name, false }
+
+static const struct reg_desc host1x_regs[] = {
+    ACTION(0x00, "INCR_SYNCPT"),
+    ACTION(0x08, "WAIT_SYNCPT"),
+    ACTION(0x09, "WAIT_SYNCPT_BASE"),
+    ACTION(0x0b, "LOAD_SYNCPT_BASE"),
+    ACTION(0x0c, "INCR_SYNCPT_BASE"),
+    { },
+};
+
+/* offsets of registers programmed by host1x-gr2d.c */
+static const struct reg_desc gr2d_regs[] = {
+    ACTION(0x00, "INCR_SYNCPT"),
+    ACTION(0x08, "WAIT_SYNCPT"),
+    REG(0x09, "TRIGGER"),
+    REG(0x0c, "CMDSEL"),
+    REG(0x11, "VDDA"),
+    REG(0x12, "VDDAINI"),
+    REG(0x13, "HDDA"),
+    REG(0x14, "HDDAINILS"),
+    REG(0x15, "CSCFIRST"),
+    REG(0x16, "CSCSECOND"),
+    REG(0x17, "CSCTHIRD"),
+    REG(0x1a, "UBA"),
+    REG(0x1b, "VBA"),
+    REG(0x1c, "SBFORMAT"),
+    REG(0x1d, "CONTROLSB"),
+    REG(0x1e, "CONTROLSECOND"),
+    REG(0x1f, "CONTROLMAIN"),
+    REG(0x20, "ROPFADE"),
+    REG(0x22, "CLIP_LEFTTOP"),
+    REG(0x23, "CLIP_RIGHTBOT"),
+    REG(0x2b, "DSTBA"),
+    REG(0x2e, "DSTST"),
+    REG(0x31, "SRCBA"),
+    REG(0x33, "SRCST"),
+    REG(0x35, "SRCFGC"),
+    REG(0x37, "SRCSIZE"),
+    REG(0x38, "DSTSIZE"),
+    REG(0x39, "SRCPS"),
+    REG(0x3a, "DSTPS"),
+    REG(0x44, "UVSTRIDE"),
+    REG(0x46, "TILEMODE"),
+    REG(0x48, "SRCBA_SB_SURFBASE"),
+    REG(0x49, "DSTBA_SB_SURFBASE"),
+    REG(0x4b, "VBA_TILE"),
+    REG(0x4c, "UBA_TILE"),
+    { },
+};
+
+static const struct reg_desc gr3d_regs[] = {
+    ACTION(TGR3D_INCR_SYNCPT, "INCR_SYNCPT"),
+    ACTION(TGR3D_WAIT_SYNCPT, "WAIT_SYNCPT"),
+    ACTION(TGR3D_WAIT_SYNCPT_BASE, "WAIT_SYNCPT_BASE"),
+    ACTION(TGR3D_LOAD_SYNCPT_BASE, "LOAD_SYNCPT_BASE"),
+    ACTION(TGR3D_INCR_SYNCPT_BASE, "INCR_SYNCPT_BASE"),
+    REG(TGR3D_INDOFF2, "INDOFF2"),
+    REG(TGR3D_INDOFF, "INDOFF"),
+    ARRAY(ATTRIB_PTR),
+    ARRAY(ATTRIB_MODE),
+    REG(TGR3D_VP_ATTRIB_IN_OUT_SELECT, "VP_ATTRIB_IN_OUT_SELECT"),
+    REG(TGR3D_INDEX_PTR, "INDEX_PTR"),
+    REG(TGR3D_DRAW_PARAMS, "DRAW_PARAMS"),
+    ACTION(TGR3D_DRAW_PRIMITIVES, "DRAW_PRIMITIVES"),
+    ACTION(TGR3D_VP_UPLOAD_INST_ID, "VP_UPLOAD_INST_ID"),
+    ACTION(TGR3D_VP_UPLOAD_INST, "VP_UPLOAD_INST"),
+    ACTION(TGR3D_VP_UPLOAD_CONST_ID, "VP_UPLOAD_CONST_ID"),
+    ACTION(TGR3D_VP_UPLOAD_CONST, "VP_UPLOAD_CONST"),
+    ARRAY(LINKER_INSTRUCTION),
+    REG(TGR3D_CULL_FACE_LINKER_SETUP, "CULL_FACE_LINKER_SETUP"),
+    REG(TGR3D_POLYGON_OFFSET_UNITS, "POLYGON_OFFSET_UNITS"),
+    REG(TGR3D_POLYFON_OFFSET_FACTOR, "POLYGON_OFFSET_FACTOR"),
+    REG(TGR3D_POINT_PARAMS, "POINT_PARAMS"),
+    REG(TGR3D_POINT_SIZE, "POINT_SIZE"),
+    REG(TGR3D_POINT_COORD_RANGE_MAX_S, "POINT_COORD_RANGE_MAX_S"),
+    REG(TGR3D_POINT_COORD_RANGE_MAX_T, "POINT_COORD_RANGE_MAX_T"),
+    REG(TGR3D_POINT_COORD_RANGE_MIN_S, "POINT_COORD_RANGE_MIN_S"),
+    REG(TGR3D_POINT_COORD_RANGE_MIN_T, "POINT_COORD_RANGE_MIN_T"),
+    REG(TGR3D_LINE_PARAMS, "LINE_PARAMS"),
+    REG(TGR3D_HALF_LINE_WIDTH, "HALF_LINE_WIDTH"),
+    REG(TGR3D_SCISSOR_HORIZ, "SCISSOR_HORIZ"),
+    REG(TGR3D_SCISSOR_VERT, "SCISSOR_VERT"),
+    REG(TGR3D_VIEWPORT_X_BIAS, "VIEWPORT_X_BIAS"),
+    REG(TGR3D_VIEWPORT_Y_BIAS, "VIEWPORT_Y_BIAS"),
+    REG(TGR3D_VIEWPORT_Z_BIAS, "VIEWPORT_Z_BIAS"),
+    REG(TGR3D_VIEWPORT_X_SCALE, "VIEWPORT_X_SCALE"),
+    REG(TGR3D_VIEWPORT_Y_SCALE, "VIEWPORT_Y_SCALE"),
+    REG(TGR3D_VIEWPORT_Z_SCALE, "VIEWPORT_Z_SCALE"),
+    REG(TGR3D_GUARDBAND_WIDTH, "GUARDBAND_WIDTH"),
+    REG(TGR3D_GUARDBAND_HEIGHT, "GUARDBAND_HEIGHT"),
+    REG(TGR3D_GUARDBAND_DEPTH, "GUARDBAND_DEPTH"),
+    REG(TGR3D_STENCIL_FRONT1, "STENCIL_FRONT1"),
+    REG(TGR3D_STENCIL_BACK1, "STENCIL_BACK1"),
+    REG(TGR3D_STENCIL_PARAMS, "STENCIL_PARAMS"),
+    REG(TGR3D_DEPTH_TEST_PARAMS, "DEPTH_TEST_PARAMS"),
+    REG(TGR3D_DEPTH_RANGE_NEAR, "DEPTH_RANGE_NEAR"),
+    REG(TGR3D_DEPTH_RANGE_FAR, "DEPTH_RANGE_FAR"),
+    ACTION(TGR3D_FP_PSEQ_UPLOAD_INST_BUFFER_FLUSH,
+           "FP_PSEQ_UPLOAD_INST_BUFFER_FLUSH"),
+    REG(TGR3D_FP_PSEQ_ENGINE_INST, "FP_PSEQ_ENGINE_INST"),
+    ACTION(TGR3D_FP_PSEQ_UPLOAD_INST_ID, "FP_PSEQ_UPLOAD_INST_ID"),
+    ACTION(TGR3D_FP_PSEQ_UPLOAD_INST, "FP_PSEQ_UPLOAD_INST"),
+    REG(TGR3D_FP_PSEQ_QUAD_ID, "FP_PSEQ_QUAD_ID"),
+    REG(TGR3D_FP_PSEQ_DW_CFG, "FP_PSEQ_DW_CFG"),
+    ACTION(TGR3D_FP_UPLOAD_MFU_SCHED_ID, "FP_UPLOAD_MFU_SCHED_ID"),
+    ACTION(TGR3D_FP_UPLOAD_MFU_SCHED, "FP_UPLOAD_MFU_SCHED"),
+    ACTION(TGR3D_FP_UPLOAD_MFU_INST_ID, "FP_UPLOAD_MFU_INST_ID"),
+    ACTION(TGR3D_FP_UPLOAD_MFU_INST, "FP_UPLOAD_MFU_INST"),
+    ACTION(TGR3D_FP_UPLOAD_TEX_INST_ID, "FP_UPLOAD_TEX_INST_ID"),
+    ACTION(TGR3D_FP_UPLOAD_TEX_INST, "FP_UPLOAD_TEX_INST"),
+    ARRAY(TEXTURE_POINTER),
+    ARRAY(TEXTURE_DESC1),
+    ARRAY(TEXTURE_DESC2),
+    ACTION(TGR3D_FP_UPLOAD_ALU_SCHED_ID, "FP_UPLOAD_ALU_SCHED_ID"),
+    ACTION(TGR3D_FP_UPLOAD_ALU_SCHED, "FP_UPLOAD_ALU_SCHED"),
+    ACTION(TGR3D_FP_UPLOAD_ALU_INST_ID, "FP_UPLOAD_ALU_INST_ID"),
+    ACTION(TGR3D_FP_UPLOAD_ALU_INST, "FP_UPLOAD_ALU_INST"),
+    ACTION(TGR3D_FP_UPLOAD_ALU_INST_COMPLEMENT,
+           "FP_UPLOAD_ALU_INST_COMPLEMENT"),
+    ARRAY(FP_CONST),
+    ACTION(TGR3D_FP_UPLOAD_DW_INST_ID, "FP_UPLOAD_DW_INST_ID"),
+    ACTION(TGR3D_FP_UPLOAD_DW_INST, "FP_UPLOAD_DW_INST"),
+    REG(TGR3D_RT_ENABLE, "RT_ENABLE"),
+    ACTION(TGR3D_FDC_CONTROL, "FDC_CONTROL"),
+    ARRAY(RT_PTR),
+    ARRAY(RT_PARAMS),
+    REG(TGR3D_ALU_BUFFER_SIZE, "ALU_BUFFER_SIZE"),
+    REG(TGR3D_TRAM_SETUP, "TRAM_SETUP"),
+    REG(TGR3D_FP_UPLOAD_INST_ID_COMMON, "FP_UPLOAD_INST_ID_COMMON"),
+    REG(TGR3D_DITHER, "DITHER"),
+    REG(TGR3D_STENCIL_FRONT2, "STENCIL_FRONT2"),
+    REG(TGR3D_STENCIL_BACK2, "STENCIL_BACK2"),
+    { },
+};
+
+static const struct reg_desc * const engine_regs[NUM_ENGINES] = {
+    [ENGINE_HOST1X] = host1x_regs,
+    [ENGINE_GR2D]   = gr2d_regs,
+    [ENGINE_GR3D]   = gr3d_regs,
+};
+
+struct engine_state {
+    /* register values left by the previous jobs */
+    uint32_t regs[NUM_REGS];
+    bool valid[NUM_REGS];
+
+    unsigned long redundant[NUM_REGS];
+    unsigned long changed[NUM_REGS];
+
+    unsigned long jobs;
+    unsigned long words;
+    unsigned long max_words;
+    unsigned long relocs;
+    unsigned long writes;
+    unsigned long total_redundant;
+    unsigned long total_changed;
+    uint64_t first_timestamp;
+    uint64_t last_timestamp;
+};
+
+struct job_state {
+    struct engine_state *engine;
+    enum engine engine_id;
+    const uint32_t *reloc_words;
+    unsigned int num_relocs;
+    unsigned long writes;
+    unsigned long redundant;
+    unsigned long changed;
+};
+
+static struct engine_state engines[NUM_ENGINES];
+static bool summary_only;
+
+static enum engine class_engine(uint32_t class_id)
+{
+    switch (class_id) {
+    case HOST1X_CLASS_HOST1X:
+        return ENGINE_HOST1X;
+    case HOST1X_CLASS_GR2D:
+    case HOST1X_CLASS_GR2D_SB:
+        /* both classes program registers of the same unit */
+        return ENGINE_GR2D;
+    case HOST1X_CLASS_GR3D:
+        return ENGINE_GR3D;
+    default:
+        return ENGINE_UNKNOWN;
+    }
+}
+
+static const struct reg_desc *find_reg(enum engine engine, unsigned int reg,
+                                       unsigned int *index)
+{
+    const struct reg_desc *desc = engine_regs[engine];
+
+    if (!desc)
+        return NULL;
+
+    for (; desc->name; desc++) {
+        if (reg < desc->offset)
+            continue;
+
+        if ((reg - desc->offset) % desc->stride)
+            continue;
+
+        if ((reg - desc->offset) / desc->stride >= desc->count)
+            continue;
+
+        *index = (reg - desc->offset) / desc->stride;
+
+        return desc;
+    }
+
+    return NULL;
+}
+
+static const char *reg_name(enum engine engine, unsigned int reg)
+{
+    static char name[64];
+    const struct reg_desc *desc;
+    unsigned int index;
+
+    desc = find_reg(engine, reg, &index);
+    if (!desc)
+        snprintf(name, sizeof(name), "0x%03x", reg);
+    else if (desc->count > 1)
+        snprintf(name, sizeof(name), "%s[%u]", desc->name, index);
+    else
+        snprintf(name, sizeof(name), "%s", desc->name);
+
+    return name;
+}
+
+static bool reg_is_action(struct job_state *job, unsigned int reg)
+{
+    struct engine_state *state = job->engine;
+    const struct reg_desc *desc;
+    unsigned int index;
+
+    if (job->engine_id == ENGINE_HOST1X || job->engine_id == ENGINE_UNKNOWN)
+        return true;
+
+    /* GR2D starts operation on a write to the register set by TRIGGER */
+    if (job->engine_id == ENGINE_GR2D && state->valid[0x09] &&
+        reg == (state->regs[0x09] & 0xfff))
+        return true;
+
+    desc = find_reg(job->engine_id, reg, &index);
+
+    return desc && desc->action;
+}
+
+static bool is_reloc(struct job_state *job, unsigned int word)
+{
+    unsigned int i;
+
+    for (i = 0; i < job->num_relocs; i++) {
+        if (job->reloc_words[i] == word)
+            return true;
+    }
+
+    return false;
+}
+
+static void write_reg(struct job_state *job, unsigned int reg,
+                      uint32_t value, unsigned int word, bool port)
+{
+    struct engine_state *state = job->engine;
+    bool reloc = word != ~0u && is_reloc(job, word);
+    const char *note = "";
+
+    reg &= NUM_REGS - 1;
+    job->writes++;
+
+    /* addresses are patched on submission, hence unknown */
+    if (reloc) {
+        note = " (reloc)";
+        state->valid[reg] = false;
+    } else if (port || reg_is_action(job, reg)) {
+        /* not a state */
+    } else if (state->valid[reg] && state->regs[reg] == value) {
+        note = " (redundant)";
+        state->redundant[reg]++;
+        job->redundant++;
+    } else {
+        if (state->valid[reg]) {
+            state->changed[reg]++;
+            job->changed++;
+        }
+
+        state->regs[reg] = value;
+        state->valid[reg] = true;
+    }
+
+    if (summary_only)
+        return;
+
+    /* immediate data is a part of the opcode word */
+    if (word != ~0u)
+        printf("    %04x: %08x      ", word, value);
+    else
+        printf("                        ");
+
+    printf("%s = 0x%08x%s\n", reg_name(job->engine_id, reg), value, note);
+}
+
+static void print_word(unsigned int i, uint32_t word, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static void print_word(unsigned int i, uint32_t word, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (summary_only)
+        return;
+
+    printf("    %04x: %08x  ", i, word);
+
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+
+    printf("\n");
+}
+
+static void disasm_job(const struct host1x_capture_record *rec,
+                       const uint32_t *words, const uint32_t *reloc_words,
+                       uint64_t start_timestamp, uint64_t prev_timestamp,
+                       unsigned long job_id)
+{
+    enum engine engine_id = class_engine(rec->class_id);
+    struct job_state job = {
+        .engine = &engines[engine_id],
+        .engine_id = engine_id,
+        .reloc_words = reloc_words,
+        .num_relocs = rec->num_relocs,
+    };
+    struct engine_state *state = job.engine;
+    unsigned int offset, count, mask;
+    unsigned int i = 0, k;
+    uint32_t word;
+
+    if (!summary_only)
+        printf("job %lu: %s, +%.3f ms (+%.3f ms), %u words, %u relocs\n",
+               job_id, engine_names[engine_id],
+               (rec->timestamp - start_timestamp) / 1000000.0,
+               (rec->timestamp - prev_timestamp) / 1000000.0,
+               rec->num_words, rec->num_relocs);
+
+    while (i < rec->num_words) {
+        word = words[i];
+        offset = (word >> 16) & 0xfff;
+
+        switch (word >> 28) {
+        case 0x0:
+            mask = word & 0x3f;
+            job.engine_id = class_engine((word >> 6) & 0x3ff);
+            job.engine = &engines[job.engine_id];
+            print_word(i++, word, "SETCL class=0x%02x offset=0x%03x mask=0x%02x",
+                       (word >> 6) & 0x3ff, offset, mask);
+
+            for (k = 0; k < 6; k++) {
+                if (!(mask & (1 << k)) || i >= rec->num_words)
+                    continue;
+
+                write_reg(&job, offset + k, words[i], i, false);
+                i++;
+            }
+            break;
+
+        case 0x1:
+        case 0x2:
+            count = word & 0xffff;
+            print_word(i++, word, "%s offset=0x%03x count=%u",
+                       (word >> 28) == 0x1 ? "INCR" : "NONINCR",
+                       offset, count);
+
+            for (k = 0; k < count && i < rec->num_words; k++, i++) {
+                /* NONINCR feeds data ports, like uploads of programs */
+                if ((word >> 28) == 0x1)
+                    write_reg(&job, offset + k, words[i], i, false);
+                else
+                    write_reg(&job, offset, words[i], i, true);
+            }
+            break;
+
+        case 0x3:
+            mask = word & 0xffff;
+            print_word(i++, word, "MASK offset=0x%03x mask=0x%04x",
+                       offset, mask);
+
+            for (k = 0; k < 16; k++) {
+                if (!(mask & (1 << k)) || i >= rec->num_words)
+                    continue;
+
+                write_reg(&job, offset + k, words[i], i, false);
+                i++;
+            }
+            break;
+
+        case 0x4:
+            print_word(i++, word, "IMM offset=0x%03x data=0x%04x",
+                       offset, word & 0xffff);
+            write_reg(&job, offset, word & 0xffff, ~0u, false);
+            break;
+
+        case 0x5:
+            print_word(i++, word, "RESTART");
+            break;
+
+        case 0x6:
+            /* followed by the address of the gathered buffer */
+            print_word(i++, word, "GATHER offset=0x%03x count=%u",
+                       offset, word & 0x3fff);
+            if (i < rec->num_words) {
+                print_word(i, words[i], "    address");
+                i++;
+            }
+            break;
+
+        case 0xe:
+            print_word(i++, word, "EXTEND subop=%u value=0x%06x",
+                       (word >> 24) & 0xf, word & 0xffffff);
+            break;
+
+        default:
+            print_word(i++, word, "unknown opcode %u", word >> 28);
+            break;
+        }
+    }
+
+    /* statistics are accounted to the engine the job was submitted to */
+    state = &engines[engine_id];
+
+    if (!state->jobs)
+        state->first_timestamp = rec->timestamp;
+
+    state->last_timestamp = rec->timestamp;
+    state->jobs++;
+    state->words += rec->num_words;
+    state->relocs += rec->num_relocs;
+    state->writes += job.writes;
+    state->total_redundant += job.redundant;
+    state->total_changed += job.changed;
+
+    if (state->max_words < rec->num_words)
+        state->max_words = rec->num_words;
+
+    if (!summary_only)
+        printf("    %lu writes, %lu redundant, %lu changed\n\n",
+               job.writes, job.redundant, job.changed);
+}
+
+static void print_top_regs(enum engine engine_id, const unsigned long *counts,
+                           const char *what)
+{
+    bool printed[NUM_REGS] = { false };
+    unsigned int i, k, top;
+
+    printf("  most %s registers:\n", what);
+
+    for (k = 0; k < TOP_REGS; k++) {
+        top = NUM_REGS;
+
+        for (i = 0; i < NUM_REGS; i++) {
+            if (printed[i] || !counts[i])
+                continue;
+
+            if (top == NUM_REGS || counts[i] > counts[top])
+                top = i;
+        }
+
+        if (top == NUM_REGS) {
+            if (!k)
+                printf("    none\n");
+            break;
+        }
+
+        printed[top] = true;
+        printf("    %-32s %lu\n", reg_name(engine_id, top), counts[top]);
+    }
+}
+
+static void print_summary(void)
+{
+    struct engine_state *state;
+    unsigned int i;
+    double span;
+
+    for (i = 0; i < NUM_ENGINES; i++) {
+        state = &engines[i];
+
+        if (!state->jobs)
+            continue;
+
+        span = (state->last_timestamp - state->first_timestamp) / 1e9;
+
+        printf("%s: %lu jobs", engine_names[i], state->jobs);
+        if (span > 0)
+            printf(" in %.3f s, %.1f jobs/s", span, state->jobs / span);
+        printf("\n");
+
+        printf("  words: %lu total, %.1f per job, %lu max\n",
+               state->words, (double)state->words / state->jobs,
+               state->max_words);
+        printf("  relocs: %lu total, %.1f per job\n",
+               state->relocs, (double)state->relocs / state->jobs);
+        printf("  register writes: %lu, redundant %lu (%.1f%%), changed %lu (%.1f per job)\n",
+               state->writes, state->total_redundant,
+               state->writes ? 100.0 * state->total_redundant / state->writes : 0,
+               state->total_changed,
+               (double)state->total_changed / state->jobs);
+
+        print_top_regs(i, state->redundant, "redundantly written");
+        print_top_regs(i, state->changed, "churned");
+        printf("\n");
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-s] <capture file>\n\n", prog);
+    fprintf(stderr, "  -s  print summary only, without disassembly\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct host1x_capture_record rec;
+    uint64_t start_timestamp = 0;
+    uint64_t prev_timestamp = 0;
+    unsigned long job_id = 0;
+    uint32_t *words = NULL;
+    size_t size = 0;
+    size_t rec_size;
+    FILE *file;
+    int c;
+
+    while ((c = getopt(argc, argv, "sh")) != -1) {
+        switch (c) {
+        case 's':
+            summary_only = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind + 1 != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    file = fopen(argv[optind], "r");
+    if (!file) {
+        fprintf(stderr, "Failed to open %s: %s\n",
+                argv[optind], strerror(errno));
+        return 1;
+    }
+
+    while (fread(&rec, sizeof(rec), 1, file) == 1) {
+        if (rec.magic != HOST1X_CAPTURE_MAGIC) {
+            fprintf(stderr, "Bad record magic 0x%08x of job %lu\n",
+                    rec.magic, job_id);
+            break;
+        }
+
+        rec_size = ((size_t)rec.num_words + rec.num_relocs) * sizeof(*words);
+
+        if (rec_size > size) {
+            free(words);
+            size = rec_size;
+            words = malloc(size);
+            if (!words) {
+                fprintf(stderr, "Failed to allocate %zu bytes\n", size);
+                return 1;
+            }
+        }
+
+        if (rec_size && fread(words, rec_size, 1, file) != 1) {
+            fprintf(stderr, "Truncated job %lu\n", job_id);
+            break;
+        }
+
+        if (!job_id)
+            start_timestamp = prev_timestamp = rec.timestamp;
+
+        disasm_job(&rec, words, words + rec.num_words,
+                   start_timestamp, prev_timestamp, job_id++);
+
+        prev_timestamp = rec.timestamp;
+    }
+
+    fclose(file);
+    free(words);
+
+    print_summary();
+
+    return 0;
+}
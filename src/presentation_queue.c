@@ -19,40 +19,203 @@
 
 #include "vdpau_tegra.h"
 
+/*
+ * Queued surfaces are kept in a binary min-heap ordered by the earliest
+ * presentation time, surfaces of the same time are ordered by queueing.
+ */
+static bool pq_entry_before(struct tegra_pq_entry *a, struct tegra_pq_entry *b)
+{
+    if (a->time != b->time)
+        return a->time < b->time;
+
+    return a->seqno < b->seqno;
+}
+
+static void pq_heap_swap(tegra_pq *pq, unsigned int a, unsigned int b)
+{
+    struct tegra_pq_entry tmp = pq->heap[a];
+
+    pq->heap[a] = pq->heap[b];
+    pq->heap[b] = tmp;
+}
+
+static int pq_heap_push(tegra_pq *pq, tegra_surface *surf)
+{
+    struct tegra_pq_entry *heap;
+    unsigned int parent, i;
+    unsigned int size;
+
+    if (pq->heap_len == pq->heap_size) {
+        size = pq->heap_size ? pq->heap_size * 2 : 8;
+
+        heap = realloc(pq->heap, size * sizeof(*heap));
+        if (!heap)
+            return -ENOMEM;
+
+        pq->heap = heap;
+        pq->heap_size = size;
+    }
+
+    i = pq->heap_len++;
+
+    pq->heap[i].time = surf->earliest_presentation_time;
+    pq->heap[i].seqno = pq->seqno++;
+    pq->heap[i].surf = surf;
+
+    while (i > 0) {
+        parent = (i - 1) / 2;
+
+        if (!pq_entry_before(&pq->heap[i], &pq->heap[parent]))
+            break;
+
+        pq_heap_swap(pq, i, parent);
+        i = parent;
+    }
+
+    /* only the earliest entry is ever removed, hence latest stays queued */
+    if (pq->latest_time < surf->earliest_presentation_time)
+        pq->latest_time = surf->earliest_presentation_time;
+
+    return 0;
+}
+
+static tegra_surface *pq_heap_pop(tegra_pq *pq)
+{
+    tegra_surface *surf = pq->heap[0].surf;
+    unsigned int child, i = 0;
+
+    pq->heap[0] = pq->heap[--pq->heap_len];
+
+    while (true) {
+        child = i * 2 + 1;
+
+        if (child >= pq->heap_len)
+            break;
+
+        if (child + 1 < pq->heap_len &&
+            pq_entry_before(&pq->heap[child + 1], &pq->heap[child]))
+                child++;
+
+        if (!pq_entry_before(&pq->heap[child], &pq->heap[i]))
+            break;
+
+        pq_heap_swap(pq, i, child);
+        i = child;
+    }
+
+    if (!pq->heap_len)
+        pq->latest_time = 0;
+
+    return surf;
+}
+
+/* second earliest surface is one of the root's children */
+static tegra_surface *pq_heap_second(tegra_pq *pq)
+{
+    if (pq->heap_len < 2)
+        return NULL;
+
+    if (pq->heap_len > 2 && pq_entry_before(&pq->heap[2], &pq->heap[1]))
+        return pq->heap[2].surf;
+
+    return pq->heap[1].surf;
+}
+
+/*
+ * Overdue surface superseded by a newer due surface will never be seen,
+ * hence it's released without displaying. It's reported as presented at
+ * the time it was superseded.
+ */
+static void pq_skip_surface(tegra_pq *pq, tegra_surface *surf, VdpTime time)
+{
+    pqt_unprepare_dri_surface(pq->pqt, surf);
+
+    pthread_mutex_lock(&surf->lock);
+
+    surf->status = VDP_PRESENTATION_QUEUE_STATUS_IDLE;
+    surf->first_presentation_time = time;
+    pthread_cond_signal(&surf->idle_cond);
+
+    pthread_mutex_unlock(&surf->lock);
+
+    pq->stats.skipped++;
+
+    DebugMsg("skipped surface %u, %llu skipped in total\n",
+             surf->surface_id, pq->stats.skipped);
+
+    unref_surface(surf);
+}
+
+static void pq_wakeup(tegra_pq *pq)
+{
+    uint64_t counter = 1;
+
+    if (write(pq->wake_fd, &counter, sizeof(counter)) < 0)
+        ErrorMsg("failed to wake up presentation thread: %s\n",
+                 strerror(errno));
+}
+
 static void * presentation_queue_thr(void *opaque)
 {
     tegra_pq *pq = opaque;
     tegra_pqt *pqt = pq->pqt;
-    tegra_surface *disp_surf, *surf, *tmp, *next;
-    VdpTime earliest_time = UINT64_MAX;
+    tegra_surface *disp_surf, *surf;
     VdpTime time = UINT64_MAX;
-    struct timespec tp;
+    VdpTime scanout_time;
+    struct pollfd fds[2];
+    uint64_t counter;
+    int timeout;
+    VdpTime now;
     int ret;
 
     pthread_mutex_lock(&pq->lock);
 
     while (true) {
+        timeout = -1;
+
         if (time != UINT64_MAX) {
-            memset(&tp, 0, sizeof(tp));
-            tp.tv_sec = time / 1000000000ULL;
-            tp.tv_nsec = time - tp.tv_sec * 1000000000ULL;
+            now = get_time();
+            timeout = 0;
 
-            ret = pthread_cond_timedwait(&pq->cond, &pq->lock, &tp);
-        } else {
-            ret = pthread_cond_wait(&pq->cond, &pq->lock);
+            /* rounded up, so that thread never wakes up too early */
+            if (time > now)
+                timeout = (time - now + 999999) / 1000000;
         }
 
+        /* vblank events of the display are delivered to the same poll */
+        fds[0].fd = pq->wake_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = pqt->vblank_fd;
+        fds[1].events = POLLIN;
+
+        pthread_mutex_unlock(&pq->lock);
+        ret = poll(fds, 2, timeout);
+        pthread_mutex_lock(&pq->lock);
+
         DebugMsg("wakeup %d\n", ret);
 
+        if (ret > 0 && (fds[0].revents & POLLIN)) {
+            if (read(pq->wake_fd, &counter, sizeof(counter)) < 0)
+                DebugMsg("failed to read wake counter: %s\n",
+                         strerror(errno));
+        }
+
+        if (ret > 0 && (fds[1].revents & POLLIN)) {
+            scanout_time = pqt_handle_vblank_events(pqt);
+            if (scanout_time)
+                presentation_stats_scanout(pq, scanout_time);
+        }
+
         if (pq->exit) {
-            LIST_FOR_EACH_ENTRY_SAFE(surf, tmp, &pq->surf_list, list_item) {
+            while (pq->heap_len) {
+                surf = pq_heap_pop(pq);
+
                 pthread_mutex_lock(&surf->lock);
 
                 surf->status = VDP_PRESENTATION_QUEUE_STATUS_IDLE;
                 surf->first_presentation_time = 0;
                 pthread_cond_signal(&surf->idle_cond);
 
-                LIST_DEL(&surf->list_item);
                 pthread_mutex_unlock(&surf->lock);
 
                 unref_surface(surf);
@@ -65,40 +228,21 @@ static void * presentation_queue_thr(void *opaque)
             return NULL;
         }
 
-        if (ret != ETIMEDOUT) {
+        if (ret != 0) {
             time = get_time();
         }
 
-        earliest_time = UINT64_MAX;
         disp_surf = NULL;
-        next = NULL;
-
-        LIST_FOR_EACH_ENTRY_SAFE(surf, tmp, &pq->surf_list, list_item) {
-            pthread_mutex_lock(&surf->lock);
-
-            if (surf->status != VDP_PRESENTATION_QUEUE_STATUS_QUEUED) {
-                pthread_mutex_unlock(&surf->lock);
-                continue;
-            }
-
-            if (surf->earliest_presentation_time > time) {
-                if (surf->earliest_presentation_time < earliest_time) {
-                    DebugMsg("surface %u in queue\n", surf->surface_id);
-                    earliest_time = surf->earliest_presentation_time;
-                    next = surf;
-                }
 
-                pthread_mutex_unlock(&surf->lock);
-                continue;
-            }
-
-            LIST_DEL(&surf->list_item);
-            pthread_mutex_unlock(&surf->lock);
+        while (pq->heap_len &&
+               pqt_frame_deadline(pqt, pq->heap[0].time) <= time)
+        {
+            surf = pq_heap_pop(pq);
 
             DebugMsg("displaying surface %u\n", surf->surface_id);
 
             if (disp_surf) {
-                pqt_display_surface(pqt, disp_surf, true, false, false);
+                pq_skip_surface(pq, disp_surf, time);
             }
 
             disp_surf = surf;
@@ -106,17 +250,25 @@ static void * presentation_queue_thr(void *opaque)
 
         if (disp_surf) {
             pqt_display_surface(pqt, disp_surf, true, false, true);
+            presentation_stats_presented(pq, disp_surf,
+                                         disp_surf->earliest_presentation_time);
         }
 
-        time = earliest_time;
+        /* release rotation buffers left over after rotation stopped */
+        tegra_scratch_pool_expire(pqt->dev);
 
-        if (time != UINT64_MAX) {
-            if (next) {
-                pqt_prepare_dri_surface(pqt, next);
-            }
+        if (pq->heap_len) {
+            time = pqt_frame_deadline(pqt, pq->heap[0].time);
+
+            DebugMsg("surface %u in queue\n", pq->heap[0].surf->surface_id);
+
+            pqt_prepare_dri_surfaces(pqt, pq->heap[0].surf,
+                                     pq_heap_second(pq));
 
             DebugMsg("next wake on %llu\n", time);
         } else {
+            time = UINT64_MAX;
+
             DebugMsg("going to sleep.. zZZ\n");
         }
     }
@@ -136,7 +288,6 @@ VdpStatus vdp_presentation_queue_create(
     tegra_pq *pq;
     VdpPresentationQueue i;
     pthread_mutexattr_t mutex_attrs;
-    pthread_condattr_t cond_attrs;
     pthread_attr_t thread_attrs;
     int ret;
 
@@ -154,6 +305,9 @@ VdpStatus vdp_presentation_queue_create(
         if (pq == NULL) {
             pq = calloc(1, sizeof(tegra_pq));
             set_presentation_queue(i, pq);
+
+            if (pq)
+                pq->id = i;
             break;
         }
     }
@@ -177,18 +331,14 @@ VdpStatus vdp_presentation_queue_create(
         return VDP_STATUS_RESOURCES;
     }
 
-    pthread_condattr_init(&cond_attrs);
-    pthread_condattr_setclock(&cond_attrs, CLOCK_MONOTONIC);
-
-    ret = pthread_cond_init(&pq->cond, &cond_attrs);
-    if (ret != 0) {
-        ErrorMsg("pthread_cond_init failed\n");
+    pq->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (pq->wake_fd < 0) {
+        ErrorMsg("eventfd failed: %s\n", strerror(errno));
         put_device(dev);
         put_queue_target(pqt);
         return VDP_STATUS_RESOURCES;
     }
 
-    LIST_INITHEAD(&pq->surf_list);
     atomic_set(&pq->refcnt, 1);
     pq->pqt = pqt;
 
@@ -233,8 +383,12 @@ VdpStatus unref_presentation_queue(tegra_pq *pq)
 
     pthread_join(pq->disp_thread, NULL);
 
+    presentation_stats_dump(pq);
+
     unref_queue_target(pqt);
     unref_device(dev);
+    close(pq->wake_fd);
+    free(pq->heap);
     free(pq);
 
     return VDP_STATUS_OK;
@@ -254,7 +408,7 @@ VdpStatus vdp_presentation_queue_destroy(
 
     pthread_mutex_lock(&pq->lock);
     pq->exit = true;
-    pthread_cond_signal(&pq->cond);
+    pq_wakeup(pq);
     pthread_mutex_unlock(&pq->lock);
 
     unref_presentation_queue(pq);
@@ -367,19 +521,30 @@ VdpStatus vdp_presentation_queue_display(
     surf->disp_width  = clip_width  ?: surf->width;
     surf->disp_height = clip_height ?: surf->height;
 
+    presentation_stats_queued(pq);
+
     if (earliest_presentation_time == 0 || !_Xglobal_lock) {
         pqt_display_surface(pq->pqt, surf, true, false, true);
+        presentation_stats_presented(pq, surf, earliest_presentation_time);
         goto unlock_surf;
     }
 
     DebugMsg("queue surface %u %llu\n",
-             surf->surface_id, surf->earliest_presentation_time);
+             surf->surface_id, earliest_presentation_time);
 
-    surf->status = VDP_PRESENTATION_QUEUE_STATUS_QUEUED;
     surf->earliest_presentation_time = earliest_presentation_time;
 
-    LIST_ADDTAIL(&surf->list_item, &pq->surf_list);
-    pthread_cond_signal(&pq->cond);
+    if (pq_heap_push(pq, surf)) {
+        unref_surface(surf);
+        ret = VDP_STATUS_RESOURCES;
+        goto unlock_surf;
+    }
+
+    surf->status = VDP_PRESENTATION_QUEUE_STATUS_QUEUED;
+
+    /* thread needs to re-arm only if queue's head changed */
+    if (pq->heap[0].surf == surf)
+        pq_wakeup(pq);
 
 unlock_surf:
     pthread_mutex_unlock(&surf->lock);
@@ -391,63 +556,100 @@ unlock_surf:
     return ret;
 }
 
-VdpStatus vdp_presentation_queue_block_until_surface_idle(
-                                        VdpPresentationQueue presentation_queue,
-                                        VdpOutputSurface surface,
-                                        VdpTime *first_presentation_time)
+/*
+ * Lock order is the same as on queueing and displaying: queue first, then
+ * surface. Surface status changes to idle under the surface lock, hence
+ * waiter sleeps on the condition without a chance to miss the wake up.
+ *
+ * Deadline is CLOCK_MONOTONIC time in nanoseconds, UINT64_MAX waits with
+ * no timeout. Render threads that can't block indefinitely pass a deadline
+ * and get -ETIMEDOUT once it has passed.
+ */
+int presentation_queue_wait_surface_idle(tegra_pq *pq, tegra_surface *surf,
+                                         VdpTime deadline,
+                                         VdpTime *first_presentation_time)
 {
-    tegra_surface *itr, *surf = get_surface_output(surface);
-    tegra_pq *pq = get_presentation_queue(presentation_queue);
-    VdpStatus ret = VDP_STATUS_ERROR;
-    int err;
-
-    if (surf == NULL || pq == NULL) {
-        put_surface(surf);
-        put_presentation_queue(pq);
-        *first_presentation_time = get_time();
-        return VDP_STATUS_INVALID_HANDLE;
-    }
+    struct timespec tp;
+    int ret = 0;
 
-retry:
+    /* idle surface doesn't need to wait for the queue */
     pthread_mutex_lock(&surf->lock);
-
     if (surf->status == VDP_PRESENTATION_QUEUE_STATUS_IDLE) {
         *first_presentation_time = surf->first_presentation_time;
-        ret = VDP_STATUS_OK;
-        goto unlock_surf;
-    }
-
-    err = pthread_mutex_trylock(&pq->lock);
-    if (err) {
         pthread_mutex_unlock(&surf->lock);
-        sched_yield();
-        goto retry;
+        return 0;
     }
+    pthread_mutex_unlock(&surf->lock);
 
-    LIST_FOR_EACH_ENTRY(itr, &pq->surf_list, list_item) {
-        if (itr->earliest_presentation_time > surf->earliest_presentation_time) {
-            ret = VDP_STATUS_OK;
-            break;
-        }
+    pthread_mutex_lock(&pq->lock);
+    pthread_mutex_lock(&surf->lock);
+
+    /* displayed surface becomes idle only once next surface is shown */
+    if (surf->status != VDP_PRESENTATION_QUEUE_STATUS_IDLE &&
+        pq->latest_time <= surf->earliest_presentation_time)
+    {
+        pthread_mutex_unlock(&pq->lock);
+        *first_presentation_time = 0;
+        ret = -EINVAL;
+        goto unlock_surf;
     }
+
     pthread_mutex_unlock(&pq->lock);
 
-    if (ret == VDP_STATUS_OK) {
+    if (surf->status != VDP_PRESENTATION_QUEUE_STATUS_IDLE)
         DebugMsg("block on surface %u+ %llu\n",
                  surf->surface_id, surf->earliest_presentation_time);
 
-        pthread_cond_wait(&surf->idle_cond, &surf->lock);
+    if (deadline != UINT64_MAX) {
+        tp.tv_sec = deadline / 1000000000ULL;
+        tp.tv_nsec = deadline - tp.tv_sec * 1000000000ULL;
+    }
 
-        DebugMsg("block on surface %u-\n", surf->surface_id);
+    while (surf->status != VDP_PRESENTATION_QUEUE_STATUS_IDLE) {
+        if (deadline == UINT64_MAX) {
+            pthread_cond_wait(&surf->idle_cond, &surf->lock);
+            continue;
+        }
 
-        *first_presentation_time = surf->first_presentation_time;
-    } else {
-        *first_presentation_time = 0;
+        ret = pthread_cond_timedwait(&surf->idle_cond, &surf->lock, &tp);
+        if (ret == ETIMEDOUT) {
+            DebugMsg("block on surface %u timed out\n", surf->surface_id);
+            ret = -ETIMEDOUT;
+            goto unlock_surf;
+        }
     }
 
+    *first_presentation_time = surf->first_presentation_time;
+    ret = 0;
+
 unlock_surf:
     pthread_mutex_unlock(&surf->lock);
 
+    return ret;
+}
+
+VdpStatus vdp_presentation_queue_block_until_surface_idle(
+                                        VdpPresentationQueue presentation_queue,
+                                        VdpOutputSurface surface,
+                                        VdpTime *first_presentation_time)
+{
+    tegra_surface *surf = get_surface_output(surface);
+    tegra_pq *pq = get_presentation_queue(presentation_queue);
+    VdpStatus ret = VDP_STATUS_OK;
+    int err;
+
+    if (surf == NULL || pq == NULL) {
+        put_surface(surf);
+        put_presentation_queue(pq);
+        *first_presentation_time = get_time();
+        return VDP_STATUS_INVALID_HANDLE;
+    }
+
+    err = presentation_queue_wait_surface_idle(pq, surf, UINT64_MAX,
+                                               first_presentation_time);
+    if (err)
+        ret = VDP_STATUS_ERROR;
+
     put_surface(surf);
     put_presentation_queue(pq);
 
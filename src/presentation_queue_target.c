@@ -19,6 +19,12 @@
 
 #include "vdpau_tegra.h"
 
+/* switch back to Xv once window stays unobscured, DRI2 is kept warm */
+#define PQT_XV_HOLDOFF_MIN      500000000ULL
+#define PQT_XV_HOLDOFF_MAX      4000000000ULL
+#define PQT_FLAPPING_PERIOD     2000000000ULL
+#define PQT_DRI_GRACE_PERIOD    5000000000ULL
+
 void pqt_display_surface_to_idle_state(tegra_pqt *pqt)
 {
     tegra_surface *surf;
@@ -50,6 +56,65 @@ void pqt_display_surface_to_idle_state(tegra_pqt *pqt)
     unref_surface(surf);
 }
 
+/*
+ * X server invalidates DRI2 buffers of a drawable once it exchanged them
+ * on swap or re-allocated them on resize. The event is delivered to the
+ * thread that reads the display's reply, hence drawables are looked up
+ * under a separate lock.
+ */
+static pthread_mutex_t dri2_events_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct list_head dri2_events_targets = {
+    &dri2_events_targets, &dri2_events_targets
+};
+
+static Bool pqt_dri2_wire_to_event(Display *dpy, XExtDisplayInfo *info,
+                                   XEvent *event, xEvent *wire)
+{
+    xDRI2InvalidateBuffers *ev = (xDRI2InvalidateBuffers *) wire;
+    tegra_pqt *pqt;
+
+    if ((wire->u.u.type & 0x7f) - info->codes->first_event !=
+            DRI2_InvalidateBuffers)
+        return False;
+
+    pthread_mutex_lock(&dri2_events_lock);
+
+    LIST_FOR_EACH_ENTRY(pqt, &dri2_events_targets, dri2_events_entry) {
+        if (pqt->dev->display == dpy && pqt->drawable == ev->drawable) {
+            DebugMsg("buffers of drawable 0x%lx invalidated\n",
+                     pqt->drawable);
+            pqt->dri_invalidated = true;
+        }
+    }
+
+    pthread_mutex_unlock(&dri2_events_lock);
+
+    /* nothing is queued to the application */
+    return False;
+}
+
+static const DRI2EventOps pqt_dri2_event_ops = {
+    .WireToEvent = pqt_dri2_wire_to_event,
+};
+
+static void pqt_set_dri_invalidated(tegra_pqt *pqt, bool invalidated)
+{
+    pthread_mutex_lock(&dri2_events_lock);
+    pqt->dri_invalidated = invalidated;
+    pthread_mutex_unlock(&dri2_events_lock);
+}
+
+static bool pqt_dri_invalidated(tegra_pqt *pqt)
+{
+    bool invalidated;
+
+    pthread_mutex_lock(&dri2_events_lock);
+    invalidated = pqt->dri_invalidated;
+    pthread_mutex_unlock(&dri2_events_lock);
+
+    return invalidated;
+}
+
 static void pqt_create_dri2_drawable(tegra_pqt *pqt)
 {
     tegra_device *dev = pqt->dev;
@@ -58,37 +123,73 @@ static void pqt_create_dri2_drawable(tegra_pqt *pqt)
         DRI2CreateDrawable(dev->display, pqt->drawable);
         DRI2SwapInterval(dev->display, pqt->drawable, 1);
         pqt->dri2_drawable_created = true;
+
+        pthread_mutex_lock(&dri2_events_lock);
+        LIST_ADDTAIL(&pqt->dri2_events_entry, &dri2_events_targets);
+        pthread_mutex_unlock(&dri2_events_lock);
     }
 }
 
+static void pqt_release_dri_buffers(tegra_pqt *pqt)
+{
+    struct tegra_pqt_dri_buffer *buf;
+    unsigned int i;
+
+    for (i = 0; i < TEGRA_PQT_DRI_BUFFERS_NB; i++) {
+        buf = &pqt->dri_bufs[i];
+
+        if (buf->pixbuf)
+            host1x_pixelbuffer_free(buf->pixbuf);
+
+        memset(buf, 0, sizeof(*buf));
+    }
+
+    pqt->dri_back = NULL;
+}
+
 static void pqt_destroy_dri2_drawable(tegra_pqt *pqt)
 {
     tegra_device *dev = pqt->dev;
 
     if (pqt->dri2_drawable_created) {
+        pthread_mutex_lock(&dri2_events_lock);
+        LIST_DEL(&pqt->dri2_events_entry);
+        pthread_mutex_unlock(&dri2_events_lock);
+
         DRI2DestroyDrawable(dev->display, pqt->drawable);
         pqt->dri2_drawable_created = false;
     }
+
+    pqt_release_dri_buffers(pqt);
 }
 
+/*
+ * X server may exchange back and front buffers on swap, hence back buffer
+ * is re-queried once buffers are invalidated. Buffers are cached by their
+ * DRI2 names, so that each of them is wrapped once and keeps the surface
+ * that was prepared in it.
+ */
 static int pqt_update_dri_pixbuf(tegra_pqt *pqt)
 {
     tegra_device *dev = pqt->dev;
+    struct tegra_pqt_dri_buffer *dri_buf = NULL;
+    struct host1x_pixelbuffer *pixbuf;
     struct drm_tegra_bo *bo;
     DRI2Buffer *buf;
     unsigned int attachment = DRI2BufferBackLeft;
     unsigned int format;
+    unsigned int i;
     int width, height;
     int outCount;
     int err;
 
-    if (pqt->dri_pixbuf) {
-        host1x_pixelbuffer_free(pqt->dri_pixbuf);
-        pqt->dri_pixbuf = NULL;
-    }
+    pqt->dri_back = NULL;
 
     pqt_create_dri2_drawable(pqt);
 
+    /* invalidation that comes after this query applies to the result */
+    pqt_set_dri_invalidated(pqt, false);
+
     buf = DRI2GetBuffers(dev->display, pqt->drawable, &width, &height,
                          &attachment, 1, &outCount);
     if (!buf || outCount != 1) {
@@ -96,7 +197,29 @@ static int pqt_update_dri_pixbuf(tegra_pqt *pqt)
         return -1;
     }
 
-    DebugMsg("width %d height %d\n", width, height);
+    for (i = 0; i < TEGRA_PQT_DRI_BUFFERS_NB; i++) {
+        pixbuf = pqt->dri_bufs[i].pixbuf;
+
+        if (!pixbuf)
+            continue;
+
+        /* drawable was resized, all buffers are re-allocated */
+        if (pixbuf->width != (unsigned)width ||
+            pixbuf->height != (unsigned)height ||
+            pixbuf->pitch != buf[0].pitch[0])
+        {
+            DebugMsg("drawable resized\n");
+            pqt_release_dri_buffers(pqt);
+            break;
+        }
+
+        if (pqt->dri_bufs[i].name == buf[0].names[0]) {
+            dri_buf = &pqt->dri_bufs[i];
+            goto done;
+        }
+    }
+
+    DebugMsg("width %d height %d name %u\n", width, height, buf[0].names[0]);
 
     switch (buf[0].cpp) {
     case 4:
@@ -121,6 +244,17 @@ static int pqt_update_dri_pixbuf(tegra_pqt *pqt)
         return -1;
     }
 
+    /* replace least recently used buffer */
+    for (i = 0; i < TEGRA_PQT_DRI_BUFFERS_NB; i++) {
+        if (!dri_buf || pqt->dri_bufs[i].last_use < dri_buf->last_use)
+            dri_buf = &pqt->dri_bufs[i];
+    }
+
+    if (dri_buf->pixbuf)
+        host1x_pixelbuffer_free(dri_buf->pixbuf);
+
+    memset(dri_buf, 0, sizeof(*dri_buf));
+
     err = drm_tegra_bo_from_name(&bo, dev->drm, buf[0].names[0], 0);
     if (err) {
         return err;
@@ -132,21 +266,98 @@ static int pqt_update_dri_pixbuf(tegra_pqt *pqt)
         return err;
     }
 
-    pqt->dri_pixbuf = host1x_pixelbuffer_wrap(&bo, width, height,
+    dri_buf->pixbuf = host1x_pixelbuffer_wrap(&bo, width, height,
                                               buf[0].pitch[0], 0, format,
                                               PIX_BUF_LAYOUT_LINEAR);
-    if (!pqt->dri_pixbuf) {
+    if (!dri_buf->pixbuf) {
         drm_tegra_bo_unref(bo);
         return -2;
     }
 
+    dri_buf->name = buf[0].names[0];
+done:
+    dri_buf->last_use = ++pqt->dri_use_cnt;
+    pqt->dri_back = dri_buf;
+
     return 0;
 }
 
+/* back buffer can't be written until it's swapped out to display */
+static bool pqt_dri_buffer_busy(tegra_pqt *pqt,
+                                struct tegra_pqt_dri_buffer *buf)
+{
+    return buf->swap_sbc > pqt->dri_sbc_done;
+}
+
+static void pqt_wait_dri_buffer(tegra_pqt *pqt,
+                                struct tegra_pqt_dri_buffer *buf)
+{
+    tegra_device *dev = pqt->dev;
+    CARD64 ust, msc, sbc;
+
+    if (!pqt_dri_buffer_busy(pqt, buf))
+        return;
+
+    DebugMsg("waiting for swap %llu\n", (unsigned long long)buf->swap_sbc);
+
+    if (!DRI2WaitSBC(dev->display, pqt->drawable, buf->swap_sbc,
+                     &ust, &msc, &sbc))
+    {
+        ErrorMsg("DRI2WaitSBC failed\n");
+        sbc = buf->swap_sbc;
+    }
+
+    pqt->dri_sbc_done = sbc;
+}
+
+static void pqt_forget_dri_surface(tegra_pqt *pqt, tegra_surface *surf)
+{
+    unsigned int i;
+
+    for (i = 0; i < TEGRA_PQT_DRI_BUFFERS_NB; i++) {
+        if (pqt->dri_bufs[i].prep_surf == surf)
+            pqt->dri_bufs[i].prep_surf = NULL;
+    }
+}
+
+/*
+ * Skipped surface is never displayed, its content may change before it's
+ * queued again.
+ */
+void pqt_unprepare_dri_surface(tegra_pqt *pqt, tegra_surface *surf)
+{
+    pthread_mutex_lock(&pqt->lock);
+    pqt_forget_dri_surface(pqt, surf);
+    pthread_mutex_unlock(&pqt->lock);
+}
+
+/*
+ * Buffer is free if it's neither waiting for its swap nor displayed, the
+ * displayed one is the last swapped out. Buffers that were never swapped
+ * out by us could be displayed by X server.
+ */
+static bool pqt_dri_buffer_spare(tegra_pqt *pqt,
+                                 struct tegra_pqt_dri_buffer *buf)
+{
+    unsigned int i;
+
+    if (!buf->pixbuf || !buf->swap_sbc || pqt_dri_buffer_busy(pqt, buf))
+        return false;
+
+    for (i = 0; i < TEGRA_PQT_DRI_BUFFERS_NB; i++) {
+        if (pqt->dri_bufs[i].swap_sbc > buf->swap_sbc &&
+            !pqt_dri_buffer_busy(pqt, &pqt->dri_bufs[i]))
+            return true;
+    }
+
+    return false;
+}
+
 static bool initialize_dri2(tegra_pqt *pqt)
 {
     tegra_device *dev = pqt->dev;
     char *driverName, *deviceName;
+    int major, minor;
     int ret;
 
     pthread_mutex_lock(&global_lock);
@@ -154,6 +365,12 @@ static bool initialize_dri2(tegra_pqt *pqt)
     if (!dev->dri2_inited) {
         dev->dri2_inited = true;
 
+        /* also installs the event handlers, 1.2 brings invalidation */
+        DRI2InitDisplay(dev->display, &pqt_dri2_event_ops);
+
+        if (DRI2QueryVersion(dev->display, &major, &minor))
+            dev->dri2_events = (major > 1 || minor >= 2);
+
         ret = DRI2Connect(dev->display, pqt->drawable, DRI2DriverVDPAU,
                           &driverName, &deviceName);
         if (!ret) {
@@ -196,27 +413,244 @@ unlock:
     return dev->dri2_ready;
 }
 
-static void pqt_display_dri(tegra_pqt *pqt, tegra_surface *surf, bool vsync)
+/*
+ * Vblank period and phase are tracked using the timestamps of observed
+ * vblanks, giving the predicted scanout time of a frame. Kernel sequence
+ * and DRI2 MSC are offset from each other, hence period is measured
+ * against the previous vblank of the same counter.
+ */
+static void pqt_update_vblank(tegra_pqt *pqt, VdpTime time, uint64_t seq,
+                              enum tegra_pqt_vblank_src src)
 {
+    VdpTime ref_time, period;
+    uint64_t ref_seq;
+
+    if (!time)
+        return;
+
+    pthread_mutex_lock(&pqt->lock);
+
+    ref_time = pqt->vblank_ref_time[src];
+    ref_seq = pqt->vblank_ref_seq[src];
+
+    if (ref_time && seq > ref_seq && time > ref_time) {
+        period = (time - ref_time) / (seq - ref_seq);
+
+        /* restart estimation on a mode change or CRTC switch */
+        if (pqt->vblank_period &&
+            (period < pqt->vblank_period / 2 ||
+             period > pqt->vblank_period * 2))
+        {
+            DebugMsg("vblank period changed %llu -> %llu\n",
+                     pqt->vblank_period, period);
+            pqt->vblank_period = period;
+        } else if (pqt->vblank_period) {
+            pqt->vblank_period = (pqt->vblank_period * 7 + period) / 8;
+        } else {
+            pqt->vblank_period = period;
+        }
+    }
+
+    pqt->vblank_ref_time[src] = time;
+    pqt->vblank_ref_seq[src] = seq;
+
+    if (time > pqt->vblank_time)
+        pqt->vblank_time = time;
+
+    pthread_mutex_unlock(&pqt->lock);
+}
+
+/* returns time of the first vblank that happens at or after given time */
+VdpTime pqt_predict_vblank(tegra_pqt *pqt, VdpTime time)
+{
+    VdpTime vblank, period;
+
+    pthread_mutex_lock(&pqt->lock);
+    vblank = pqt->vblank_time;
+    period = pqt->vblank_period;
+    pthread_mutex_unlock(&pqt->lock);
+
+    if (!period || !vblank)
+        return time;
+
+    if (time > vblank)
+        return vblank + (time - vblank + period - 1) / period * period;
+
+    return vblank - (vblank - time) / period * period;
+}
+
+/*
+ * Frame is put on display half of period before the vblank at which it
+ * should be scanned out, hence it's latched by that vblank.
+ */
+VdpTime pqt_frame_deadline(tegra_pqt *pqt, VdpTime earliest_time)
+{
+    VdpTime vblank, period;
+
+    pthread_mutex_lock(&pqt->lock);
+    vblank = pqt_predict_vblank(pqt, earliest_time);
+    period = pqt->vblank_period;
+    pthread_mutex_unlock(&pqt->lock);
+
+    if (!period || vblank < period / 2)
+        return earliest_time;
+
+    return vblank - period / 2;
+}
+
+static void pqt_vblank_handler(int fd, unsigned int sequence,
+                               unsigned int tv_sec, unsigned int tv_usec,
+                               void *user_data)
+{
+    tegra_pqt *pqt = user_data;
+    tegra_surface *surf;
+    VdpTime time;
+
+    time = (VdpTime)tv_sec * 1000000000ULL + (VdpTime)tv_usec * 1000ULL;
+
+    pthread_mutex_lock(&pqt->lock);
+
+    pqt_update_vblank(pqt, time, sequence, TEGRA_PQT_VBLANK_KMS);
+
+    /* surface is referenced while it's displayed */
+    surf = pqt->vblank_surf;
+    if (surf && surf == pqt->disp_surf) {
+        pthread_mutex_lock(&surf->lock);
+        if (surf->status == VDP_PRESENTATION_QUEUE_STATUS_VISIBLE) {
+            surf->first_presentation_time = time;
+            pqt->vblank_scanout_time = time;
+        }
+        pthread_mutex_unlock(&surf->lock);
+
+        DebugMsg("surface %u scanned out at %llu\n",
+                 surf->surface_id, time);
+    }
+    pqt->vblank_surf = NULL;
+
+    pthread_mutex_unlock(&pqt->lock);
+}
+
+/* returns actual scanout time of the displayed surface, if it was reported */
+VdpTime pqt_handle_vblank_events(tegra_pqt *pqt)
+{
+    drmEventContext evctx;
+    VdpTime time;
+
+    memset(&evctx, 0, sizeof(evctx));
+    evctx.version = 2;
+    evctx.vblank_handler = pqt_vblank_handler;
+
+    if (drmHandleEvent(pqt->vblank_fd, &evctx))
+        DebugMsg("drmHandleEvent() failed\n");
+
+    pthread_mutex_lock(&pqt->lock);
+    time = pqt->vblank_scanout_time;
+    pqt->vblank_scanout_time = 0;
+    pthread_mutex_unlock(&pqt->lock);
+
+    return time;
+}
+
+/* accounts time spent in a phase of the display path, returns current time */
+static VdpTime pqt_phase_end(tegra_pqt *pqt, enum tegra_pqt_phase phase,
+                             VdpTime start)
+{
+    VdpTime now = get_time();
+
+    pqt->last_phase[phase] += now - start;
+
+    return now;
+}
+
+/*
+ * Completion of the vblank is delivered to the presentation thread,
+ * which then updates presentation time of the surface.
+ */
+static bool pqt_request_vblank_event(tegra_pqt *pqt, tegra_surface *surf)
+{
+    drmVBlank vbl;
+    int err;
+
+    if (pqt->vblank_fd < 0)
+        return false;
+
+    memset(&vbl, 0, sizeof(vbl));
+    vbl.request.type = DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT;
+    vbl.request.sequence = 1;
+    vbl.request.signal = (unsigned long)pqt;
+
+    if (pqt->crtc_pipe)
+        vbl.request.type |= DRM_VBLANK_SECONDARY;
+
+    err = drmWaitVBlank(pqt->vblank_fd, &vbl);
+    if (err) {
+        DebugMsg("drmWaitVBlank() failed: %d\n", err);
+        return false;
+    }
+
+    pqt->vblank_surf = surf;
+
+    return true;
+}
+
+static VdpTime pqt_display_dri(tegra_pqt *pqt, tegra_surface *surf,
+                               bool vsync)
+{
+    struct tegra_pqt_dri_buffer *back = pqt->dri_back;
     tegra_device *dev = pqt->dev;
     CARD64 ust, msc, sbc;
     CARD64 count;
+    VdpTime start;
+    VdpTime time;
 
     DebugMsg("surface %u DRI\n", surf->surface_id);
 
+    if (!back) {
+        pqt->last_path = TEGRA_PQT_PATH_NONE;
+        return pqt_predict_vblank(pqt, get_time());
+    }
+
+    pqt->last_path = TEGRA_PQT_PATH_DRI;
+
+    start = get_time();
+    host1x_pixelbuffer_sync(back->pixbuf);
+    start = pqt_phase_end(pqt, TEGRA_PQT_PHASE_BLIT, start);
+
     DRI2GetMSC(dev->display, pqt->drawable, &ust, &msc, &sbc);
+    pqt_update_vblank(pqt, ust * 1000, msc, TEGRA_PQT_VBLANK_DRI2);
+    pqt->dri_sbc_done = sbc;
+
     DRI2SwapBuffers(dev->display, pqt->drawable, msc + 1, 0, 0, &count);
-    if (vsync) {
+    start = pqt_phase_end(pqt, TEGRA_PQT_PHASE_PUT, start);
+    time = pqt_predict_vblank(pqt, start);
+    back->swap_sbc = count;
+
+    /*
+     * Vblank event only reports the scanout time, X server performs the
+     * swap after its own vblank event. Completion of the swap is known
+     * only from DRI2 SBC.
+     */
+    if (vsync && !pqt_request_vblank_event(pqt, surf)) {
         DRI2WaitMSC(dev->display, pqt->drawable, msc + 1, 0, 0, &ust, &msc, &sbc);
-    }
+        pqt_update_vblank(pqt, ust * 1000, msc, TEGRA_PQT_VBLANK_DRI2);
+        pqt->dri_sbc_done = sbc;
+        time = ust * 1000;
 
-    if (pqt->dri_prep_surf == surf) {
-        pqt->dri_prep_surf = NULL;
+        pqt_phase_end(pqt, TEGRA_PQT_PHASE_VBLANK, start);
+        pqt->last_vblank_waited = true;
     }
 
+    pqt_forget_dri_surface(pqt, surf);
+
+    /* without events buffers are assumed to be exchanged on every swap */
+    if (!dev->dri2_events)
+        pqt_set_dri_invalidated(pqt, true);
+
     if (surf->set_bg) {
         pqt->bg_new_state.bg_color = surf->bg_color;
     }
+
+    return time;
 }
 
 static bool pqt_update_background_state(tegra_pqt *pqt, tegra_surface *surf)
@@ -344,14 +778,18 @@ static void pqt_draw_background(tegra_pqt *pqt, tegra_surface *surf)
     }
 }
 
-static void wait_for_vblank(tegra_device *dev, int secondary)
+/* waits for given number of vblanks and returns time of the last one */
+static VdpTime pqt_wait_vblank(tegra_pqt *pqt, int secondary,
+                               unsigned int count)
 {
+    tegra_device *dev = pqt->dev;
     drmVBlank vbl;
+    VdpTime time;
     int err;
 
     memset(&vbl, 0, sizeof(vbl));
     vbl.request.type = DRM_VBLANK_RELATIVE;
-    vbl.request.sequence = 1;
+    vbl.request.sequence = count;
     vbl.request.signal = 0;
 
     if (secondary)
@@ -360,12 +798,58 @@ static void wait_for_vblank(tegra_device *dev, int secondary)
     err = drmWaitVBlank(dev->drm_fd, &vbl);
     if (err) {
         DebugMsg("drmWaitVBlank() failed: %d\n", err);
+        return 0;
     }
+
+    /* DRM timestamps are CLOCK_MONOTONIC */
+    time = (VdpTime)vbl.reply.tval_sec * 1000000000ULL +
+           (VdpTime)vbl.reply.tval_usec * 1000ULL;
+
+    pqt_update_vblank(pqt, time, vbl.reply.sequence, TEGRA_PQT_VBLANK_KMS);
+
+    return time;
+}
+
+/*
+ * Overlay info changes only when window is moved or its visibility
+ * changes. It's re-read on these events if they are watched, otherwise
+ * once a second.
+ */
+static TegraXvVdpauInfo pqt_get_xv_info(tegra_pqt *pqt)
+{
+    tegra_device *dev = pqt->dev;
+    VdpTime time = get_time();
+    int32_t val;
+    int ret;
+
+    if (pqt->xv_info_valid && (pqt->x11_events_watched ||
+                               time - pqt->xv_info_time < 1000000000ULL))
+        return pqt->xv_info;
+
+    ret = XvGetPortAttribute(dev->display, dev->xv_port, dev->xvVdpauInfo,
+                             &val);
+    if (ret != Success || !val) {
+        DebugMsg("failed to get XV_TEGRA_VDPAU_INFO %d val %d\n", ret, val);
+        pqt->xv_info.data = 0;
+    } else {
+        pqt->xv_info.data = val;
+    }
+
+    DebugMsg("vdpau_info.visible %u vdpau_info.crtc_pipe %u\n",
+             pqt->xv_info.visible, pqt->xv_info.crtc_pipe);
+
+    pqt->xv_info_valid = true;
+    pqt->xv_info_time = time;
+
+    return pqt->xv_info;
 }
 
-static void pqt_display_xv(tegra_pqt *pqt, tegra_surface *surf, bool block)
+static VdpTime pqt_display_xv(tegra_pqt *pqt, tegra_surface *surf,
+                              bool block)
 {
     tegra_device *dev = pqt->dev;
+    VdpTime start = get_time();
+    VdpTime scanout_time = 0;
     bool no_surf = false;
     bool upd_bg;
 
@@ -373,6 +857,13 @@ static void pqt_display_xv(tegra_pqt *pqt, tegra_surface *surf, bool block)
 
     if (surf->shared && surf->shared->xv_img) {
         DebugMsg("surface %u YUV overlay\n", surf->surface_id);
+        pqt->last_path = TEGRA_PQT_PATH_XV_YUV;
+
+        host1x_pixelbuffer_sync(surf->shared->video->pixbuf);
+        start = pqt_phase_end(pqt, TEGRA_PQT_PHASE_BLIT, start);
+
+        /* CSC change is sent along with the image */
+        tegra_xv_apply_csc(dev, &surf->shared->csc);
 
         XvPutImage(dev->display, dev->xv_port,
                    pqt->drawable, pqt->gc,
@@ -385,10 +876,12 @@ static void pqt_display_xv(tegra_pqt *pqt, tegra_surface *surf, bool block)
                    surf->shared->dst_y0,
                    surf->shared->dst_width,
                    surf->shared->dst_height);
-
-        tegra_xv_apply_csc(dev, &surf->shared->csc);
     } else if (surf->xv_img) {
         DebugMsg("surface %u RGB overlay\n", surf->surface_id);
+        pqt->last_path = TEGRA_PQT_PATH_XV_RGB;
+
+        host1x_pixelbuffer_sync(surf->pixbuf);
+        start = pqt_phase_end(pqt, TEGRA_PQT_PHASE_BLIT, start);
 
         XvPutImage(dev->display, dev->xv_port,
                    pqt->drawable, pqt->gc,
@@ -403,6 +896,7 @@ static void pqt_display_xv(tegra_pqt *pqt, tegra_surface *surf, bool block)
                    surf->disp_height);
     } else {
         DebugMsg("surface %u is absent\n", surf->surface_id);
+        pqt->last_path = TEGRA_PQT_PATH_NONE;
         no_surf = true;
     }
 
@@ -413,35 +907,43 @@ static void pqt_display_xv(tegra_pqt *pqt, tegra_surface *surf, bool block)
     }
 
     if (no_surf) {
-        return;
+        return pqt_predict_vblank(pqt, get_time());
     }
 
-    XSync(dev->display, 0);
+    XFlush(dev->display);
+    start = pqt_phase_end(pqt, TEGRA_PQT_PHASE_PUT, start);
 
-    if (dev->xv_v2 && block) {
-        TegraXvVdpauInfo vdpau_info = { 0 };
+    if (dev->xv_v2) {
+        TegraXvVdpauInfo vdpau_info = pqt_get_xv_info(pqt);
         VdpTime time = 0;
-        int32_t val;
-        int ret;
 
-        ret = XvGetPortAttribute(dev->display, dev->xv_port, dev->xvVdpauInfo,
-                                 &val);
-        if (ret != Success || !val) {
-            DebugMsg("failed to get XV_TEGRA_VDPAU_INFO %d val %d\n", ret, val);
-        } else {
-            vdpau_info.data = val;
+        /* sequence of the other CRTC is unrelated */
+        if (pqt->crtc_pipe != vdpau_info.crtc_pipe) {
+            pqt->vblank_ref_time[TEGRA_PQT_VBLANK_KMS] = 0;
+            pqt->crtc_pipe = vdpau_info.crtc_pipe;
         }
 
-        DebugMsg("vdpau_info.visible %u vdpau_info.crtc_pipe %u\n",
-                 vdpau_info.visible, vdpau_info.crtc_pipe);
+        /* samples the last vblank, doesn't block */
+        pqt_wait_vblank(pqt, vdpau_info.crtc_pipe, 0);
+
+        if (block && !pqt_request_vblank_event(pqt, surf)) {
+            if (tegra_vdpau_debug)
+                time = get_time();
 
-        if (tegra_vdpau_debug)
-            time = get_time();
+            scanout_time = pqt_wait_vblank(pqt, vdpau_info.crtc_pipe, 1);
+            pqt->last_vblank_waited = !!scanout_time;
 
-        wait_for_vblank(dev, vdpau_info.crtc_pipe);
+            DebugMsg("waited for VBLANK %llu usec\n",
+                     (get_time() - time) / 1000);
+        }
 
-        DebugMsg("waited for VBLANK %llu usec\n", (get_time() - time) / 1000);
+        pqt_phase_end(pqt, TEGRA_PQT_PHASE_VBLANK, start);
     }
+
+    if (!scanout_time)
+        scanout_time = pqt_predict_vblank(pqt, get_time());
+
+    return scanout_time;
 }
 
 static void transit_display_to_xv(tegra_pqt *pqt)
@@ -451,7 +953,15 @@ static void transit_display_to_xv(tegra_pqt *pqt)
     if (surf)
         DebugMsg("surface %u\n", surf->surface_id);
 
-    pqt_destroy_dri2_drawable(pqt);
+    /* overlap may come back soon, DRI2 drawable is released later */
+    if (pqt->threads_running && pqt->dri2_drawable_created) {
+        pthread_mutex_lock(&pqt->disp_lock);
+        pqt->dri_release_time = get_time() + PQT_DRI_GRACE_PERIOD;
+        pthread_cond_signal(&pqt->disp_cond);
+        pthread_mutex_unlock(&pqt->disp_lock);
+    } else {
+        pqt_destroy_dri2_drawable(pqt);
+    }
 
     pqt->disp_state = TEGRA_PQT_XV;
 }
@@ -468,49 +978,33 @@ static void transit_display_to_dri(tegra_pqt *pqt)
     memset(&pqt->bg_old_state, 0, sizeof(pqt->bg_old_state));
     tegra_xv_reset_csc(dev);
 
+    pqt->dri_release_time = 0;
     pqt->disp_state = TEGRA_PQT_DRI;
 }
 
-static void pqt_update_dri_buffer(tegra_pqt *pqt, tegra_surface *surf)
+static void pqt_transfer_dri_surface(tegra_surface *surf,
+                                     struct host1x_pixelbuffer *dri_pixbuf)
 {
-    bool new_buffer;
+    struct tegra_stream *stream;
     int ret;
 
-    if (!pqt->dri_pixbuf ||
-        surf->disp_width != pqt->dri_pixbuf->width ||
-        surf->disp_height != pqt->dri_pixbuf->height)
-    {
-        pqt_update_dri_pixbuf(pqt);
-        new_buffer = true;
-    } else {
-        new_buffer = false;
-    }
-
-    if (!pqt->dri_pixbuf) {
-        return;
-    }
-
-    if (!new_buffer && pqt->dri_prep_surf == surf) {
-        DebugMsg("using prepared surface %u\n", surf->surface_id);
-        pqt->dri_prep_surf = NULL;
-        return;
-    }
-
     DebugMsg("surface %u+\n", surf->surface_id);
 
     pthread_mutex_lock(&surf->lock);
 
+    stream = tegra_stream_pool_get(surf->dev, surf->dev->gr2d);
+
     if (surf->shared) {
         DebugMsg("surface %u transfer YUV\n", surf->surface_id);
 
         if (surf->set_bg) {
-            ret = host1x_gr2d_clear_rect_clipped(surf->stream_2d,
-                                                 pqt->dri_pixbuf,
+            ret = host1x_gr2d_clear_rect_clipped(stream,
+                                                 dri_pixbuf,
                                                  surf->bg_color,
                                                  0,
                                                  0,
-                                                 pqt->dri_pixbuf->width,
-                                                 pqt->dri_pixbuf->height,
+                                                 dri_pixbuf->width,
+                                                 dri_pixbuf->height,
                                                  surf->shared->dst_x0,
                                                  surf->shared->dst_y0,
                                                  surf->shared->dst_x0 + surf->shared->dst_width,
@@ -521,9 +1015,9 @@ static void pqt_update_dri_buffer(tegra_pqt *pqt, tegra_surface *surf)
             }
         }
 
-        ret = host1x_gr2d_surface_blit(surf->stream_2d,
+        ret = host1x_gr2d_surface_blit(stream,
                                        surf->shared->video->pixbuf,
-                                       pqt->dri_pixbuf,
+                                       dri_pixbuf,
                                        &surf->shared->csc.gr2d,
                                        surf->shared->src_x0,
                                        surf->shared->src_y0,
@@ -539,10 +1033,10 @@ static void pqt_update_dri_buffer(tegra_pqt *pqt, tegra_surface *surf)
     } else if (surf->pixbuf) {
         DebugMsg("surface %u transfer RGB\n", surf->surface_id);
 
-        if (surf->pixbuf->format == pqt->dri_pixbuf->format)
-            ret = host1x_gr2d_blit(surf->stream_2d,
+        if (surf->pixbuf->format == dri_pixbuf->format)
+            ret = host1x_gr2d_blit(stream,
                                    surf->pixbuf,
-                                   pqt->dri_pixbuf,
+                                   dri_pixbuf,
                                    IDENTITY,
                                    0,
                                    0,
@@ -551,9 +1045,9 @@ static void pqt_update_dri_buffer(tegra_pqt *pqt, tegra_surface *surf)
                                    surf->disp_width,
                                    surf->disp_height);
         else
-            ret = host1x_gr2d_surface_blit(surf->stream_2d,
+            ret = host1x_gr2d_surface_blit(stream,
                                            surf->pixbuf,
-                                           pqt->dri_pixbuf,
+                                           dri_pixbuf,
                                            &csc_rgb_default,
                                            0,
                                            0,
@@ -570,32 +1064,140 @@ static void pqt_update_dri_buffer(tegra_pqt *pqt, tegra_surface *surf)
         DebugMsg("surface %u is absent\n", surf->surface_id);
     }
 
+    tegra_stream_pool_put(surf->dev, stream);
+
     pthread_mutex_unlock(&surf->lock);
 
     DebugMsg("surface %u-\n", surf->surface_id);
 }
 
-void pqt_prepare_dri_surface(tegra_pqt *pqt, tegra_surface *surf)
+static bool pqt_dri_buffer_fits(struct tegra_pqt_dri_buffer *buf,
+                                tegra_surface *surf)
+{
+    return surf->disp_width == buf->pixbuf->width &&
+           surf->disp_height == buf->pixbuf->height;
+}
+
+static void pqt_update_dri_buffer(tegra_pqt *pqt, tegra_surface *surf)
+{
+    /* next frame goes to the buffer given by X server after the swap */
+    if (!pqt->dri_back || pqt_dri_invalidated(pqt) ||
+        !pqt_dri_buffer_fits(pqt->dri_back, surf))
+        pqt_update_dri_pixbuf(pqt);
+
+    if (!pqt->dri_back) {
+        return;
+    }
+
+    /* buffer returned by X server could be prepared ahead of the swap */
+    if (pqt->dri_back->prep_surf == surf) {
+        DebugMsg("using prepared surface %u\n", surf->surface_id);
+        return;
+    }
+
+    pqt_wait_dri_buffer(pqt, pqt->dri_back);
+    pqt->dri_back->prep_surf = NULL;
+
+    pqt_transfer_dri_surface(surf, pqt->dri_back->pixbuf);
+}
+
+/*
+ * Buffers are expected to be handed out in the order they were used,
+ * hence the least recently used spare buffer is the next after the back
+ * buffer. There is a spare buffer only if X server rotates more than two
+ * buffers, or once the swap of the other buffer is done.
+ */
+static unsigned int pqt_predict_dri_buffers(tegra_pqt *pqt,
+                                            struct tegra_pqt_dri_buffer **bufs)
+{
+    struct tegra_pqt_dri_buffer *buf;
+    unsigned int i, k, n = 0;
+
+    /*
+     * Don't stall, surface will be transferred on display. Querying
+     * invalidated buffers is throttled by X server till swap is done.
+     */
+    if (!pqt->dri_back ||
+        (!pqt_dri_invalidated(pqt) && !pqt_dri_buffer_busy(pqt, pqt->dri_back)))
+        bufs[n++] = pqt->dri_back;
+
+    for (i = 0; i < TEGRA_PQT_DRI_BUFFERS_NB; i++) {
+        buf = &pqt->dri_bufs[i];
+
+        if (buf == pqt->dri_back || !pqt_dri_buffer_spare(pqt, buf))
+            continue;
+
+        for (k = n; k > 0 && bufs[k - 1] != pqt->dri_back &&
+                    bufs[k - 1]->last_use > buf->last_use; k--)
+            bufs[k] = bufs[k - 1];
+
+        bufs[k] = buf;
+        n++;
+    }
+
+    return n;
+}
+
+/*
+ * Surfaces are transferred ahead of their display into the buffers that X
+ * server is expected to return for them, the next queued surface and the
+ * one after it. Surface prepared in a buffer that X server doesn't return
+ * is transferred again on display.
+ */
+void pqt_prepare_dri_surfaces(tegra_pqt *pqt, tegra_surface *next,
+                              tegra_surface *after)
 {
+    struct tegra_pqt_dri_buffer *bufs[TEGRA_PQT_DRI_BUFFERS_NB + 1];
+    tegra_surface *surfs[2] = { next, after };
+    struct tegra_pqt_dri_buffer *buf;
+    tegra_surface *surf;
+    unsigned int i, n;
+
     pthread_mutex_lock(&pqt->lock);
 
-    if ((tegra_vdpau_force_dri || pqt->overlapped_current) &&
+    if (!(tegra_vdpau_force_dri || pqt->overlapped_current) ||
         !initialize_dri2(pqt))
     {
         pthread_mutex_unlock(&pqt->lock);
         return;
     }
 
-    pthread_mutex_lock(&surf->lock);
+    n = pqt_predict_dri_buffers(pqt, bufs);
 
-    if (tegra_vdpau_force_dri || pqt->overlapped_current) {
-        pqt_update_dri_buffer(pqt, surf);
-        pqt->dri_prep_surf = surf;
+    for (i = 0; i < 2 && surfs[i]; i++) {
+        surf = surfs[i];
 
-        DebugMsg("surface %u\n", surf->surface_id);
+        if (i >= n) {
+            DebugMsg("no free buffer, surface %u not prepared\n",
+                     surf->surface_id);
+            break;
+        }
+
+        pthread_mutex_lock(&surf->lock);
+
+        buf = bufs[i];
+
+        if (i == 0 && buf == pqt->dri_back) {
+            pqt_update_dri_buffer(pqt, surf);
+            buf = pqt->dri_back;
+        } else if (buf == pqt->dri_back) {
+            /* spare buffer was just returned as the back buffer */
+            buf = NULL;
+        } else if (buf->prep_surf != surf && pqt_dri_buffer_fits(buf, surf)) {
+            pqt_forget_dri_surface(pqt, surf);
+            pqt_transfer_dri_surface(surf, buf->pixbuf);
+        } else if (buf->prep_surf != surf) {
+            buf = NULL;
+        }
+
+        if (buf) {
+            buf->prep_surf = surf;
+            DebugMsg("surface %u\n", surf->surface_id);
+        }
+
+        pthread_mutex_unlock(&surf->lock);
     }
 
-    pthread_mutex_unlock(&surf->lock);
     pthread_mutex_unlock(&pqt->lock);
 }
 
@@ -603,12 +1205,17 @@ void pqt_display_surface(tegra_pqt *pqt, tegra_surface *surf,
                          bool update_status, bool transit, bool vsync)
 {
     tegra_device *dev = pqt->dev;
+    VdpTime scanout_time;
+    VdpTime start;
 
     DebugMsg("surface %u earliest_presentation_time %llu+\n",
              surf->surface_id, surf->earliest_presentation_time);
 
     pthread_mutex_lock(&pqt->lock);
 
+    memset(pqt->last_phase, 0, sizeof(pqt->last_phase));
+    pqt->last_vblank_waited = false;
+
     if (tegra_vdpau_force_dri || pqt->overlapped_current) {
         initialize_dri2(pqt);
     }
@@ -619,14 +1226,17 @@ void pqt_display_surface(tegra_pqt *pqt, tegra_surface *surf,
             (pqt->overlapped_current && !tegra_vdpau_force_xv)) &&
         dev->dri2_ready)
     {
+        start = get_time();
         pqt_update_dri_buffer(pqt, surf);
-        pqt_display_dri(pqt, surf, vsync);
+        pqt_phase_end(pqt, TEGRA_PQT_PHASE_BLIT, start);
+
+        scanout_time = pqt_display_dri(pqt, surf, vsync);
 
         if (transit || pqt->disp_state != TEGRA_PQT_DRI) {
             transit_display_to_dri(pqt);
         }
     } else {
-        pqt_display_xv(pqt, surf, vsync);
+        scanout_time = pqt_display_xv(pqt, surf, vsync);
 
         if (transit || pqt->disp_state != TEGRA_PQT_XV) {
             transit_display_to_xv(pqt);
@@ -634,7 +1244,7 @@ void pqt_display_surface(tegra_pqt *pqt, tegra_surface *surf,
     }
 
     if (update_status) {
-        surf->first_presentation_time = get_time();
+        surf->first_presentation_time = scanout_time;
         surf->status = VDP_PRESENTATION_QUEUE_STATUS_VISIBLE;
     }
 
@@ -650,31 +1260,83 @@ void pqt_display_surface(tegra_pqt *pqt, tegra_surface *surf,
     DebugMsg("surface %u-\n", surf->surface_id);
 }
 
+static void pqt_update_overlap_state(tegra_pqt *pqt, bool overlapped,
+                                     VdpTime now)
+{
+    DebugMsg("updating overlap state\n");
+
+    /* overlap keeps toggling, transitions get less eager */
+    if (now - pqt->last_transit_time < PQT_FLAPPING_PERIOD) {
+        pqt->xv_holdoff *= 2;
+
+        if (pqt->xv_holdoff > PQT_XV_HOLDOFF_MAX)
+            pqt->xv_holdoff = PQT_XV_HOLDOFF_MAX;
+    } else {
+        pqt->xv_holdoff = PQT_XV_HOLDOFF_MIN;
+    }
+
+    pqt->last_transit_time = now;
+    pqt->overlapped_current = overlapped;
+
+    if (pqt->disp_surf) {
+        pqt_display_surface(pqt, pqt->disp_surf, false, true, false);
+    }
+}
+
 static void * pqt_display_thr(void *opaque)
 {
     tegra_pqt *pqt = opaque;
+    VdpTime deadline, now;
     bool overlapped;
+    bool release_dri;
+    bool transit;
+    bool win_move;
+    struct timespec tp;
 
     while (!pqt->exit) {
         pthread_mutex_lock(&pqt->disp_lock);
-        if (pqt->overlapped_current == pqt->overlapped_new && !pqt->win_move) {
-            pthread_cond_wait(&pqt->disp_cond, &pqt->disp_lock);
 
-            if (pqt->exit)
-                break;
-        }
+        now = get_time();
+        deadline = UINT64_MAX;
         overlapped = pqt->overlapped_new;
-        pthread_mutex_unlock(&pqt->disp_lock);
+        transit = (pqt->overlapped_current != overlapped);
+
+        /* obscured window needs DRI immediately, Xv can wait */
+        if (transit && !overlapped &&
+            now < pqt->overlap_change_time + pqt->xv_holdoff)
+        {
+            deadline = pqt->overlap_change_time + pqt->xv_holdoff;
+            transit = false;
+        }
 
-        pthread_mutex_lock(&pqt->lock);
-        if (pqt->overlapped_current != overlapped) {
-            DebugMsg("updating overlap state\n");
+        release_dri = pqt->dri_release_time && now >= pqt->dri_release_time;
 
-            pqt->overlapped_current = overlapped;
+        if (pqt->dri_release_time && !release_dri &&
+            pqt->dri_release_time < deadline)
+                deadline = pqt->dri_release_time;
 
-            if (pqt->disp_surf) {
-                pqt_display_surface(pqt, pqt->disp_surf, false, true, false);
+        win_move = pqt->win_move;
+
+        if (!transit && !win_move && !release_dri) {
+            if (deadline == UINT64_MAX) {
+                pthread_cond_wait(&pqt->disp_cond, &pqt->disp_lock);
+            } else {
+                tp.tv_sec = deadline / 1000000000ULL;
+                tp.tv_nsec = deadline - tp.tv_sec * 1000000000ULL;
+
+                pthread_cond_timedwait(&pqt->disp_cond, &pqt->disp_lock,
+                                       &tp);
             }
+
+            pthread_mutex_unlock(&pqt->disp_lock);
+            continue;
+        }
+
+        pthread_mutex_unlock(&pqt->disp_lock);
+
+        pthread_mutex_lock(&pqt->lock);
+        if (transit) {
+            pqt_update_overlap_state(pqt, overlapped, now);
         }
         if (pqt->win_move) {
             pqt->win_move = false;
@@ -683,88 +1345,231 @@ static void * pqt_display_thr(void *opaque)
                 pqt_display_surface(pqt, pqt->disp_surf, false, false, false);
             }
         }
+        if (release_dri && pqt->dri_release_time &&
+            pqt->disp_state != TEGRA_PQT_DRI)
+        {
+            DebugMsg("releasing DRI2 drawable\n");
+            pqt_destroy_dri2_drawable(pqt);
+        }
+        if (release_dri) {
+            pqt->dri_release_time = 0;
+        }
         pthread_mutex_unlock(&pqt->lock);
     }
 
     return NULL;
 }
 
-static void * pqt_x11_event_thr(void *opaque)
+/* Xv info is read by presentation under the target's lock */
+static void pqt_invalidate_xv_info(tegra_pqt *pqt)
+{
+    pthread_mutex_lock(&pqt->lock);
+    pqt->xv_info_valid = false;
+    pthread_mutex_unlock(&pqt->lock);
+}
+
+static void pqt_handle_x11_event(tegra_pqt *pqt, XEvent *event)
 {
-    tegra_pqt *pqt = opaque;
-    tegra_device *dev = pqt->dev;
     bool overlapped;
-    bool win_move;
-    int x = 0, y = 0;
-    XEvent event;
-    struct timeval tv;
-    fd_set in_fds;
-    int fd;
 
-    fd = ConnectionNumber(dev->display);
+    if (tegra_vdpau_force_xv || tegra_vdpau_force_dri)
+        return;
 
-    while (!pqt->exit) {
-        memset(&tv, 0, sizeof(tv));
-        tv.tv_usec = 300000;
+    switch (event->type) {
+    case VisibilityNotify:
+        overlapped = (event->xvisibility.state == VisibilityPartiallyObscured ||
+                      event->xvisibility.state == VisibilityFullyObscured);
 
-        FD_ZERO(&in_fds);
-        FD_SET(fd, &in_fds);
+        pqt_invalidate_xv_info(pqt);
 
-        if (select(fd + 1, &in_fds, NULL, NULL, &tv) <= 0) {
-            continue;
-        }
+        if (pqt->overlapped_new != overlapped) {
+            pthread_mutex_lock(&pqt->disp_lock);
 
-        if (tegra_vdpau_force_xv || tegra_vdpau_force_dri)
-            break;
+            DebugMsg("window overlapped %d\n", overlapped);
 
-        if (XCheckWindowEvent(dev->display, pqt->drawable,
-                              VisibilityChangeMask, &event)) {
+            pqt->overlapped_new = overlapped;
+            pqt->overlap_change_time = get_time();
+            pthread_cond_signal(&pqt->disp_cond);
 
-            overlapped = (event.xvisibility.state == VisibilityPartiallyObscured ||
-                          event.xvisibility.state == VisibilityFullyObscured);
+            pthread_mutex_unlock(&pqt->disp_lock);
+        }
+        break;
 
-            if (pqt->overlapped_new != overlapped) {
-                pthread_mutex_lock(&pqt->disp_lock);
+    case ConfigureNotify:
+        pqt_invalidate_xv_info(pqt);
 
-                DebugMsg("window overlapped %d\n", overlapped);
+        if (pqt->win_x != event->xconfigure.x ||
+            pqt->win_y != event->xconfigure.y)
+        {
+            pqt->win_x = event->xconfigure.x;
+            pqt->win_y = event->xconfigure.y;
 
-                pqt->overlapped_new = overlapped;
-                pthread_cond_signal(&pqt->disp_cond);
+            pthread_mutex_lock(&pqt->disp_lock);
 
-                pthread_mutex_unlock(&pqt->disp_lock);
-            }
-        } else if (XCheckWindowEvent(dev->display, pqt->drawable,
-                                     StructureNotifyMask, &event)) {
-
-            if (event.type == ConfigureNotify &&
-                (x != event.xconfigure.x ||
-                 y != event.xconfigure.y))
-            {
-                x = event.xconfigure.x;
-                y = event.xconfigure.y;
-                win_move = true;
-            } else {
-                win_move = false;
-            }
+            DebugMsg("window move (%d, %d)\n", pqt->win_x, pqt->win_y);
 
-            XPutBackEvent(dev->display, &event);
+            pqt->win_move = true;
+            pthread_cond_signal(&pqt->disp_cond);
+
+            pthread_mutex_unlock(&pqt->disp_lock);
+        }
+        break;
+    }
+}
+
+/*
+ * Window events of all targets are received by a single thread of the
+ * device, using a separate X connection. Hence application's own event
+ * queue and event masks are left alone.
+ */
+static void * tegra_x11_events_thr(void *opaque)
+{
+    tegra_device *dev = opaque;
+    struct tegra_x11_events *events = &dev->x11_events;
+    struct pollfd fds[2];
+    uint64_t counter;
+    tegra_pqt *pqt;
+    XEvent event;
 
-            if (win_move) {
-                pthread_mutex_lock(&pqt->disp_lock);
+    fds[0].fd = ConnectionNumber(events->display);
+    fds[0].events = POLLIN;
+    fds[1].fd = events->wake_fd;
+    fds[1].events = POLLIN;
 
-                DebugMsg("window move (%d, %d)\n", x, y);
+    while (!events->exit) {
+        while (XPending(events->display)) {
+            XNextEvent(events->display, &event);
 
-                pqt->win_move = true;
-                pthread_cond_signal(&pqt->disp_cond);
+            pthread_mutex_lock(&events->lock);
 
-                pthread_mutex_unlock(&pqt->disp_lock);
+            LIST_FOR_EACH_ENTRY(pqt, &events->targets, x11_events_entry) {
+                if (pqt->drawable == event.xany.window) {
+                    pqt_handle_x11_event(pqt, &event);
+                    break;
+                }
             }
+
+            pthread_mutex_unlock(&events->lock);
+        }
+
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+            ErrorMsg("poll failed: %s\n", strerror(errno));
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            if (read(events->wake_fd, &counter, sizeof(counter)) < 0)
+                DebugMsg("failed to read wake counter: %s\n",
+                         strerror(errno));
         }
     }
 
     return NULL;
 }
 
+void tegra_x11_events_init(tegra_device *dev)
+{
+    pthread_mutex_init(&dev->x11_events.lock, NULL);
+    LIST_INITHEAD(&dev->x11_events.targets);
+    dev->x11_events.wake_fd = -1;
+}
+
+static bool tegra_x11_events_start(tegra_device *dev)
+{
+    struct tegra_x11_events *events = &dev->x11_events;
+    int ret;
+
+    if (events->running)
+        return true;
+
+    events->display = XOpenDisplay(DisplayString(dev->display));
+    if (!events->display) {
+        ErrorMsg("failed to open X display for events\n");
+        return false;
+    }
+
+    events->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (events->wake_fd < 0) {
+        ErrorMsg("eventfd failed: %s\n", strerror(errno));
+        goto close_display;
+    }
+
+    events->exit = false;
+
+    ret = pthread_create(&events->thread, NULL, tegra_x11_events_thr, dev);
+    if (ret != 0) {
+        ErrorMsg("pthread_create failed\n");
+        goto close_fd;
+    }
+
+    events->running = true;
+
+    return true;
+
+close_fd:
+    close(events->wake_fd);
+    events->wake_fd = -1;
+close_display:
+    XCloseDisplay(events->display);
+    events->display = NULL;
+
+    return false;
+}
+
+void tegra_x11_events_release(tegra_device *dev)
+{
+    struct tegra_x11_events *events = &dev->x11_events;
+    uint64_t counter = 1;
+
+    if (!events->running)
+        return;
+
+    events->exit = true;
+
+    if (write(events->wake_fd, &counter, sizeof(counter)) < 0)
+        ErrorMsg("failed to wake up events thread: %s\n", strerror(errno));
+
+    pthread_join(events->thread, NULL);
+
+    XCloseDisplay(events->display);
+    close(events->wake_fd);
+
+    events->display = NULL;
+    events->wake_fd = -1;
+    events->running = false;
+}
+
+static void pqt_watch_x11_events(tegra_pqt *pqt)
+{
+    struct tegra_x11_events *events = &pqt->dev->x11_events;
+
+    pthread_mutex_lock(&events->lock);
+
+    if (tegra_x11_events_start(pqt->dev)) {
+        XSelectInput(events->display, pqt->drawable,
+                     VisibilityChangeMask | StructureNotifyMask);
+        XFlush(events->display);
+
+        LIST_ADDTAIL(&pqt->x11_events_entry, &events->targets);
+        pqt->x11_events_watched = true;
+    }
+
+    pthread_mutex_unlock(&events->lock);
+}
+
+static void pqt_unwatch_x11_events(tegra_pqt *pqt)
+{
+    struct tegra_x11_events *events = &pqt->dev->x11_events;
+
+    if (!pqt->x11_events_watched)
+        return;
+
+    pthread_mutex_lock(&events->lock);
+    LIST_DEL(&pqt->x11_events_entry);
+    pqt->x11_events_watched = false;
+    pthread_mutex_unlock(&events->lock);
+}
+
 void ref_queue_target(tegra_pqt *pqt)
 {
     atomic_inc(&pqt->refcnt);
@@ -777,9 +1582,9 @@ VdpStatus unref_queue_target(tegra_pqt *pqt)
     if (!atomic_dec_and_test(&pqt->refcnt))
         return VDP_STATUS_OK;
 
-    if (pqt->threads_running) {
-        pthread_join(pqt->x11_thread, NULL);
+    pqt_unwatch_x11_events(pqt);
 
+    if (pqt->threads_running) {
         pthread_mutex_lock(&pqt->disp_lock);
         pthread_cond_signal(&pqt->disp_cond);
         pthread_mutex_unlock(&pqt->disp_lock);
@@ -790,13 +1595,18 @@ VdpStatus unref_queue_target(tegra_pqt *pqt)
     if (pqt->disp_state == TEGRA_PQT_XV)
         XvStopVideo(dev->display, dev->xv_port, pqt->drawable);
 
-    if (pqt->disp_state == TEGRA_PQT_DRI)
-        pqt_destroy_dri2_drawable(pqt);
+    /* DRI2 drawable may be kept warm while Xv is used */
+    pqt_destroy_dri2_drawable(pqt);
 
     if (pqt->gc != None) {
         XFreeGC(dev->display, pqt->gc);
     }
 
+    if (pqt->vblank_fd >= 0)
+        close(pqt->vblank_fd);
+
+    pqt_release_dri_buffers(pqt);
+
     unref_device(dev);
     free(pqt);
 
@@ -832,9 +1642,9 @@ VdpStatus vdp_presentation_queue_target_create_x11(
     XGCValues values;
     tegra_pqt *pqt;
     pthread_mutexattr_t mutex_attrs;
+    pthread_condattr_t cond_attrs;
     pthread_attr_t thread_attrs;
     XSetWindowAttributes set;
-    XWindowAttributes get;
     int val, ret;
 
     if (dev == NULL) {
@@ -873,14 +1683,17 @@ VdpStatus vdp_presentation_queue_target_create_x11(
     pqt->drawable = drawable;
     pqt->gc = XCreateGC(dev->display, drawable, 0, &values);
     pqt->bg_new_state.colorkey = 0x200507;
+    pqt->xv_holdoff = PQT_XV_HOLDOFF_MIN;
+
+    /* own DRM file, so that only this target receives its vblank events */
+    pqt->vblank_fd = drmOpen("tegra", "drm");
+    if (pqt->vblank_fd < 0)
+        ErrorMsg("failed to open DRM for vblank events, blocking on vblank\n");
+    else
+        fcntl(pqt->vblank_fd, F_SETFL, O_NONBLOCK);
 
-    XGetWindowAttributes(dev->display, drawable, &get);
-    set.event_mask  = get.all_event_masks;
-    set.event_mask |= VisibilityChangeMask;
-    set.event_mask |= StructureNotifyMask;
     set.backing_store = Always;
-    XChangeWindowAttributes(dev->display, drawable,
-                            CWEventMask | CWBackingStore, &set);
+    XChangeWindowAttributes(dev->display, drawable, CWBackingStore, &set);
 
     XSetWindowBackground(dev->display, drawable, 0x000000);
     XClearWindow(dev->display, drawable);
@@ -913,13 +1726,10 @@ VdpStatus vdp_presentation_queue_target_create_x11(
     }
 
     if (_Xglobal_lock && !(tegra_vdpau_force_xv || tegra_vdpau_force_dri)) {
-        pthread_attr_init(&thread_attrs);
-        pthread_attr_setdetachstate(&thread_attrs, PTHREAD_CREATE_JOINABLE);
-        pthread_create(&pqt->x11_thread, &thread_attrs,
-                       pqt_x11_event_thr, pqt);
-
         pthread_mutex_init(&pqt->disp_lock, NULL);
-        pthread_cond_init(&pqt->disp_cond, NULL);
+        pthread_condattr_init(&cond_attrs);
+        pthread_condattr_setclock(&cond_attrs, CLOCK_MONOTONIC);
+        pthread_cond_init(&pqt->disp_cond, &cond_attrs);
 
         pthread_attr_init(&thread_attrs);
         pthread_attr_setdetachstate(&thread_attrs, PTHREAD_CREATE_JOINABLE);
@@ -927,6 +1737,8 @@ VdpStatus vdp_presentation_queue_target_create_x11(
                        pqt_display_thr, pqt);
 
         pqt->threads_running = true;
+
+        pqt_watch_x11_events(pqt);
     }
 
     *target = i;
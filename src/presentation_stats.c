@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "vdpau_tegra.h"
+
+/* used for detecting late frames until vblank period is known */
+#define DEFAULT_FRAME_PERIOD    16666667ULL
+
+bool tegra_vdpau_present_stats;
+
+static VdpTime stats_period;
+
+static const char * const path_names[TEGRA_PQT_PATHS_NB] = {
+    [TEGRA_PQT_PATH_NONE]   = "none",
+    [TEGRA_PQT_PATH_XV_YUV] = "xv-yuv",
+    [TEGRA_PQT_PATH_XV_RGB] = "xv-rgb",
+    [TEGRA_PQT_PATH_DRI]    = "dri",
+};
+
+static const char * const phase_names[TEGRA_PQT_PHASES_NB] = {
+    [TEGRA_PQT_PHASE_BLIT]   = "blit",
+    [TEGRA_PQT_PHASE_PUT]    = "put",
+    [TEGRA_PQT_PHASE_VBLANK] = "vblank wait",
+};
+
+static unsigned int time_to_bucket(VdpTime time)
+{
+    unsigned int bucket = 0;
+    VdpTime msec = time / 1000000;
+
+    while (msec && bucket < TEGRA_PQ_STATS_BUCKETS - 1) {
+        msec >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+static void format_histogram(char *buf, size_t size, unsigned int *hist)
+{
+    unsigned int i;
+    int len = 0;
+
+    buf[0] = '\0';
+
+    for (i = 0; i < TEGRA_PQ_STATS_BUCKETS && len < (int)size; i++) {
+        if (i < TEGRA_PQ_STATS_BUCKETS - 1)
+            len += snprintf(buf + len, size - len, " <%u:%u",
+                            1 << i, hist[i]);
+        else
+            len += snprintf(buf + len, size - len, " >=%u:%u",
+                            1 << (i - 1), hist[i]);
+    }
+}
+
+static void presentation_stats_dump_locked(tegra_pq *pq, VdpTime now)
+{
+    struct tegra_pq_stats *st = &pq->stats;
+    VdpTime pending_earliest;
+    char hist[128];
+    unsigned int i;
+
+    InfoMsg("queue %u: %.1f s, queued %llu, presented %llu "
+            "(%s %llu, %s %llu, %s %llu, %s %llu), skipped %llu, late %llu\n",
+            pq->id, (now - st->period_start) / 1e9,
+            st->queued, st->presented,
+            path_names[TEGRA_PQT_PATH_XV_YUV], st->path[TEGRA_PQT_PATH_XV_YUV],
+            path_names[TEGRA_PQT_PATH_XV_RGB], st->path[TEGRA_PQT_PATH_XV_RGB],
+            path_names[TEGRA_PQT_PATH_DRI], st->path[TEGRA_PQT_PATH_DRI],
+            path_names[TEGRA_PQT_PATH_NONE], st->path[TEGRA_PQT_PATH_NONE],
+            st->skipped, st->late);
+
+    format_histogram(hist, sizeof(hist), st->lateness);
+
+    InfoMsg("queue %u: lateness msec avg %.2f max %.2f, histogram%s\n",
+            pq->id,
+            st->lateness_cnt ? st->lateness_sum / 1e6 / st->lateness_cnt : 0.0,
+            st->lateness_max / 1e6, hist);
+
+    for (i = 0; i < TEGRA_PQT_PHASES_NB; i++) {
+        format_histogram(hist, sizeof(hist), st->latency[i]);
+
+        InfoMsg("queue %u: %s msec avg %.2f max %.2f, histogram%s\n",
+                pq->id, phase_names[i],
+                st->presented ? st->latency_sum[i] / 1e6 / st->presented : 0.0,
+                st->latency_max[i] / 1e6, hist);
+    }
+
+    /* frame still waits for its vblank */
+    pending_earliest = st->pending_earliest;
+
+    memset(st, 0, sizeof(*st));
+    st->period_start = now;
+    st->pending_earliest = pending_earliest;
+}
+
+static void presentation_stats_lateness(tegra_pq *pq, VdpTime earliest_time,
+                                        VdpTime scanout_time)
+{
+    struct tegra_pq_stats *st = &pq->stats;
+    VdpTime frame_period;
+    VdpTime lateness = 0;
+
+    if (scanout_time > earliest_time)
+        lateness = scanout_time - earliest_time;
+
+    frame_period = pq->pqt->vblank_period ?: DEFAULT_FRAME_PERIOD;
+
+    /* frame should be scanned out by the first vblank after deadline */
+    if (lateness > frame_period)
+        st->late++;
+
+    st->lateness[time_to_bucket(lateness)]++;
+    st->lateness_sum += lateness;
+    st->lateness_cnt++;
+    if (st->lateness_max < lateness)
+        st->lateness_max = lateness;
+}
+
+void presentation_stats_init(const char *period)
+{
+    long seconds = strtol(period, NULL, 10);
+
+    /* non-positive period means dump on queue destruction only */
+    if (seconds > 0)
+        stats_period = seconds * 1000000000ULL;
+
+    tegra_vdpau_present_stats = true;
+}
+
+/* statistics are accessed under the queue's lock */
+void presentation_stats_queued(tegra_pq *pq)
+{
+    if (!tegra_vdpau_present_stats)
+        return;
+
+    if (!pq->stats.period_start)
+        pq->stats.period_start = get_time();
+
+    pq->stats.queued++;
+}
+
+/*
+ * Lateness is measured against the actual vblank timestamp, which is
+ * known on return only if display blocked on vblank. Otherwise it's
+ * accounted once vblank event arrives, frames that don't get the event
+ * have only predicted scanout time and aren't accounted.
+ */
+void presentation_stats_presented(tegra_pq *pq, tegra_surface *surf,
+                                  VdpTime earliest_time)
+{
+    VdpTime phase[TEGRA_PQT_PHASES_NB];
+    struct tegra_pq_stats *st = &pq->stats;
+    tegra_pqt *pqt = pq->pqt;
+    enum tegra_pqt_path path;
+    VdpTime scanout_time;
+    bool vblank_waited;
+    bool vblank_event;
+    unsigned int i;
+    VdpTime now;
+
+    if (!tegra_vdpau_present_stats)
+        return;
+
+    pthread_mutex_lock(&pqt->lock);
+    memcpy(phase, pqt->last_phase, sizeof(phase));
+    path = pqt->last_path;
+    vblank_waited = pqt->last_vblank_waited;
+    vblank_event = (pqt->vblank_surf == surf);
+    pthread_mutex_unlock(&pqt->lock);
+
+    pthread_mutex_lock(&surf->lock);
+    scanout_time = surf->first_presentation_time;
+    pthread_mutex_unlock(&surf->lock);
+
+    st->presented++;
+    st->path[path]++;
+
+    for (i = 0; i < TEGRA_PQT_PHASES_NB; i++) {
+        st->latency[i][time_to_bucket(phase[i])]++;
+        st->latency_sum[i] += phase[i];
+        if (st->latency_max[i] < phase[i])
+            st->latency_max[i] = phase[i];
+    }
+
+    st->pending_earliest = 0;
+
+    /* frames displayed immediately have no deadline */
+    if (earliest_time) {
+        if (vblank_event)
+            st->pending_earliest = earliest_time;
+        else if (vblank_waited)
+            presentation_stats_lateness(pq, earliest_time, scanout_time);
+    }
+
+    now = get_time();
+
+    if (stats_period && now - st->period_start >= stats_period)
+        presentation_stats_dump_locked(pq, now);
+}
+
+void presentation_stats_scanout(tegra_pq *pq, VdpTime scanout_time)
+{
+    struct tegra_pq_stats *st = &pq->stats;
+
+    if (!tegra_vdpau_present_stats || !st->pending_earliest)
+        return;
+
+    presentation_stats_lateness(pq, st->pending_earliest, scanout_time);
+    st->pending_earliest = 0;
+}
+
+void presentation_stats_dump(tegra_pq *pq)
+{
+    if (!tegra_vdpau_present_stats || !pq->stats.period_start)
+        return;
+
+    presentation_stats_dump_locked(pq, get_time());
+}
@@ -20,11 +20,17 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+
+#ifdef MODULATE
 pseq_to_dw_exec_nb = 3	// the number of 'EXEC' block where DW happens
+#else
+pseq_to_dw_exec_nb = 1	// the number of 'EXEC' block where DW happens
+#endif
 alu_buffer_size = 1	// number of .rgba regs carried through pipeline
 
 .asm
 
+#ifdef MODULATE
 EXEC
 	MFU:	sfu:  rcp r4
 		mul0: bar, sfu, bar0
@@ -59,3 +65,24 @@ EXEC
 
 	DW:	store rt1, r0, r1
 ;
+#else
+EXEC
+	// fetch dst pixel to r2,r3
+	PSEQ:	0x0081000A
+
+	MFU:	sfu:  rcp r4
+		mul0: bar, sfu, bar0
+		mul1: bar, sfu, bar1
+		ipl:  t0.fp20, t0.fp20, NOP, NOP
+
+	// sample tex1 (mask)
+	TEX:	tex r0, r1, tex0, r0, r1, r2
+
+	ALU:
+		ALU0:	MAD  r0.l, r1.h-1, -r2.l, r0.l
+		ALU1:	MAD  r0.h, r1.h-1, -r2.h, r0.h
+		ALU2:	MAD  r1.l, r1.h-1, -r3.l, r1.l
+
+	DW:	store rt1, r0, r1
+;
+#endif
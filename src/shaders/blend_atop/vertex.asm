@@ -1,11 +1,17 @@
 .exports
 	[0] = "position";
+#ifdef MODULATE
 	[1] = "colors";
 	[2] = "texcoords";
+#else
+	[1] = "texcoords";
+#endif
 
 .attributes
 	[0] = "position";
+#ifdef MODULATE
 	[1] = "colors";
+#endif
 	[2] = "texcoords";
 
 .constants
@@ -21,10 +27,14 @@ EXEC(export[0]=vector)
 	MOVv r63.**zw, c[0].xyzw
 ;
 
+#ifdef MODULATE
 EXEC(export[1]=vector)
 	MOVv r63.xyzw, a[1].xyzw
 ;
 
 EXEC_END(export[2]=vector)
+#else
+EXEC_END(export[1]=vector)
+#endif
 	MOVv r63.xy**, a[2].xyzw
 ;
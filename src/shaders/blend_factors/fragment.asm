@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) Dmitry Osipenko
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifdef MIN_MAX
+#ifdef MODULATE
+pseq_to_dw_exec_nb = 7	// the number of 'EXEC' block where DW happens
+#else
+pseq_to_dw_exec_nb = 5	// the number of 'EXEC' block where DW happens
+#endif
+alu_buffer_size = 4	// number of .rgba regs carried through pipeline
+#else
+#ifdef MODULATE
+pseq_to_dw_exec_nb = 6	// the number of 'EXEC' block where DW happens
+#else
+pseq_to_dw_exec_nb = 4	// the number of 'EXEC' block where DW happens
+#endif
+alu_buffer_size = 3	// number of .rgba regs carried through pipeline
+#endif
+
+/*
+ * result = src * Fs + dst * Fd, where each blend factor is evaluated as
+ *
+ *   F = k0 + kS * S + kSa * Sa + kD * D + kDa * Da + kSat * min(Sa, 1 - Da)
+ *
+ * Source factor coefficients are in u0-u5, destination in u6-u11:
+ *
+ *   [0].l = k0.r   [0].h = k0.g   [1].l = k0.b   [1].h = k0.a
+ *   [2].l = kS     [2].h = kSa    [3].l = kD     [3].h = kDa
+ *   [4].l = kSat   [4].h = kSa.a  [5].l = kDa.a
+ *
+ * Subtraction is handled by negating the coefficients. MIN / MAX equations
+ * zero out the factors and select min(src, dst) / max(src, dst) instead:
+ *
+ *   [12].l = min.rgb   [12].h = max.rgb   [13].l = min.a   [13].h = max.a
+ *
+ * r0,r1 = src, r2,r3 = dst, r5.l = saturate
+ * r5.h,r6.l,r6.h,r7.l = Fs, r7.h,r8.l,r8.h,r9.l = Fd
+ * r10,r11 = min(src, dst), r12,r13 = max(src, dst)
+ */
+
+.asm
+
+#ifdef MODULATE
+EXEC
+	MFU:	sfu:  rcp r4
+		mul0: bar, sfu, bar0
+		mul1: bar, sfu, bar1
+		ipl:  t1.fp20, t1.fp20, NOP, NOP
+
+	// sample tex0 (src)
+	TEX:	tex r2, r3, tex0, r0, r1, r2
+;
+
+EXEC
+	MFU:	sfu:  rcp r4
+		mul0: bar, sfu, bar0
+		mul1: bar, sfu, bar1
+		ipl:  t0.fx10, t0.fx10, NOP, NOP
+
+	// modulate src by vertex color
+	ALU:
+		ALU0:	MAD  r0.l, r2.l, r0.l, #0
+		ALU1:	MAD  r0.h, r2.h, r0.h, #0
+		ALU2:	MAD  r1.l, r3.l, r1.l, #0
+		ALU3:	MAD  r1.h, r3.h, r1.h, #0
+;
+
+#endif
+EXEC
+	// fetch dst pixel to r2,r3
+	PSEQ:	0x0081000A
+
+#ifndef MODULATE
+	MFU:	sfu:  rcp r4
+		mul0: bar, sfu, bar0
+		mul1: bar, sfu, bar1
+		ipl:  t0.fp20, t0.fp20, NOP, NOP
+
+	// sample tex0 (src)
+	TEX:	tex r0, r1, tex0, r0, r1, r2
+
+#endif
+	ALU:
+		ALU0:	MAD  r5.h, u2.l, r0.l, u0.l
+		ALU1:	MAD  r6.l, u2.l, r0.h, u0.h
+		ALU2:	MAD  r6.h, u2.l, r1.l, u1.l
+		ALU3:	MIN  r5.l, r1.h, -r3.h-1, #0
+
+	ALU:
+		ALU0:	MAD  r5.h, u2.h, r1.h, r5.h
+		ALU1:	MAD  r6.l, u2.h, r1.h, r6.l
+		ALU2:	MAD  r6.h, u2.h, r1.h, r6.h
+		ALU3:	MAD  r7.l, u4.h, r1.h, u1.h
+
+	ALU:
+		ALU0:	MAD  r5.h, u3.l, r2.l, r5.h
+		ALU1:	MAD  r6.l, u3.l, r2.h, r6.l
+		ALU2:	MAD  r6.h, u3.l, r3.l, r6.h
+		ALU3:	MAD  r7.l, u5.l, r3.h, r7.l
+;
+
+EXEC
+	ALU:
+		ALU0:	MAD  r5.h, u3.h, r3.h, r5.h
+		ALU1:	MAD  r6.l, u3.h, r3.h, r6.l
+		ALU2:	MAD  r6.h, u3.h, r3.h, r6.h
+		ALU3:	MAD  r9.l, u10.h, r1.h, u7.h
+
+	ALU:
+		ALU0:	MAD  r5.h, u4.l, r5.l, r5.h
+		ALU1:	MAD  r6.l, u4.l, r5.l, r6.l
+		ALU2:	MAD  r6.h, u4.l, r5.l, r6.h
+		ALU3:	MAD  r9.l, u11.l, r3.h, r9.l
+
+	ALU:
+		ALU0:	MAD  r7.h, u8.l, r0.l, u6.l
+		ALU1:	MAD  r8.l, u8.l, r0.h, u6.h
+		ALU2:	MAD  r8.h, u8.l, r1.l, u7.l
+		ALU3:	MAD  r9.h, r3.h, r9.l, #0
+;
+
+EXEC
+	ALU:
+		ALU0:	MAD  r7.h, u8.h, r1.h, r7.h
+		ALU1:	MAD  r8.l, u8.h, r1.h, r8.l
+		ALU2:	MAD  r8.h, u8.h, r1.h, r8.h
+		ALU3:	MAD  r9.h, r1.h, r7.l, r9.h
+
+	ALU:
+		ALU0:	MAD  r7.h, u9.l, r2.l, r7.h
+		ALU1:	MAD  r8.l, u9.l, r2.h, r8.l
+		ALU2:	MAD  r8.h, u9.l, r3.l, r8.h
+		ALU3:	MAD  r5.h, r0.l, r5.h, #0
+
+	ALU:
+		ALU0:	MAD  r7.h, u9.h, r3.h, r7.h
+		ALU1:	MAD  r8.l, u9.h, r3.h, r8.l
+		ALU2:	MAD  r8.h, u9.h, r3.h, r8.h
+		ALU3:	MAD  r6.l, r0.h, r6.l, #0
+;
+
+EXEC
+	ALU:
+		ALU0:	MAD  r7.h, u10.l, r5.l, r7.h
+		ALU1:	MAD  r8.l, u10.l, r5.l, r8.l
+		ALU2:	MAD  r8.h, u10.l, r5.l, r8.h
+		ALU3:	MAD  r6.h, r1.l, r6.h, #0
+
+#ifdef MIN_MAX
+	ALU:
+		ALU0:	MIN  r10.l, r0.l, r2.l, #0
+		ALU1:	MIN  r10.h, r0.h, r2.h, #0
+		ALU2:	MIN  r11.l, r1.l, r3.l, #0
+		ALU3:	MIN  r11.h, r1.h, r3.h, #0
+
+	ALU:
+		ALU0:	MAX  r12.l, r0.l, r2.l, #0
+		ALU1:	MAX  r12.h, r0.h, r2.h, #0
+		ALU2:	MAX  r13.l, r1.l, r3.l, #0
+		ALU3:	MAX  r13.h, r1.h, r3.h, #0
+;
+
+EXEC
+	ALU:
+		ALU0:	MAD  r0.l, r2.l, r7.h, r5.h
+		ALU1:	MAD  r0.h, r2.h, r8.l, r6.l
+		ALU2:	MAD  r1.l, r3.l, r8.h, r6.h
+		ALU3:	MAD  r1.h, r9.h, #1, #0
+
+	ALU:
+		ALU0:	MAD  r0.l, r10.l, u12.l, r0.l
+		ALU1:	MAD  r0.h, r10.h, u12.l, r0.h
+		ALU2:	MAD  r1.l, r11.l, u12.l, r1.l
+		ALU3:	MAD  r1.h, r11.h, u13.l, r1.h
+
+	ALU:
+		ALU0:	MAD  r0.l, r12.l, u12.h, r0.l (sat)
+		ALU1:	MAD  r0.h, r12.h, u12.h, r0.h (sat)
+		ALU2:	MAD  r1.l, r13.l, u12.h, r1.l (sat)
+		ALU3:	MAD  r1.h, r13.h, u13.h, r1.h (sat)
+#else
+	ALU:
+		ALU0:	MAD  r0.l, r2.l, r7.h, r5.h (sat)
+		ALU1:	MAD  r0.h, r2.h, r8.l, r6.l (sat)
+		ALU2:	MAD  r1.l, r3.l, r8.h, r6.h (sat)
+		ALU3:	MAD  r1.h, r9.h, #1, #0 (sat)
+#endif
+
+	DW:	store rt1, r0, r1
+;
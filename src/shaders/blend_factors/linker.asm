@@ -0,0 +1,6 @@
+#ifdef MODULATE
+LINK fx10.l, fx10.h, fx10.l, fx10.h, tram0.xxyy, export1
+LINK fp20,   fp20,   NOP,    NOP,    tram1.xyzw, export2
+#else
+LINK fp20,   fp20,   NOP,    NOP,    tram0.xyzw, export1
+#endif
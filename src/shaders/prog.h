@@ -43,4 +43,31 @@ struct shader_program {
     unsigned used_tram_rows_nb;
 };
 
+/*
+ * Programs assembled from a parameterized source (see the 'variants'
+ * file of a shader directory) are keyed by the names that were defined
+ * for them.
+ */
+#define SHADER_VARIANT_MODULATE     (1 << 0)
+#define SHADER_VARIANT_MIN_MAX      (1 << 1)
+
+struct shader_program_variant {
+    uint32_t key;
+    struct shader_program *prog;
+};
+
+static inline struct shader_program *
+shader_program_lookup(struct shader_program_variant *variants,
+                      unsigned variants_nb, uint32_t key)
+{
+    unsigned i;
+
+    for (i = 0; i < variants_nb; i++) {
+        if (variants[i].key == key)
+            return variants[i].prog;
+    }
+
+    return NULL;
+}
+
 #endif
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) Dmitry Osipenko 2018
+ * Copyright (c) Dmitry Osipenko
  *
  * Permission is hereby granted, free of charge, to any person obtaining a
  * copy of this software and associated documentation files (the "Software"),
@@ -26,21 +26,13 @@ alu_buffer_size = 1	// number of .rgba regs carried through pipeline
 .asm
 
 EXEC
-	// fetch dst pixel to r2,r3
-	PSEQ:	0x0081000A
-
 	MFU:	sfu:  rcp r4
 		mul0: bar, sfu, bar0
 		mul1: bar, sfu, bar1
 		ipl:  t0.fp20, t0.fp20, NOP, NOP
 
-	// sample tex1 (mask)
+	// sample tex0 (src)
 	TEX:	tex r0, r1, tex0, r0, r1, r2
 
-	ALU:
-		ALU0:	MAD  r0.l, r1.h-1, -r2.l, r0.l
-		ALU1:	MAD  r0.h, r1.h-1, -r2.h, r0.h
-		ALU2:	MAD  r1.l, r1.h-1, -r3.l, r1.l
-
 	DW:	store rt1, r0, r1
 ;
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) Dmitry Osipenko
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+pseq_to_dw_exec_nb = 4	// the number of 'EXEC' block where DW happens
+alu_buffer_size = 2	// number of .rgba regs carried through pipeline
+
+/*
+ * YV12 to RGB conversion, Y/U/V planes are sampled from tex0/tex1/tex2.
+ *
+ *   R = offR + kY * Y + 2 * (kUr * U + kVr * V)
+ *   G = offG + kY * Y + 2 * (kUg * U + kVg * V)
+ *   B = offB + kY * Y + 2 * (kUb * U + kVb * V)
+ *
+ * Chroma coefficients are halved to fit the fx10 range:
+ *
+ *   [0].l = kY     [0].h = offR   [1].l = offG   [1].h = offB
+ *   [2].l = kUr    [2].h = kUg    [3].l = kUb
+ *   [3].h = kVr    [4].l = kVg    [4].h = kVb
+ *
+ * r5.l = Y, r5.h = U, r6.l = V
+ */
+
+.asm
+
+EXEC
+	MFU:	sfu:  rcp r4
+		mul0: bar, sfu, bar0
+		mul1: bar, sfu, bar1
+		ipl:  t0.fp20, t0.fp20, NOP, NOP
+
+	// sample tex0 (luma)
+	TEX:	tex r0, r1, tex0, r0, r1, r2
+
+	ALU:
+		ALU0:	MAD  r5.l, r0.l, #1, #0
+;
+
+EXEC
+	MFU:	sfu:  rcp r4
+		mul0: bar, sfu, bar0
+		mul1: bar, sfu, bar1
+		ipl:  t1.fp20, t1.fp20, NOP, NOP
+
+	// sample tex1 (chroma blue)
+	TEX:	tex r0, r1, tex1, r0, r1, r2
+
+	ALU:
+		ALU0:	MAD  r5.h, r0.l, #1, #0
+;
+
+EXEC
+	MFU:	sfu:  rcp r4
+		mul0: bar, sfu, bar0
+		mul1: bar, sfu, bar1
+		ipl:  t1.fp20, t1.fp20, NOP, NOP
+
+	// sample tex2 (chroma red)
+	TEX:	tex r0, r1, tex2, r0, r1, r2
+
+	ALU:
+		ALU0:	MAD  r2.l, u0.l, r5.l, u0.h
+		ALU1:	MAD  r2.h, u0.l, r5.l, u1.l
+		ALU2:	MAD  r3.l, u0.l, r5.l, u1.h
+		ALU3:	MAD  r6.l, r0.l, #1, #0
+
+	ALU:
+		ALU0:	MAD  r2.l, u2.l, r5.h, r2.l
+		ALU1:	MAD  r2.h, u2.h, r5.h, r2.h
+		ALU2:	MAD  r3.l, u3.l, r5.h, r3.l
+
+	ALU:
+		ALU0:	MAD  r2.l, u2.l, r5.h, r2.l
+		ALU1:	MAD  r2.h, u2.h, r5.h, r2.h
+		ALU2:	MAD  r3.l, u3.l, r5.h, r3.l
+;
+
+EXEC
+	ALU:
+		ALU0:	MAD  r2.l, u3.h, r6.l, r2.l
+		ALU1:	MAD  r2.h, u4.l, r6.l, r2.h
+		ALU2:	MAD  r3.l, u4.h, r6.l, r3.l
+
+	ALU:
+		ALU0:	MAD  r0.l, u3.h, r6.l, r2.l (sat)
+		ALU1:	MAD  r0.h, u4.l, r6.l, r2.h (sat)
+		ALU2:	MAD  r1.l, u4.h, r6.l, r3.l (sat)
+		ALU3:	MAD  r1.h, #0, #0, #1
+
+	DW:	store rt1, r0, r1
+;
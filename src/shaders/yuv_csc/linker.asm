@@ -0,0 +1,2 @@
+LINK fp20,   fp20,   NOP,    NOP,    tram0.xyzw, export1
+LINK fp20,   fp20,   NOP,    NOP,    tram1.xyzw, export2
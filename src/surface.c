@@ -86,6 +86,9 @@ int map_surface_data(tegra_surface *surf)
 
     pthread_mutex_lock(&surf->lock);
 
+    /* CPU access has to wait for the engines */
+    host1x_pixelbuffer_sync(surf->pixbuf);
+
     if (surf->map_cnt++) {
         goto out_unlock;
     }
@@ -379,6 +382,9 @@ static int __alloc_surface_data(tegra_surface *surf)
 
         size = ALIGN(width, 32) * ALIGN(height, 16) / 4;
 
+        /* aux buffer is accessed only by VDE */
+        bo_flags |= DRM_TEGRA_BO_GPU_ONLY;
+
         ret = drm_tegra_bo_new(&surf->aux_bo, dev->drm, bo_flags, ALIGN(size, 256));
         if (ret) {
             ErrorMsg("drm_tegra_bo_new failed %d (%s)\n",
@@ -551,6 +557,7 @@ tegra_surface *alloc_surface(tegra_device *dev,
 {
     struct tegra_vde_h264_frame *frame = NULL;
     pthread_mutexattr_t mutex_attrs;
+    pthread_condattr_t cond_attrs;
     tegra_surface *surf;
     int ret;
 
@@ -584,7 +591,10 @@ tegra_surface *alloc_surface(tegra_device *dev,
         goto err_cleanup;
     }
 
-    ret = pthread_cond_init(&surf->idle_cond, NULL);
+    pthread_condattr_init(&cond_attrs);
+    pthread_condattr_setclock(&cond_attrs, CLOCK_MONOTONIC);
+
+    ret = pthread_cond_init(&surf->idle_cond, &cond_attrs);
     if (ret != 0) {
         ErrorMsg("pthread_cond_init failed\n");
         goto err_cleanup;
@@ -608,8 +618,6 @@ tegra_surface *alloc_surface(tegra_device *dev,
         }
     }
 
-    tegra_stream_create(&surf->stream_3d, dev, dev->gr3d);
-    tegra_stream_create(&surf->stream_2d, dev, dev->gr2d);
     ref_device(dev);
 
     DebugMsg("surface %p output %d video %d\n", surf, output, video);
@@ -676,8 +684,6 @@ VdpStatus unref_surface(tegra_surface *surf)
     DebugMsg("surface %u %p\n", surf->surface_id, surf);
 
     dynamic_release_surface_data(surf);
-    tegra_stream_destroy(surf->stream_3d);
-    tegra_stream_destroy(surf->stream_2d);
     unref_device(surf->dev);
 
     set_surface(surf->surface_id, NULL);
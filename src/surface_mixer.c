@@ -489,6 +489,7 @@ VdpStatus vdp_video_mixer_render(
     tegra_surface *video_surf = get_surface_video(video_surface_current);
     tegra_mixer *mix = get_mixer(mixer);
     tegra_shared_surface *shared = NULL;
+    struct tegra_stream *stream;
     uint32_t src_vid_width, src_vid_height, src_vid_x0, src_vid_y0;
     uint32_t dst_vid_width, dst_vid_height, dst_vid_x0, dst_vid_y0;
     uint32_t bg_width, bg_height, bg_x0, bg_y0;
@@ -598,7 +599,8 @@ VdpStatus vdp_video_mixer_render(
                 return VDP_STATUS_RESOURCES;
             }
 
-            ret = host1x_gr2d_clear_rect_clipped(dest_surf->stream_2d,
+            stream = tegra_stream_pool_get(dest_surf->dev, dest_surf->dev->gr2d);
+            ret = host1x_gr2d_clear_rect_clipped(stream,
                                                  dest_surf->pixbuf,
                                                  bg_color,
                                                  bg_x0,
@@ -610,6 +612,7 @@ VdpStatus vdp_video_mixer_render(
                                                  dst_vid_x0 + dst_vid_width,
                                                  dst_vid_y0 + dst_vid_height,
                                                  true);
+            tegra_stream_pool_put(dest_surf->dev, stream);
             if (ret) {
                 ErrorMsg("setting BG failed %d\n", ret);
             }
@@ -633,7 +636,8 @@ VdpStatus vdp_video_mixer_render(
             return VDP_STATUS_RESOURCES;
         }
 
-        ret = host1x_gr2d_surface_blit(dest_surf->stream_2d,
+        stream = tegra_stream_pool_get(dest_surf->dev, dest_surf->dev->gr2d);
+        ret = host1x_gr2d_surface_blit(stream,
                                        bg_surf->pixbuf,
                                        dest_surf->pixbuf,
                                        &csc_rgb_default,
@@ -645,6 +649,7 @@ VdpStatus vdp_video_mixer_render(
                                        0,
                                        dest_surf->width,
                                        dest_surf->height);
+        tegra_stream_pool_put(dest_surf->dev, stream);
         if (ret) {
             ErrorMsg("copying BG failed %d\n", ret);
         }
@@ -686,7 +691,8 @@ VdpStatus vdp_video_mixer_render(
                 return VDP_STATUS_RESOURCES;
             }
 
-            ret = host1x_gr2d_clear_rect_clipped(dest_surf->stream_2d,
+            stream = tegra_stream_pool_get(dest_surf->dev, dest_surf->dev->gr2d);
+            ret = host1x_gr2d_clear_rect_clipped(stream,
                                                  dest_surf->pixbuf,
                                                  bg_color,
                                                  bg_x0,
@@ -698,6 +704,7 @@ VdpStatus vdp_video_mixer_render(
                                                  dst_vid_x0 + dst_vid_width,
                                                  dst_vid_y0 + dst_vid_height,
                                                  true);
+            tegra_stream_pool_put(dest_surf->dev, stream);
             if (ret) {
                 ErrorMsg("setting BG failed %d\n", ret);
             }
@@ -707,7 +714,8 @@ VdpStatus vdp_video_mixer_render(
     }
 
     if (!shared) {
-        ret = host1x_gr2d_surface_blit(dest_surf->stream_2d,
+        stream = tegra_stream_pool_get(dest_surf->dev, dest_surf->dev->gr2d);
+        ret = host1x_gr2d_surface_blit(stream,
                                        video_surf->pixbuf,
                                        dest_surf->pixbuf,
                                        &mix->csc.gr2d,
@@ -719,6 +727,7 @@ VdpStatus vdp_video_mixer_render(
                                        dst_vid_y0,
                                        dst_vid_width,
                                        dst_vid_height);
+        tegra_stream_pool_put(dest_surf->dev, stream);
         if (ret) {
             ErrorMsg("video transfer failed %d\n", ret);
         }
@@ -19,7 +19,8 @@
 
 #include "vdpau_tegra.h"
 #include "shaders/blend_atop.bin.h"
-#include "shaders/blend_atop_solid_shade.bin.h"
+#include "shaders/blend_factors.bin.h"
+#include "shaders/texture_copy.bin.h"
 
 VdpStatus vdp_output_surface_query_capabilities(
                                             VdpDevice device,
@@ -211,6 +212,302 @@ VdpStatus vdp_output_surface_put_bits_y_cb_cr(
     return VDP_STATUS_NO_IMPLEMENTATION;
 }
 
+struct blend_factor_coefs {
+    float constant[4];
+    float src;
+    float src_alpha;
+    float dst;
+    float dst_alpha;
+    float saturate;
+};
+
+static bool blend_state_is_atop(VdpOutputSurfaceRenderBlendState const *bs)
+{
+    return (bs->blend_factor_source_color      == VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ONE &&
+            bs->blend_factor_destination_color == VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA &&
+            bs->blend_factor_source_alpha      == VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ZERO &&
+            bs->blend_factor_destination_alpha == VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ZERO &&
+            bs->blend_equation_color           == VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_ADD &&
+            bs->blend_equation_alpha           == VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_ADD);
+}
+
+static bool blend_equation_is_min_max(VdpOutputSurfaceRenderBlendEquation eq)
+{
+    return (eq == VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_MIN ||
+            eq == VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_MAX);
+}
+
+static VdpStatus check_blend_state(VdpOutputSurfaceRenderBlendState const *bs)
+{
+    if (bs->blend_factor_source_color      > VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ONE_MINUS_CONSTANT_ALPHA ||
+        bs->blend_factor_destination_color > VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ONE_MINUS_CONSTANT_ALPHA ||
+        bs->blend_factor_source_alpha      > VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ONE_MINUS_CONSTANT_ALPHA ||
+        bs->blend_factor_destination_alpha > VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ONE_MINUS_CONSTANT_ALPHA)
+    {
+        return VDP_STATUS_INVALID_BLEND_FACTOR;
+    }
+
+    if (bs->blend_equation_color > VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_MAX ||
+        bs->blend_equation_alpha > VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_MAX)
+    {
+        return VDP_STATUS_INVALID_BLEND_EQUATION;
+    }
+
+    return VDP_STATUS_OK;
+}
+
+/*
+ * Blend factor is evaluated by shader as a linear combination of the
+ * source / destination components, see shaders/blend_factors/fragment.asm.
+ * In case of the alpha factor, color and alpha terms are equal.
+ */
+static void blend_factor_to_coefs(VdpOutputSurfaceRenderBlendFactor factor,
+                                  VdpColor const *c, bool alpha,
+                                  struct blend_factor_coefs *coefs)
+{
+    float k[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    unsigned i;
+
+    memset(coefs, 0, sizeof(*coefs));
+
+    switch (factor) {
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ZERO:
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ONE:
+        k[0] = k[1] = k[2] = k[3] = 1.0f;
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_SRC_COLOR:
+        if (alpha) {
+            coefs->src_alpha = 1.0f;
+        } else {
+            coefs->src = 1.0f;
+        }
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ONE_MINUS_SRC_COLOR:
+        k[0] = k[1] = k[2] = k[3] = 1.0f;
+
+        if (alpha) {
+            coefs->src_alpha = -1.0f;
+        } else {
+            coefs->src = -1.0f;
+        }
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_SRC_ALPHA:
+        coefs->src_alpha = 1.0f;
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA:
+        k[0] = k[1] = k[2] = k[3] = 1.0f;
+        coefs->src_alpha = -1.0f;
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_DST_ALPHA:
+        coefs->dst_alpha = 1.0f;
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ONE_MINUS_DST_ALPHA:
+        k[0] = k[1] = k[2] = k[3] = 1.0f;
+        coefs->dst_alpha = -1.0f;
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_DST_COLOR:
+        if (alpha) {
+            coefs->dst_alpha = 1.0f;
+        } else {
+            coefs->dst = 1.0f;
+        }
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ONE_MINUS_DST_COLOR:
+        k[0] = k[1] = k[2] = k[3] = 1.0f;
+
+        if (alpha) {
+            coefs->dst_alpha = -1.0f;
+        } else {
+            coefs->dst = -1.0f;
+        }
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_SRC_ALPHA_SATURATE:
+        /* f = min(As, 1 - Ad) for color and 1 for alpha */
+        k[3] = 1.0f;
+        coefs->saturate = 1.0f;
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_CONSTANT_COLOR:
+        k[0] = c->red;
+        k[1] = c->green;
+        k[2] = c->blue;
+        k[3] = c->alpha;
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ONE_MINUS_CONSTANT_COLOR:
+        k[0] = 1.0f - c->red;
+        k[1] = 1.0f - c->green;
+        k[2] = 1.0f - c->blue;
+        k[3] = 1.0f - c->alpha;
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_CONSTANT_ALPHA:
+        k[0] = k[1] = k[2] = k[3] = c->alpha;
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ONE_MINUS_CONSTANT_ALPHA:
+        k[0] = k[1] = k[2] = k[3] = 1.0f - c->alpha;
+        break;
+    }
+
+    for (i = 0; i < 4; i++) {
+        coefs->constant[i] = k[i];
+    }
+}
+
+static void blend_factor_negate(struct blend_factor_coefs *coefs)
+{
+    unsigned i;
+
+    for (i = 0; i < 4; i++) {
+        coefs->constant[i] = -coefs->constant[i];
+    }
+
+    coefs->src       = -coefs->src;
+    coefs->src_alpha = -coefs->src_alpha;
+    coefs->dst       = -coefs->dst;
+    coefs->dst_alpha = -coefs->dst_alpha;
+    coefs->saturate  = -coefs->saturate;
+}
+
+static void blend_upload_factor(struct tegra_stream *stream, unsigned index,
+                                struct blend_factor_coefs const *color,
+                                struct blend_factor_coefs const *alpha)
+{
+    host1x_gr3d_upload_const_fp(stream, index + 0,
+                                FX10x2(color->constant[0],
+                                       color->constant[1]));
+    host1x_gr3d_upload_const_fp(stream, index + 1,
+                                FX10x2(color->constant[2],
+                                       alpha->constant[3]));
+    host1x_gr3d_upload_const_fp(stream, index + 2,
+                                FX10x2(color->src, color->src_alpha));
+    host1x_gr3d_upload_const_fp(stream, index + 3,
+                                FX10x2(color->dst, color->dst_alpha));
+    host1x_gr3d_upload_const_fp(stream, index + 4,
+                                FX10x2(color->saturate, alpha->src_alpha));
+    host1x_gr3d_upload_const_fp(stream, index + 5,
+                                FX10x2(alpha->dst_alpha, 0.0f));
+}
+
+static void blend_upload_state(struct tegra_stream *stream,
+                               VdpOutputSurfaceRenderBlendState const *bs,
+                               VdpColor const *constant)
+{
+    VdpOutputSurfaceRenderBlendEquation eq_color = bs->blend_equation_color;
+    VdpOutputSurfaceRenderBlendEquation eq_alpha = bs->blend_equation_alpha;
+    struct blend_factor_coefs src_color, dst_color;
+    struct blend_factor_coefs src_alpha, dst_alpha;
+
+    blend_factor_to_coefs(bs->blend_factor_source_color, constant,
+                          false, &src_color);
+    blend_factor_to_coefs(bs->blend_factor_destination_color, constant,
+                          false, &dst_color);
+    blend_factor_to_coefs(bs->blend_factor_source_alpha, constant,
+                          true, &src_alpha);
+    blend_factor_to_coefs(bs->blend_factor_destination_alpha, constant,
+                          true, &dst_alpha);
+
+    switch (eq_color) {
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_SUBTRACT:
+        blend_factor_negate(&dst_color);
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_REVERSE_SUBTRACT:
+        blend_factor_negate(&src_color);
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_MIN:
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_MAX:
+        /* factors are ignored by MIN / MAX equations */
+        memset(&src_color, 0, sizeof(src_color));
+        memset(&dst_color, 0, sizeof(dst_color));
+        break;
+    }
+
+    switch (eq_alpha) {
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_SUBTRACT:
+        blend_factor_negate(&dst_alpha);
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_REVERSE_SUBTRACT:
+        blend_factor_negate(&src_alpha);
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_MIN:
+    case VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_MAX:
+        memset(&src_alpha, 0, sizeof(src_alpha));
+        memset(&dst_alpha, 0, sizeof(dst_alpha));
+        break;
+    }
+
+    blend_upload_factor(stream, 0, &src_color, &src_alpha);
+    blend_upload_factor(stream, 6, &dst_color, &dst_alpha);
+
+    if (blend_equation_is_min_max(eq_color) ||
+        blend_equation_is_min_max(eq_alpha))
+    {
+        host1x_gr3d_upload_const_fp(stream, 12,
+            FX10x2(eq_color == VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_MIN,
+                   eq_color == VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_MAX));
+        host1x_gr3d_upload_const_fp(stream, 13,
+            FX10x2(eq_alpha == VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_MIN,
+                   eq_alpha == VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_MAX));
+    }
+}
+
+static struct shader_program *
+blend_program(VdpOutputSurfaceRenderBlendState const *bs, bool modulate)
+{
+    uint32_t key = 0;
+
+    if (!bs) {
+        return &prog_texture_copy;
+    }
+
+    if (modulate) {
+        key |= SHADER_VARIANT_MODULATE;
+    }
+
+    if (blend_state_is_atop(bs)) {
+        return shader_program_lookup(blend_atop_variants,
+                                     ARRAY_SIZE(blend_atop_variants), key);
+    }
+
+    if (blend_equation_is_min_max(bs->blend_equation_color) ||
+        blend_equation_is_min_max(bs->blend_equation_alpha))
+    {
+        key |= SHADER_VARIANT_MIN_MAX;
+    }
+
+    return shader_program_lookup(blend_factors_variants,
+                                 ARRAY_SIZE(blend_factors_variants), key);
+}
+
+static bool blend_surface_format_supported(VdpRGBAFormat format)
+{
+    return (format == VDP_RGBA_FORMAT_B8G8R8A8 ||
+            format == VDP_RGBA_FORMAT_R8G8B8A8);
+}
+
+static bool blend_surface_supported(tegra_surface *src_surf,
+                                    tegra_surface *dst_surf,
+                                    VdpColor const *colors,
+                                    VdpOutputSurfaceRenderBlendState const *bs)
+{
+    if (src_surf->rgba_format != dst_surf->rgba_format) {
+        return false;
+    }
+
+    if (!blend_surface_format_supported(src_surf->rgba_format)) {
+        return false;
+    }
+
+    /* all-white colors are dropped by blend_surface(), check both variants */
+    if (!blend_program(bs, false)) {
+        return false;
+    }
+
+    if (colors && !blend_program(bs, true)) {
+        return false;
+    }
+
+    return true;
+}
+
 static int blend_surface(tegra_device *dev,
                          tegra_surface *src_surf,
                          tegra_surface *dst_surf,
@@ -223,18 +520,25 @@ static int blend_surface(tegra_device *dev,
                          uint32_t dst_width,
                          uint32_t dst_height,
                          VdpColor const *colors,
+                         VdpOutputSurfaceRenderBlendState const *blend_state,
                          uint32_t flags)
 {
-    struct tegra_stream *stream = dst_surf->stream_3d;
+    struct tegra_stream *stream = NULL;
+    struct shader_program *prog;
     struct drm_tegra_bo *attribs_bo;
+    VdpColor constant = { 0.0f, 0.0f, 0.0f, 0.0f };
     __fp16 dst_left, dst_right, dst_top, dst_bottom;
     __fp16 src_left, src_right, src_top, src_bottom;
+    __fp16 src[4][2];
     __fp16 c[4][4];
     __fp16 tmp;
     __fp16 *map = NULL;
+    float ftmp;
     VdpTime time = 0;
     unsigned attrib_itr = 0;
     uint32_t bo_flags = 0;
+    unsigned rot;
+    bool scaled;
     unsigned i;
     int drm_ver;
     int err;
@@ -243,6 +547,13 @@ static int blend_surface(tegra_device *dev,
         time = get_time();
     }
 
+    if (blend_state) {
+        constant = blend_state->blend_constant;
+    } else {
+        /* plain copy ignores colors, like the GR2D blit does */
+        colors = NULL;
+    }
+
     dst_left   = (__fp16) (dst_x0     * 2) / dst_surf->width  - 1.0f;
     dst_right  = (__fp16) (dst_width  * 2) / dst_surf->width  + dst_left;
     dst_bottom = (__fp16) (dst_y0     * 2) / dst_surf->height - 1.0f;
@@ -253,6 +564,52 @@ static int blend_surface(tegra_device *dev,
     src_bottom = (__fp16) src_y0     / src_surf->height;
     src_top    = (__fp16) src_height / src_surf->height + src_bottom;
 
+    /*
+     * Source corners in the order of the destination corners that they
+     * map to without rotation: (left, bottom), (right, bottom),
+     * (right, top), (left, top). Rotation by 90 degrees clockwise moves
+     * every source corner to the next destination corner.
+     */
+    switch (flags & 3) {
+    case VDP_OUTPUT_SURFACE_RENDER_ROTATE_90:
+        rot = 3;
+        scaled = (dst_width != src_height || dst_height != src_width);
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_ROTATE_180:
+        rot = 2;
+        scaled = (dst_width != src_width || dst_height != src_height);
+        break;
+    case VDP_OUTPUT_SURFACE_RENDER_ROTATE_270:
+        rot = 1;
+        scaled = (dst_width != src_height || dst_height != src_width);
+        break;
+    default:
+        rot = 0;
+        scaled = (dst_width != src_width || dst_height != src_height);
+        break;
+    }
+
+    for (i = 0; i < 4; i++) {
+        switch ((i + rot) % 4) {
+        case 0:
+            src[i][0] = src_left;
+            src[i][1] = src_bottom;
+            break;
+        case 1:
+            src[i][0] = src_right;
+            src[i][1] = src_bottom;
+            break;
+        case 2:
+            src[i][0] = src_right;
+            src[i][1] = src_top;
+            break;
+        case 3:
+            src[i][0] = src_left;
+            src[i][1] = src_top;
+            break;
+        }
+    }
+
     if (colors) {
         if (flags & VDP_OUTPUT_SURFACE_RENDER_COLOR_PER_VERTEX) {
             for (i = 0; i < 4; i++) {
@@ -283,6 +640,11 @@ static int blend_surface(tegra_device *dev,
         }
     }
 
+    prog = blend_program(blend_state, colors != NULL);
+    if (!prog) {
+        return -EINVAL;
+    }
+
     switch (src_surf->rgba_format) {
     case VDP_RGBA_FORMAT_B8G8R8A8:
         for (i = 0; i < 4; i++) {
@@ -290,6 +652,10 @@ static int blend_surface(tegra_device *dev,
             c[i][0] = c[i][2];
             c[i][2] = tmp;
         }
+
+        ftmp = constant.red;
+        constant.red = constant.blue;
+        constant.blue = ftmp;
         break;
 
     case VDP_RGBA_FORMAT_R8G8B8A8:
@@ -332,31 +698,36 @@ static int blend_surface(tegra_device *dev,
     /* push first triangle of the quad to the attributes buffer */
     TegraPushVtxAttr2(dst_left, dst_bottom);
     TegraPushVtxAttr4(c[3][0], c[3][1], c[3][2], c[3][3]);
-    TegraPushVtxAttr2(src_left, src_bottom);
+    TegraPushVtxAttr2(src[0][0], src[0][1]);
 
     TegraPushVtxAttr2(dst_left, dst_top);
     TegraPushVtxAttr4(c[0][0], c[0][1], c[0][2], c[0][3]);
-    TegraPushVtxAttr2(src_left, src_top);
+    TegraPushVtxAttr2(src[3][0], src[3][1]);
 
     TegraPushVtxAttr2(dst_right, dst_top);
     TegraPushVtxAttr4(c[1][0], c[1][1], c[1][2], c[1][3]);
-    TegraPushVtxAttr2(src_right, src_top);
+    TegraPushVtxAttr2(src[2][0], src[2][1]);
 
     /* push second */
     TegraPushVtxAttr2(dst_right, dst_top);
     TegraPushVtxAttr4(c[1][0], c[1][1], c[1][2], c[1][3]);
-    TegraPushVtxAttr2(src_right, src_top);
+    TegraPushVtxAttr2(src[2][0], src[2][1]);
 
     TegraPushVtxAttr2(dst_right, dst_bottom);
     TegraPushVtxAttr4(c[2][0], c[2][1], c[2][2], c[2][3]);
-    TegraPushVtxAttr2(src_right, src_bottom);
+    TegraPushVtxAttr2(src[1][0], src[1][1]);
 
     TegraPushVtxAttr2(dst_left, dst_bottom);
     TegraPushVtxAttr4(c[3][0], c[3][1], c[3][2], c[3][3]);
-    TegraPushVtxAttr2(src_left, src_bottom);
+    TegraPushVtxAttr2(src[0][0], src[0][1]);
 
     drm_tegra_bo_unmap(attribs_bo);
 
+    host1x_pixelbuffer_depend(src_surf->pixbuf, false);
+    host1x_pixelbuffer_depend(dst_surf->pixbuf, false);
+
+    stream = tegra_stream_pool_get(dev, dev->gr3d);
+
     err = tegra_stream_begin(stream);
     if (err) {
         goto out_unref;
@@ -364,11 +735,7 @@ static int blend_surface(tegra_device *dev,
 
     tegra_stream_push_setclass(stream, HOST1X_CLASS_GR3D);
 
-    if (colors) {
-        host1x_gr3d_initialize(stream, &prog_blend_atop);
-    } else {
-        host1x_gr3d_initialize(stream, &prog_blend_atop_solid_shade);
-    }
+    host1x_gr3d_initialize(stream, prog);
 
     host1x_gr3d_setup_scissor(stream, 0, 0, dst_surf->width, dst_surf->height);
 
@@ -390,7 +757,7 @@ static int blend_surface(tegra_device *dev,
                                 2, 16);
 
     /* colors */
-    if (colors) {
+    if (prog->vs_attrs_in_mask & (1 << 1)) {
         host1x_gr3d_setup_attribute(stream, 1, attribs_bo,
                                     4, TGR3D_ATTRIB_TYPE_FLOAT16,
                                     4, 16);
@@ -407,11 +774,15 @@ static int blend_surface(tegra_device *dev,
                                    src_surf->width,
                                    src_surf->height,
                                    TGR3D_PIXEL_FORMAT_RGBA8888,
-                                   false, false, false,
+                                   scaled, false, scaled,
                                    true, false);
 
     host1x_gr3d_upload_const_vp(stream, 0, 0.0f, 0.0f, 0.0f, 1.0f);
 
+    if (blend_state && !blend_state_is_atop(blend_state)) {
+        blend_upload_state(stream, blend_state, &constant);
+    }
+
     host1x_gr3d_setup_draw_params(stream, TGR3D_PRIMITIVE_TYPE_TRIANGLES,
                                   TGR3D_INDEX_MODE_NONE, 0);
 
@@ -422,17 +793,14 @@ static int blend_surface(tegra_device *dev,
         goto out_unref;
     }
 
-    err = tegra_stream_flush(stream);
-    if (err) {
-        goto out_unref;
-    }
-
-    host1x_pixelbuffer_check_guard(dst_surf->pixbuf);
+    err = host1x_pixelbuffer_submit(stream, false,
+                                    src_surf->pixbuf, dst_surf->pixbuf);
 
 out_unref:
+    tegra_stream_pool_put(dev, stream);
     drm_tegra_bo_unref(attribs_bo);
 
-    DebugMsg("waited for %llu usec\n", (get_time() - time) / 1000);
+    DebugMsg("submitted in %llu usec\n", (get_time() - time) / 1000);
 
     return err;
 }
@@ -447,6 +815,7 @@ static VdpStatus surface_render_bitmap_surface(
                             uint32_t flags)
 {
     tegra_shared_surface *shared;
+    struct tegra_stream *stream;
     enum host1x_2d_rotate rotate;
     pixman_image_t *src_pix_region = NULL;
     pixman_image_t *src_pix;
@@ -461,8 +830,10 @@ static VdpStatus surface_render_bitmap_surface(
     int16_t dst_x0, dst_y0;
     uint32_t clear_color = 0xFFFFFFFF;
     bool hw_rotate = false;
+    bool gr3d_render;
     int need_scale = 0;
     int need_rotate = 0;
+    VdpStatus status;
     int ret;
 
     if (source_rect != NULL) {
@@ -526,18 +897,18 @@ static VdpStatus surface_render_bitmap_surface(
 
         if (need_rotate && !blend_state) {
             if (shared) {
-                ret = rotate_surface_gr2d(shared->video,
-                                          dst_surf,
-                                          &shared->csc.gr2d,
-                                          rotate,
-                                          0, 0,
-                                          shared->src_width,
-                                          shared->src_height,
-                                          dst_x0,
-                                          dst_y0,
-                                          dst_width,
-                                          dst_height,
-                                          true);
+                ret = rotate_video_surface(shared->video,
+                                           dst_surf,
+                                           &shared->csc.gr2d,
+                                           rotate,
+                                           0, 0,
+                                           shared->src_width,
+                                           shared->src_height,
+                                           dst_x0,
+                                           dst_y0,
+                                           dst_width,
+                                           dst_height,
+                                           true);
 
                 if (src_x0 == shared->dst_x0 &&
                     src_y0 == shared->dst_y0 &&
@@ -594,11 +965,13 @@ out_1:
     }
 
     if (src_surf == NULL) {
-        ret = host1x_gr2d_clear_rect(dst_surf->stream_2d,
+        stream = tegra_stream_pool_get(dst_surf->dev, dst_surf->dev->gr2d);
+        ret = host1x_gr2d_clear_rect(stream,
                                      dst_surf->pixbuf,
                                      clear_color,
                                      dst_x0, dst_y0,
                                      dst_width, dst_height);
+        tegra_stream_pool_put(dst_surf->dev, stream);
 
         if (ret == 0) {
             pthread_mutex_unlock(&dst_surf->lock);
@@ -651,6 +1024,14 @@ out_1:
             put_surface(src_surf);
             return VDP_STATUS_INVALID_STRUCT_VERSION;
         }
+
+        status = check_blend_state(blend_state);
+        if (status != VDP_STATUS_OK) {
+            pthread_mutex_unlock(&dst_surf->lock);
+            put_surface(dst_surf);
+            put_surface(src_surf);
+            return status;
+        }
     }
 
     DebugMsg("src_width %u src_height %u src_x0 %u src_y0 %u dst_width %u dst_height %u dst_x0 %u dst_y0 %u\n",
@@ -670,16 +1051,17 @@ out_1:
         break;
     }
 
-    if (!need_rotate || hw_rotate) {
-        if (src_surf->rgba_format == dst_surf->rgba_format &&
-            blend_state &&
-            blend_state->blend_factor_source_color      == VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ONE &&
-            blend_state->blend_factor_destination_color == VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA &&
-            blend_state->blend_factor_source_alpha      == VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ZERO &&
-            blend_state->blend_factor_destination_alpha == VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ZERO &&
-            blend_state->blend_equation_color           == VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_ADD &&
-            blend_state->blend_equation_alpha           == VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_ADD)
-        {
+    /*
+     * Blending, as well as rotation that GR2D couldn't handle, is done
+     * by GR3D which also takes care of scaling with bilinear filtering.
+     * Whatever GR3D can't handle falls back to pixman.
+     */
+    gr3d_render = ((blend_state || (need_rotate && !hw_rotate)) &&
+                   blend_surface_supported(src_surf, dst_surf,
+                                           colors, blend_state));
+
+    if (gr3d_render || (!blend_state && (!need_rotate || hw_rotate))) {
+        if (gr3d_render) {
             ret = shared_surface_transfer_video(src_surf);
             if (ret) {
                 pthread_mutex_unlock(&dst_surf->lock);
@@ -691,25 +1073,25 @@ out_1:
             ret = blend_surface(dst_surf->dev, src_surf, dst_surf,
                                 src_x0, src_y0, src_width, src_height,
                                 dst_x0, dst_y0, dst_width, dst_height,
-                                colors, flags);
+                                colors, blend_state, flags);
         } else {
             if (hw_rotate) {
                 pthread_mutex_lock(&src_surf->lock);
 
                 shared = shared_surface_get(src_surf);
                 if (shared) {
-                    ret = rotate_surface_gr2d(shared->video,
-                                              dst_surf,
-                                              &shared->csc.gr2d,
-                                              rotate,
-                                              0, 0,
-                                              shared->src_width,
-                                              shared->src_height,
-                                              dst_x0,
-                                              dst_y0,
-                                              dst_width,
-                                              dst_height,
-                                              false);
+                    ret = rotate_video_surface(shared->video,
+                                               dst_surf,
+                                               &shared->csc.gr2d,
+                                               rotate,
+                                               0, 0,
+                                               shared->src_width,
+                                               shared->src_height,
+                                               dst_x0,
+                                               dst_y0,
+                                               dst_width,
+                                               dst_height,
+                                               false);
                 } else {
                     ErrorMsg("shared surface disappeared unexpectedly\n");
                     ret = -EINVAL;
@@ -721,7 +1103,8 @@ out_1:
                     unref_shared_surface(shared);
                 }
             } else {
-                ret = host1x_gr2d_surface_blit(dst_surf->stream_2d,
+                stream = tegra_stream_pool_get(dst_surf->dev, dst_surf->dev->gr2d);
+                ret = host1x_gr2d_surface_blit(stream,
                                                src_surf->pixbuf,
                                                dst_surf->pixbuf,
                                                &csc_rgb_default,
@@ -729,6 +1112,7 @@ out_1:
                                                src_width, src_height,
                                                dst_x0, dst_y0,
                                                dst_width, dst_height);
+                tegra_stream_pool_put(dst_surf->dev, stream);
             }
         }
 
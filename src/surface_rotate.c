@@ -18,23 +18,446 @@
  */
 
 #include "vdpau_tegra.h"
+#include "shaders/yuv_csc.bin.h"
 
-int rotate_surface_gr2d(tegra_surface *src_surf,
-                        tegra_surface *dst_surf,
-                        struct host1x_csc_params *csc,
-                        enum host1x_2d_rotate rotate,
-                        unsigned int sx, unsigned int sy,
-                        unsigned int src_width, int src_height,
-                        unsigned int dx, unsigned int dy,
-                        unsigned int dst_width, int dst_height,
-                        bool check_only)
+#define SCRATCH_EXPIRE_NSEC     (5 * NSEC_PER_SEC)
+#define SCRATCH_POOL_MAX        4
+
+/*
+ * Intermediate buffers of the two-pass rotation are kept around for the
+ * next frame, a rotated display needs them for every frame. The fence of
+ * the last job that used a buffer is held until the buffer is reused.
+ */
+struct scratch_pixbuf {
+    struct list_head entry;
+    struct host1x_pixelbuffer *pixbuf;
+    struct tegra_fence *fence;
+    VdpTime last_use;
+};
+
+static void scratch_pixbuf_free(struct scratch_pixbuf *scratch)
+{
+    tegra_stream_wait_fence(scratch->fence);
+    tegra_stream_put_fence(scratch->fence);
+    host1x_pixelbuffer_free(scratch->pixbuf);
+    free(scratch);
+}
+
+void tegra_scratch_pool_init(tegra_device *dev)
+{
+    struct tegra_scratch_pool *pool = &dev->scratch_pool;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    LIST_INITHEAD(&pool->list);
+    pool->count = 0;
+}
+
+void tegra_scratch_pool_release(tegra_device *dev)
+{
+    struct tegra_scratch_pool *pool = &dev->scratch_pool;
+    struct scratch_pixbuf *scratch, *tmp;
+
+    pthread_mutex_lock(&pool->lock);
+
+    LIST_FOR_EACH_ENTRY_SAFE(scratch, tmp, &pool->list, entry) {
+        LIST_DEL(&scratch->entry);
+        scratch_pixbuf_free(scratch);
+    }
+
+    pool->count = 0;
+
+    pthread_mutex_unlock(&pool->lock);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+/*
+ * Moves buffers that weren't used for a while, or exceed the pool size,
+ * to the given list. Freeing may block on a fence, hence it's done by
+ * caller after releasing the pool lock.
+ */
+static void scratch_pool_expire_locked(struct tegra_scratch_pool *pool,
+                                       struct list_head *expired,
+                                       VdpTime now, unsigned int max)
+{
+    struct scratch_pixbuf *old, *tmp;
+
+    /* least recently used buffers are at the tail */
+    LIST_FOR_EACH_ENTRY_SAFE_REV(old, tmp, &pool->list, entry) {
+        if (pool->count <= max && now - old->last_use < SCRATCH_EXPIRE_NSEC)
+            break;
+
+        LIST_DEL(&old->entry);
+        LIST_ADDTAIL(&old->entry, expired);
+        pool->count--;
+    }
+}
+
+static void scratch_pool_free_list(struct list_head *expired)
+{
+    struct scratch_pixbuf *old, *tmp;
+
+    LIST_FOR_EACH_ENTRY_SAFE(old, tmp, expired, entry) {
+        LIST_DEL(&old->entry);
+        scratch_pixbuf_free(old);
+    }
+}
+
+void tegra_scratch_pool_expire(tegra_device *dev)
+{
+    struct tegra_scratch_pool *pool = &dev->scratch_pool;
+    struct list_head expired;
+
+    LIST_INITHEAD(&expired);
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count)
+        scratch_pool_expire_locked(pool, &expired, get_time(),
+                                   SCRATCH_POOL_MAX);
+    pthread_mutex_unlock(&pool->lock);
+
+    scratch_pool_free_list(&expired);
+}
+
+static struct scratch_pixbuf *
+scratch_pixbuf_get(tegra_device *dev, unsigned width, unsigned height,
+                   enum pixel_format format)
+{
+    struct tegra_scratch_pool *pool = &dev->scratch_pool;
+    struct scratch_pixbuf *scratch, *found = NULL;
+    struct list_head expired;
+
+    LIST_INITHEAD(&expired);
+
+    pthread_mutex_lock(&pool->lock);
+
+    scratch_pool_expire_locked(pool, &expired, get_time(), SCRATCH_POOL_MAX);
+
+    LIST_FOR_EACH_ENTRY(scratch, &pool->list, entry) {
+        if (scratch->pixbuf->width == width &&
+            scratch->pixbuf->height == height &&
+            scratch->pixbuf->format == format)
+        {
+            LIST_DEL(&scratch->entry);
+            pool->count--;
+            found = scratch;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    scratch_pool_free_list(&expired);
+
+    if (found) {
+        tegra_stream_wait_fence(found->fence);
+        tegra_stream_put_fence(found->fence);
+        found->fence = NULL;
+
+        return found;
+    }
+
+    scratch = calloc(1, sizeof(*scratch));
+    if (!scratch)
+        return NULL;
+
+    scratch->pixbuf = host1x_pixelbuffer_create(dev->drm,
+                                                width, height,
+                                                width * 4, 0,
+                                                format,
+                                                PIX_BUF_LAYOUT_LINEAR);
+    if (!scratch->pixbuf) {
+        free(scratch);
+        return NULL;
+    }
+
+    DebugMsg("allocated %ux%u format %d\n", width, height, format);
+
+    return scratch;
+}
+
+static void scratch_pixbuf_put(tegra_device *dev,
+                               struct scratch_pixbuf *scratch,
+                               struct tegra_stream *stream)
+{
+    struct tegra_scratch_pool *pool = &dev->scratch_pool;
+    struct list_head expired;
+
+    LIST_INITHEAD(&expired);
+
+    scratch->fence = tegra_stream_get_last_fence(stream);
+    scratch->last_use = get_time();
+
+    pthread_mutex_lock(&pool->lock);
+
+    /* make room for the returned buffer */
+    scratch_pool_expire_locked(pool, &expired, scratch->last_use,
+                               SCRATCH_POOL_MAX - 1);
+
+    LIST_ADD(&scratch->entry, &pool->list);
+    pool->count++;
+
+    pthread_mutex_unlock(&pool->lock);
+
+    scratch_pool_free_list(&expired);
+}
+
+static float csc_fixed_to_float(uint32_t val, unsigned int sign_bit)
+{
+    float f = (val & ((1u << sign_bit) - 1)) / 128.0f;
+
+    return (val & (1u << sign_bit)) ? -f : f;
+}
+
+/*
+ * Converts YV12 to RGB, scales and rotates in a single GR3D pass. Chroma
+ * planes are always sampled bilinearly, luma only when scaling.
+ */
+static int rotate_surface_gr3d(tegra_surface *src_surf,
+                               tegra_surface *dst_surf,
+                               struct host1x_csc_params *csc,
+                               enum host1x_2d_rotate rotate,
+                               unsigned int sx, unsigned int sy,
+                               unsigned int src_width, int src_height,
+                               unsigned int dx, unsigned int dy,
+                               unsigned int dst_width, int dst_height)
+{
+    struct tegra_stream *stream;
+    struct host1x_pixelbuffer *src = src_surf->pixbuf;
+    struct host1x_pixelbuffer *dst = dst_surf->pixbuf;
+    struct drm_tegra_bo *attribs_bo;
+    __fp16 dst_left, dst_right, dst_top, dst_bottom;
+    __fp16 luma[4][2], chroma[4][2];
+    __fp16 *map = NULL;
+    float ky, yos, off[3], ku[3], kv[3], ftmp;
+    unsigned chroma_height = ALIGN(src->height, 2) / 2;
+    unsigned attrib_itr = 0;
+    unsigned x, y, rot, i;
+    uint32_t bo_flags = 0;
+    bool scaled;
+    int drm_ver;
+    int err;
+
+    if (src->format != PIX_BUF_FMT_YV12 ||
+        src->layout != PIX_BUF_LAYOUT_LINEAR)
+        return -EINVAL;
+
+    switch (rotate) {
+    case ROT_90:
+        rot = 1;
+        scaled = (dst_width != src_height || dst_height != src_width);
+        break;
+
+    case ROT_180:
+        rot = 2;
+        scaled = (dst_width != src_width || dst_height != src_height);
+        break;
+
+    case ROT_270:
+        rot = 3;
+        scaled = (dst_width != src_height || dst_height != src_width);
+        break;
+
+    default:
+        return -EINVAL;
+    }
+
+    /* Y' = Y + yos, X = cyx * Y' + cuX * (U - 0.5) + cvX * (V - 0.5) */
+    ky    = csc_fixed_to_float(csc->cyx, 8);
+    yos   = (int8_t) csc->yos / 255.0f;
+    ku[0] = csc_fixed_to_float(csc->cur, 9);
+    ku[1] = csc_fixed_to_float(csc->cug, 8);
+    ku[2] = csc_fixed_to_float(csc->cub, 9);
+    kv[0] = csc_fixed_to_float(csc->cvr, 9);
+    kv[1] = csc_fixed_to_float(csc->cvg, 8);
+    kv[2] = csc_fixed_to_float(csc->cvb, 9);
+
+    if (dst_surf->rgba_format == VDP_RGBA_FORMAT_B8G8R8A8) {
+        ftmp = ku[0];
+        ku[0] = ku[2];
+        ku[2] = ftmp;
+
+        ftmp = kv[0];
+        kv[0] = kv[2];
+        kv[2] = ftmp;
+    }
+
+    for (i = 0; i < 3; i++)
+        off[i] = ky * yos - (ku[i] + kv[i]) * 128.0f / 255.0f;
+
+    dst_left   = (__fp16) (dx         * 2) / dst->width  - 1.0f;
+    dst_right  = (__fp16) (dst_width  * 2) / dst->width  + dst_left;
+    dst_bottom = (__fp16) (dy         * 2) / dst->height - 1.0f;
+    dst_top    = (__fp16) (dst_height * 2) / dst->height + dst_bottom;
+
+    /*
+     * Destination corners are (left, bottom), (right, bottom), (right, top)
+     * and (left, top). Every rotation step by 90 degrees clockwise moves
+     * the source corner to the next destination corner.
+     */
+    for (i = 0; i < 4; i++) {
+        switch ((i + rot) % 4) {
+        case 0:
+            x = sx;
+            y = sy;
+            break;
+        case 1:
+            x = sx + src_width;
+            y = sy;
+            break;
+        case 2:
+            x = sx + src_width;
+            y = sy + src_height;
+            break;
+        default:
+            x = sx;
+            y = sy + src_height;
+            break;
+        }
+
+        luma[i][0]   = (__fp16) x / src->pitch;
+        luma[i][1]   = (__fp16) y / src->height;
+        chroma[i][0] = (__fp16) x / 2 / src->pitch_uv;
+        chroma[i][1] = (__fp16) y / 2 / chroma_height;
+    }
+
+    drm_ver = drm_tegra_version(dst_surf->dev->drm);
+
+    if (drm_ver >= GRATE_KERNEL_DRM_VERSION)
+        bo_flags |= DRM_TEGRA_GEM_CREATE_DONT_KMAP;
+
+    if (drm_ver >= GRATE_KERNEL_DRM_VERSION + 1) {
+        /* version 0 is bugged, enable this feature only for 1+ */
+        bo_flags |= DRM_TEGRA_GEM_CREATE_SPARSE;
+    }
+
+    err = drm_tegra_bo_new(&attribs_bo, dst_surf->dev->drm, bo_flags, 4096);
+    if (err)
+        return err;
+
+    err = drm_tegra_bo_map(attribs_bo, (void**)&map);
+    if (err)
+        goto out_unref;
+
+#define TegraPushVtx(x, y, n)               \
+    map[attrib_itr++] = x;                  \
+    map[attrib_itr++] = y;                  \
+    map[attrib_itr++] = luma[n][0];         \
+    map[attrib_itr++] = luma[n][1];         \
+    map[attrib_itr++] = chroma[n][0];       \
+    map[attrib_itr++] = chroma[n][1];
+
+    /* first triangle of the quad */
+    TegraPushVtx(dst_left,  dst_bottom, 0);
+    TegraPushVtx(dst_left,  dst_top,    3);
+    TegraPushVtx(dst_right, dst_top,    2);
+
+    /* second */
+    TegraPushVtx(dst_right, dst_top,    2);
+    TegraPushVtx(dst_right, dst_bottom, 1);
+    TegraPushVtx(dst_left,  dst_bottom, 0);
+
+#undef TegraPushVtx
+
+    drm_tegra_bo_unmap(attribs_bo);
+
+    host1x_pixelbuffer_depend(src, false);
+    host1x_pixelbuffer_depend(dst, false);
+
+    stream = tegra_stream_pool_get(dst_surf->dev, dst_surf->dev->gr3d);
+
+    err = tegra_stream_begin(stream);
+    if (err)
+        goto out_put;
+
+    tegra_stream_push_setclass(stream, HOST1X_CLASS_GR3D);
+
+    host1x_gr3d_initialize(stream, &prog_yuv_csc);
+
+    host1x_gr3d_setup_scissor(stream, 0, 0, dst->width, dst->height);
+
+    host1x_gr3d_setup_viewport_bias_scale(stream, 0.0f, 0.0f, 0.5f,
+                                          dst->width, dst->height, 0.5f);
+
+    host1x_gr3d_setup_render_target(stream, 1, dst->bo, dst->bo_offset,
+                                    TGR3D_PIXEL_FORMAT_RGBA8888,
+                                    dst->pitch);
+
+    host1x_gr3d_enable_render_targets(stream, 1 << 1);
+
+    /* dst position */
+    host1x_gr3d_setup_attribute(stream, 0, attribs_bo,
+                                0, TGR3D_ATTRIB_TYPE_FLOAT16,
+                                2, 12);
+
+    /* luma texcoords */
+    host1x_gr3d_setup_attribute(stream, 1, attribs_bo,
+                                4, TGR3D_ATTRIB_TYPE_FLOAT16,
+                                2, 12);
+
+    /* chroma texcoords */
+    host1x_gr3d_setup_attribute(stream, 2, attribs_bo,
+                                8, TGR3D_ATTRIB_TYPE_FLOAT16,
+                                2, 12);
+
+    host1x_gr3d_setup_texture_desc(stream, 0,
+                                   src->bos[0], src->bos_offset[0],
+                                   src->pitch, src->height,
+                                   TGR3D_PIXEL_FORMAT_L8,
+                                   scaled, false, scaled,
+                                   true, false);
+
+    for (i = 1; i < 3; i++)
+        host1x_gr3d_setup_texture_desc(stream, i,
+                                       src->bos[i], src->bos_offset[i],
+                                       src->pitch_uv, chroma_height,
+                                       TGR3D_PIXEL_FORMAT_L8,
+                                       true, false, true,
+                                       true, false);
+
+    host1x_gr3d_upload_const_vp(stream, 0, 0.0f, 0.0f, 0.0f, 1.0f);
+
+    /* chroma coefficients are halved to fit the fx10 range */
+    host1x_gr3d_upload_const_fp(stream, 0, FX10x2(ky, off[0]));
+    host1x_gr3d_upload_const_fp(stream, 1, FX10x2(off[1], off[2]));
+    host1x_gr3d_upload_const_fp(stream, 2, FX10x2(ku[0] / 2, ku[1] / 2));
+    host1x_gr3d_upload_const_fp(stream, 3, FX10x2(ku[2] / 2, kv[0] / 2));
+    host1x_gr3d_upload_const_fp(stream, 4, FX10x2(kv[1] / 2, kv[2] / 2));
+
+    host1x_gr3d_setup_draw_params(stream, TGR3D_PRIMITIVE_TYPE_TRIANGLES,
+                                  TGR3D_INDEX_MODE_NONE, 0);
+
+    host1x_gr3d_draw_primitives(stream, 0, 6);
+
+    err = tegra_stream_end(stream);
+    if (err)
+        goto out_put;
+
+    err = host1x_pixelbuffer_submit(stream, false, src, dst);
+
+out_put:
+    tegra_stream_pool_put(dst_surf->dev, stream);
+out_unref:
+    drm_tegra_bo_unref(attribs_bo);
+
+    return err;
+}
+
+int rotate_video_surface(tegra_surface *src_surf,
+                         tegra_surface *dst_surf,
+                         struct host1x_csc_params *csc,
+                         enum host1x_2d_rotate rotate,
+                         unsigned int sx, unsigned int sy,
+                         unsigned int src_width, int src_height,
+                         unsigned int dx, unsigned int dy,
+                         unsigned int dst_width, int dst_height,
+                         bool check_only)
 {
     tegra_device *dev;
     struct tegra_stream *stream;
     struct host1x_pixelbuffer *src;
     struct host1x_pixelbuffer *dst;
-    struct host1x_pixelbuffer *tmp2 = NULL;
-    struct host1x_pixelbuffer *tmp = NULL;
+    struct scratch_pixbuf *tmp2 = NULL;
+    struct scratch_pixbuf *tmp = NULL;
     struct host1x_pixelbuffer *rot = NULL;
     unsigned pre_rot_width, pre_rot_height;
     unsigned rot_width, rot_height;
@@ -93,10 +516,18 @@ int rotate_surface_gr2d(tegra_surface *src_surf,
     if (check_only)
         goto out_unlock;
 
+    ret = rotate_surface_gr3d(src_surf, dst_surf, csc, rotate,
+                              sx, sy, src_width, src_height,
+                              dx, dy, dst_width, dst_height);
+    if (ret == 0)
+        goto out_unlock;
+
+    DebugMsg("GR3D rotation failed %d, falling back to GR2D\n", ret);
+
     src    = src_surf->pixbuf;
     dst    = dst_surf->pixbuf;
     dev    = dst_surf->dev;
-    stream = dst_surf->stream_2d;
+    stream = tegra_stream_pool_get(dev, dev->gr2d);
 
     if (pre_rot_width * pre_rot_height > src_width * src_height)
         downscale = false;
@@ -120,16 +551,14 @@ int rotate_surface_gr2d(tegra_surface *src_surf,
         }
     }
 
-    tmp = host1x_pixelbuffer_create(dev->drm,
-                                    tmp_width, tmp_height,
-                                    tmp_width * 4, 0,
-                                    dst->format,
-                                    PIX_BUF_LAYOUT_LINEAR);
-    if (!tmp)
-        return -EINVAL;
+    tmp = scratch_pixbuf_get(dev, tmp_width, tmp_height, dst->format);
+    if (!tmp) {
+        ret = -ENOMEM;
+        goto out_unref;
+    }
 
     ret = host1x_gr2d_surface_blit(stream,
-                                   src, tmp,
+                                   src, tmp->pixbuf,
                                    csc, sx, sy,
                                    src_width,
                                    src_height,
@@ -144,11 +573,7 @@ int rotate_surface_gr2d(tegra_surface *src_surf,
         tmp_width != pre_rot_width ||
         tmp_height != pre_rot_height)
     {
-        tmp2 = host1x_pixelbuffer_create(dev->drm,
-                                         rot_width, rot_height,
-                                         rot_width * 4, 0,
-                                         dst->format,
-                                         PIX_BUF_LAYOUT_LINEAR);
+        tmp2 = scratch_pixbuf_get(dev, rot_width, rot_height, dst->format);
         if (!tmp2) {
             ret = -ENOMEM;
             goto out_unref;
@@ -160,7 +585,7 @@ int rotate_surface_gr2d(tegra_surface *src_surf,
 
         twopass = true;
 
-        rot = tmp2;
+        rot = tmp2->pixbuf;
     } else {
         DebugMsg("direct rotation\n");
 
@@ -176,7 +601,7 @@ int rotate_surface_gr2d(tegra_surface *src_surf,
     }
 
     ret = host1x_gr2d_blit(stream,
-                           tmp, rot,
+                           tmp->pixbuf, rot,
                            rotate,
                            0, 0,
                            x, y,
@@ -194,10 +619,12 @@ int rotate_surface_gr2d(tegra_surface *src_surf,
 
 out_unref:
     if (tmp)
-        host1x_pixelbuffer_free(tmp);
+        scratch_pixbuf_put(dev, tmp, stream);
 
     if (tmp2)
-        host1x_pixelbuffer_free(tmp2);
+        scratch_pixbuf_put(dev, tmp2, stream);
+
+    tegra_stream_pool_put(dev, stream);
 
 out_unlock:
     pthread_mutex_unlock(&dst_surf->lock);
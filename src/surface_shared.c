@@ -265,6 +265,7 @@ tegra_surface * shared_surface_swap_video(tegra_surface *old)
 int shared_surface_transfer_video(tegra_surface *disp)
 {
     tegra_shared_surface *shared;
+    struct tegra_stream *stream;
     tegra_surface *video;
     int ret;
 
@@ -302,7 +303,8 @@ int shared_surface_transfer_video(tegra_surface *disp)
              shared->video->surface_id);
 
     if (disp->set_bg) {
-        ret = host1x_gr2d_clear_rect_clipped(disp->stream_2d,
+        stream = tegra_stream_pool_get(disp->dev, disp->dev->gr2d);
+        ret = host1x_gr2d_clear_rect_clipped(stream,
                                              disp->pixbuf,
                                              disp->bg_color,
                                              0, 0,
@@ -313,6 +315,7 @@ int shared_surface_transfer_video(tegra_surface *disp)
                                              shared->dst_x0 + shared->dst_width,
                                              shared->dst_y0 + shared->dst_height,
                                              true);
+        tegra_stream_pool_put(disp->dev, stream);
         if (ret) {
             ErrorMsg("setting BG failed %d\n", ret);
         }
@@ -320,7 +323,8 @@ int shared_surface_transfer_video(tegra_surface *disp)
         disp->set_bg = false;
     }
 
-    ret = host1x_gr2d_surface_blit(disp->stream_2d,
+    stream = tegra_stream_pool_get(disp->dev, disp->dev->gr2d);
+    ret = host1x_gr2d_surface_blit(stream,
                                    video->pixbuf,
                                    disp->pixbuf,
                                    &shared->csc.gr2d,
@@ -332,6 +336,7 @@ int shared_surface_transfer_video(tegra_surface *disp)
                                    shared->dst_y0,
                                    shared->dst_width,
                                    shared->dst_height);
+    tegra_stream_pool_put(disp->dev, stream);
     if (ret) {
         ErrorMsg("video transfer failed %d\n", ret);
     }
@@ -28,10 +28,12 @@
 #ifndef TEGRA_STREAM_H_
 #define TEGRA_STREAM_H_
 
+#include <assert.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
+#include "atomic.h"
 #include "host1x.h"
 #include "opentegra_lib.h"
 
@@ -56,15 +58,40 @@ struct tegra_reloc {
 
 struct tegra_fence {
     void *opaque;
-    int refcnt;
+    atomic_t refcnt;
     bool gr2d;
 
     bool (*wait_fence)(struct tegra_fence *f);
     void (*free_fence)(struct tegra_fence *f);
 };
 
+#define TEGRA_TEMPLATE_MAX_WORDS    40
+#define TEGRA_TEMPLATE_MAX_PARAMS   16
+#define TEGRA_TEMPLATE_MAX_RELOCS   8
+
+/*
+ * Command sequence recorded once and replayed with a single push_words,
+ * parameter and relocation slots are patched on every replay.
+ */
+struct tegra_stream_template {
+    uint32_t class_id;
+    unsigned int num_words;
+    unsigned int num_params;
+    unsigned int num_relocs;
+    uint32_t words[TEGRA_TEMPLATE_MAX_WORDS];
+    uint8_t param_words[TEGRA_TEMPLATE_MAX_PARAMS];
+    uint8_t reloc_words[TEGRA_TEMPLATE_MAX_RELOCS];
+};
+
+/* largest job submitted by streams of the same engine */
+struct tegra_stream_hwm {
+    unsigned int words;
+    unsigned int relocs;
+};
+
 struct tegra_stream {
     struct drm_tegra_channel *channel;
+    struct tegra_stream_hwm *hwm;
     enum tegra_stream_status status;
     struct tegra_fence *last_fence;
     bool op_done_synced;
@@ -83,7 +110,8 @@ struct tegra_stream {
                       struct drm_tegra_bo *bo,
                       unsigned offset);
     int (*push_words)(struct tegra_stream *stream, const void *addr,
-                      unsigned words, int num_relocs, ...);
+                      unsigned words, const struct tegra_reloc *relocs,
+                      unsigned num_relocs);
     int (*prep)(struct tegra_stream *stream, uint32_t words);
     int (*sync)(struct tegra_stream *stream,
                 enum drm_tegra_syncpt_cond cond,
@@ -92,10 +120,12 @@ struct tegra_stream {
 
 /* Stream operations */
 int tegra_stream_create_v1(struct tegra_stream **stream,
-                           struct tegra_device *tegra);
+                           struct tegra_device *tegra,
+                           struct drm_tegra_channel *channel);
 
 int grate_stream_create_v2(struct tegra_stream **stream,
-                           struct tegra_device *tegra);
+                           struct tegra_device *tegra,
+                           struct drm_tegra_channel *channel);
 
 static inline int tegra_stream_create(struct tegra_stream **stream,
                                       struct tegra_device *tegra,
@@ -103,11 +133,9 @@ static inline int tegra_stream_create(struct tegra_stream **stream,
 {
     int ret;
 
-    ret = grate_stream_create_v2(stream, tegra);
+    ret = grate_stream_create_v2(stream, tegra, channel);
     if (ret)
-        ret = tegra_stream_create_v1(stream, tegra);
-    if (!ret)
-        (*stream)->channel = channel;
+        ret = tegra_stream_create_v1(stream, tegra, channel);
 
     return ret;
 }
@@ -166,6 +194,7 @@ static inline int tegra_stream_flush(struct tegra_stream *stream)
     return stream->flush(stream);
 }
 
+/* returned fence is owned by the stream, NULL if submission failed */
 static inline struct tegra_fence *
 tegra_stream_submit(struct tegra_stream *stream, bool gr2d)
 {
@@ -175,12 +204,27 @@ tegra_stream_submit(struct tegra_stream *stream, bool gr2d)
     return stream->submit(stream, gr2d);
 }
 
+/*
+ * Updated without locking, losing a racing update only costs a resize
+ * of the next job.
+ */
+static inline void tegra_stream_update_hwm(struct tegra_stream *stream,
+                                           unsigned int words,
+                                           unsigned int relocs)
+{
+    if (stream->hwm->words < words)
+        stream->hwm->words = words;
+
+    if (stream->hwm->relocs < relocs)
+        stream->hwm->relocs = relocs;
+}
+
 static inline struct tegra_fence *
 tegra_stream_ref_fence(struct tegra_fence *f, void *opaque)
 {
     if (f) {
         f->opaque = opaque;
-        f->refcnt++;
+        atomic_inc(&f->refcnt);
     }
 
     return f;
@@ -207,17 +251,17 @@ static inline bool tegra_stream_wait_fence(struct tegra_fence *f)
 static inline void tegra_stream_put_fence(struct tegra_fence *f)
 {
     if (f) {
-        if (f->refcnt < 0) {
+        if (atomic_read(&f->refcnt) <= 0) {
             TGR_STRM_ERROR_MSG("BUG: fence refcount underflow\n");
             return;
         }
 
-        if (f->refcnt > 10) {
+        if (atomic_read(&f->refcnt) > 10) {
             TGR_STRM_ERROR_MSG("BUG: fence refcount overflow\n");
             return;
         }
 
-        if (--f->refcnt == -1)
+        if (atomic_dec_and_test(&f->refcnt))
             f->free_fence(f);
     }
 }
@@ -238,22 +282,15 @@ tegra_stream_push_reloc(struct tegra_stream *stream,
 static inline int tegra_stream_push_words(struct tegra_stream *stream,
                                           const void *addr,
                                           unsigned words,
-                                          int num_relocs,
-                                          ...)
+                                          const struct tegra_reloc *relocs,
+                                          unsigned num_relocs)
 {
-    va_list args;
-    int ret;
-
     if (!(stream && stream->status == TEGRADRM_STREAM_CONSTRUCT)) {
         TGR_STRM_ERROR_MSG("Stream status isn't CONSTRUCT\n");
         return -1;
     }
 
-    va_start(args, num_relocs);
-    ret = stream->push_words(stream, addr, words, num_relocs, args);
-    va_end(args);
-
-    return ret;
+    return stream->push_words(stream, addr, words, relocs, num_relocs);
 }
 
 static inline int
@@ -328,4 +365,83 @@ tegra_reloc(const void *var_ptr, struct drm_tegra_bo *bo,
     return reloc;
 }
 
+static inline void
+tegra_template_init(struct tegra_stream_template *tmpl, uint32_t class_id)
+{
+    tmpl->class_id = class_id;
+    tmpl->num_words = 0;
+    tmpl->num_params = 0;
+    tmpl->num_relocs = 0;
+}
+
+static inline void
+tegra_template_push(struct tegra_stream_template *tmpl, uint32_t word)
+{
+    assert(tmpl->num_words < TEGRA_TEMPLATE_MAX_WORDS);
+
+    tmpl->words[tmpl->num_words++] = word;
+}
+
+static inline void
+tegra_template_push_param(struct tegra_stream_template *tmpl, unsigned slot)
+{
+    assert(slot < TEGRA_TEMPLATE_MAX_PARAMS);
+
+    tmpl->param_words[slot] = tmpl->num_words;
+
+    if (tmpl->num_params <= slot)
+        tmpl->num_params = slot + 1;
+
+    tegra_template_push(tmpl, 0x00000000);
+}
+
+static inline void
+tegra_template_push_reloc(struct tegra_stream_template *tmpl, unsigned slot)
+{
+    assert(slot < TEGRA_TEMPLATE_MAX_RELOCS);
+
+    tmpl->reloc_words[slot] = tmpl->num_words;
+
+    if (tmpl->num_relocs <= slot)
+        tmpl->num_relocs = slot + 1;
+
+    tegra_template_push(tmpl, 0xdeadbeef);
+}
+
+/*
+ * Replays template, params and relocs are indexed by the slots given
+ * while recording. Var offsets of the relocs are filled in here.
+ */
+static inline int
+tegra_stream_push_template(struct tegra_stream *stream,
+                           const struct tegra_stream_template *tmpl,
+                           const uint32_t *params,
+                           struct tegra_reloc *relocs)
+{
+    uint32_t *words;
+    unsigned i;
+    int ret;
+
+    ret = tegra_stream_push_setclass(stream, tmpl->class_id);
+    if (ret)
+        return ret;
+
+    for (i = 0; i < tmpl->num_relocs; i++)
+        relocs[i].var_offset = tmpl->reloc_words[i] * sizeof(uint32_t);
+
+    ret = tegra_stream_push_words(stream, tmpl->words, tmpl->num_words,
+                                  relocs, tmpl->num_relocs);
+    if (ret)
+        return ret;
+
+    words = *stream->buf_ptr - tmpl->num_words;
+
+    for (i = 0; i < tmpl->num_params; i++)
+        words[tmpl->param_words[i]] = params[i];
+
+    stream->op_done_synced = false;
+
+    return 0;
+}
+
 #endif
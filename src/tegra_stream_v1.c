@@ -34,12 +34,14 @@ struct tegra_command_buffer_v1 {
 struct tegra_fence_v1 {
     struct tegra_fence base;
     struct drm_tegra_fence *fence;
+    pthread_mutex_t lock;
 };
 
 struct tegra_stream_v1 {
     struct tegra_stream base;
     struct drm_tegra_job *job;
     struct tegra_command_buffer_v1 buffer;
+    bool job_busy;
 };
 
 static struct tegra_fence *
@@ -65,13 +67,67 @@ static void tegra_stream_destroy_v1(struct tegra_stream *base_stream)
     free(stream);
 }
 
+static bool tegra_stream_job_idle_v1(struct tegra_stream_v1 *stream)
+{
+    struct tegra_fence_v1 *f;
+    bool idle = true;
+
+    if (!stream->job_busy)
+        return true;
+
+    if (!stream->base.last_fence)
+        return false;
+
+    f = to_fence_v1(stream->base.last_fence);
+
+    /*
+     * Fence is usually waited through pixbufs, if at all, hence poll it.
+     * It's released once it has been waited for.
+     */
+    pthread_mutex_lock(&f->lock);
+
+    if (f->fence && drm_tegra_fence_wait_timeout(f->fence, 0))
+        idle = false;
+
+    pthread_mutex_unlock(&f->lock);
+
+    return idle;
+}
+
+static void tegra_stream_update_hwm_v1(struct tegra_stream_v1 *stream)
+{
+    unsigned int words, relocs;
+
+    if (!drm_tegra_job_get_size(stream->job, &words, &relocs))
+        tegra_stream_update_hwm(&stream->base, words, relocs);
+}
+
+static void tegra_stream_capture_v1(struct tegra_stream_v1 *stream)
+{
+    unsigned int words, relocs;
+    uint32_t *buf;
+
+    if (!host1x_capture_enabled())
+        return;
+
+    if (drm_tegra_job_get_size(stream->job, &words, &relocs))
+        return;
+
+    buf = malloc((words + relocs) * sizeof(*buf));
+    if (!buf)
+        return;
+
+    if (!drm_tegra_job_read(stream->job, buf, buf + words))
+        host1x_capture_job(buf, words, buf + words, relocs);
+
+    free(buf);
+}
+
 static int tegra_stream_cleanup_v1(struct tegra_stream *base_stream)
 {
     struct tegra_stream_v1 *stream = to_stream_v1(base_stream);
 
-    drm_tegra_job_free(stream->job);
-
-    stream->job = NULL;
+    /* job is kept for reuse, it's reset by the next begin */
     stream->base.status = TEGRADRM_STREAM_FREE;
 
     return 0;
@@ -104,9 +160,13 @@ static int tegra_stream_flush_v1(struct tegra_stream *base_stream)
         goto cleanup;
     }
 
+    tegra_stream_update_hwm_v1(stream);
+    tegra_stream_capture_v1(stream);
+
     ret = drm_tegra_fence_wait_timeout(fence, 1000);
     if (ret) {
         ErrorMsg("drm_tegra_fence_wait_timeout() failed %d\n", ret);
+        stream->job_busy = true;
         ret = -1;
     }
 
@@ -122,8 +182,10 @@ static struct tegra_fence *
 tegra_stream_submit_v1(struct tegra_stream *base_stream, bool gr2d)
 {
     struct tegra_stream_v1 *stream = to_stream_v1(base_stream);
+    unsigned int words = 0, relocs;
     struct drm_tegra_fence *fence;
     struct tegra_fence *f;
+    VdpTime submit_time;
     int ret;
 
     f = stream->base.last_fence;
@@ -134,30 +196,39 @@ tegra_stream_submit_v1(struct tegra_stream *base_stream, bool gr2d)
 
     /* return error if stream is constructed badly */
     if (stream->base.status != TEGRADRM_STREAM_READY) {
-        ret = -1;
+        f = NULL;
         goto cleanup;
     }
 
+    if (tegra_vdpau_engine_stats)
+        drm_tegra_job_get_size(stream->job, &words, &relocs);
+
+    submit_time = get_time();
+
     ret = drm_tegra_job_submit(stream->job, &fence);
     if (ret) {
         ErrorMsg("drm_tegra_job_submit() failed %d\n", ret);
-        ret = -1;
+        f = NULL;
     } else {
+        tegra_stream_update_hwm_v1(stream);
+        tegra_stream_capture_v1(stream);
+
         f = tegra_stream_create_fence_v1(fence, gr2d);
         if (f) {
             tegra_stream_put_fence(stream->base.last_fence);
             stream->base.last_fence = f;
+            stream->job_busy = true;
+
+            engine_stats_submit(f, submit_time, words);
         } else {
             drm_tegra_fence_wait_timeout(fence, 1000);
             drm_tegra_fence_free(fence);
+            f = NULL;
         }
     }
 
 cleanup:
-    drm_tegra_job_free(stream->job);
-
-    stream->job = NULL;
-    stream->base.status = TEGRADRM_STREAM_FREE;
+    tegra_stream_cleanup_v1(base_stream);
 
     return f;
 }
@@ -165,8 +236,12 @@ cleanup:
 static bool tegra_stream_wait_fence_v1(struct tegra_fence *base_fence)
 {
     struct tegra_fence_v1 *f = to_fence_v1(base_fence);
+    bool waited = false;
     int ret;
 
+    /* fence may be shared by pixbufs of different threads */
+    pthread_mutex_lock(&f->lock);
+
     if (f->fence) {
         ret = drm_tegra_fence_wait_timeout(f->fence, 1000);
         if (ret) {
@@ -176,10 +251,12 @@ static bool tegra_stream_wait_fence_v1(struct tegra_fence *base_fence)
         drm_tegra_fence_free(f->fence);
         f->fence = NULL;
 
-        return true;
+        waited = true;
     }
 
-    return false;
+    pthread_mutex_unlock(&f->lock);
+
+    return waited;
 }
 
 static void tegra_stream_free_fence_v1(struct tegra_fence *base_fence)
@@ -187,6 +264,7 @@ static void tegra_stream_free_fence_v1(struct tegra_fence *base_fence)
     struct tegra_fence_v1 *f = to_fence_v1(base_fence);
 
     drm_tegra_fence_free(f->fence);
+    pthread_mutex_destroy(&f->lock);
     free(f);
 }
 
@@ -198,6 +276,8 @@ tegra_stream_create_fence_v1(struct drm_tegra_fence *fence, bool gr2d)
     if (!f)
         return NULL;
 
+    pthread_mutex_init(&f->lock, NULL);
+    atomic_set(&f->base.refcnt, 1);
     f->fence = fence;
     f->base.wait_fence = tegra_stream_wait_fence_v1;
     f->base.free_fence = tegra_stream_free_fence_v1;
@@ -210,26 +290,44 @@ static int tegra_stream_begin_v1(struct tegra_stream *base_stream,
                                  struct drm_tegra_channel *channel)
 {
     struct tegra_stream_v1 *stream = to_stream_v1(base_stream);
+    struct tegra_stream_hwm *hwm = stream->base.hwm;
     int ret;
 
-    ret = drm_tegra_job_new(&stream->job, channel);
-    if (ret) {
-        ErrorMsg("drm_tegra_job_new() failed %d\n", ret);
-        return -1;
+    if (stream->job) {
+        /* pushbuf is reusable once hardware is done with it */
+        ret = drm_tegra_job_reset(stream->job,
+                                  tegra_stream_job_idle_v1(stream));
+        if (ret) {
+            ErrorMsg("drm_tegra_job_reset() failed %d\n", ret);
+            goto err_free_job;
+        }
+
+        stream->job_busy = false;
+    } else {
+        ret = drm_tegra_job_new(&stream->job, channel);
+        if (ret) {
+            ErrorMsg("drm_tegra_job_new() failed %d\n", ret);
+            return -1;
+        }
+
+        ret = drm_tegra_pushbuf_new(&stream->buffer.pushbuf, stream->job);
+        if (ret) {
+            ErrorMsg("drm_tegra_pushbuf_new() failed %d\n", ret);
+            goto err_free_job;
+        }
     }
 
-    ret = drm_tegra_pushbuf_new(&stream->buffer.pushbuf, stream->job);
+    ret = drm_tegra_job_reserve(stream->job, hwm->relocs);
     if (ret) {
-        ErrorMsg("drm_tegra_pushbuf_new() failed %d\n", ret);
-        drm_tegra_job_free(stream->job);
-        return -1;
+        ErrorMsg("drm_tegra_job_reserve() failed %d\n", ret);
+        goto err_free_job;
     }
 
-    ret = drm_tegra_pushbuf_prepare(stream->buffer.pushbuf, 1);
+    ret = drm_tegra_pushbuf_prepare(stream->buffer.pushbuf,
+                                    hwm->words ?: 1);
     if (ret) {
         ErrorMsg("drm_tegra_pushbuf_prepare() failed %d\n", ret);
-        drm_tegra_job_free(stream->job);
-        return -1;
+        goto err_free_job;
     }
 
     stream->base.class_id = 0;
@@ -238,6 +336,12 @@ static int tegra_stream_begin_v1(struct tegra_stream *base_stream,
     stream->base.buf_ptr = &stream->buffer.pushbuf->ptr;
 
     return 0;
+
+err_free_job:
+    drm_tegra_job_free(stream->job);
+    stream->job = NULL;
+
+    return -1;
 }
 
 static int tegra_stream_push_reloc_v1(struct tegra_stream *base_stream,
@@ -288,12 +392,12 @@ ready:
 
 static int
 tegra_stream_push_words_v1(struct tegra_stream *base_stream, const void *addr,
-                           unsigned words, int num_relocs, ...)
+                           unsigned words, const struct tegra_reloc *relocs,
+                           unsigned num_relocs)
 {
     struct tegra_stream_v1 *stream = to_stream_v1(base_stream);
-    struct tegra_reloc reloc_arg;
     uint32_t *pushbuf_ptr;
-    va_list ap;
+    unsigned i;
     int ret;
 
     ret = drm_tegra_pushbuf_prepare(stream->buffer.pushbuf, words);
@@ -317,22 +421,18 @@ tegra_stream_push_words_v1(struct tegra_stream *base_stream, const void *addr,
     memcpy(pushbuf_ptr, addr, words * sizeof(uint32_t));
 
     /* copy relocs */
-    va_start(ap, num_relocs);
-    for (; num_relocs; num_relocs--) {
-        reloc_arg = va_arg(ap, struct tegra_reloc);
-
+    for (i = 0; i < num_relocs; i++) {
         stream->buffer.pushbuf->ptr  = pushbuf_ptr;
-        stream->buffer.pushbuf->ptr += reloc_arg.var_offset / sizeof(uint32_t);
+        stream->buffer.pushbuf->ptr += relocs[i].var_offset / sizeof(uint32_t);
 
-        ret = drm_tegra_pushbuf_relocate(stream->buffer.pushbuf, reloc_arg.bo,
-                                         reloc_arg.offset, 0);
+        ret = drm_tegra_pushbuf_relocate(stream->buffer.pushbuf, relocs[i].bo,
+                                         relocs[i].offset, 0);
         if (ret) {
             stream->base.status = TEGRADRM_STREAM_CONSTRUCTION_FAILED;
             ErrorMsg("drm_tegra_pushbuf_relocate() failed %d\n", ret);
             break;
         }
     }
-    va_end(ap);
 
     stream->buffer.pushbuf->ptr = pushbuf_ptr + words;
 
@@ -378,7 +478,8 @@ static int tegra_stream_sync_v1(struct tegra_stream *base_stream,
 }
 
 int tegra_stream_create_v1(struct tegra_stream **pstream,
-                           struct tegra_device *tegra)
+                           struct tegra_device *tegra,
+                           struct drm_tegra_channel *channel)
 {
     struct tegra_stream_v1 *stream_v1;
     struct tegra_stream *stream;
@@ -395,6 +496,8 @@ int tegra_stream_create_v1(struct tegra_stream **pstream,
         return -1;
 
     stream = &stream_v1->base;
+    stream->hwm = channel == tegra->gr2d ? &tegra->gr2d_hwm : &tegra->gr3d_hwm;
+    stream->channel = channel;
     stream->status = TEGRADRM_STREAM_FREE;
     stream->destroy = tegra_stream_destroy_v1;
     stream->begin = tegra_stream_begin_v1;
@@ -34,6 +34,9 @@ struct tegra_stream_v2 {
     int drm_fd;
     struct drm_tegra *drm;
     struct drm_tegra_job_v2 *job;
+    uint32_t *capture_relocs;
+    unsigned int num_capture_relocs;
+    unsigned int max_capture_relocs;
 };
 
 static struct tegra_fence *
@@ -56,9 +59,50 @@ static void tegra_stream_destroy_v2(struct tegra_stream *base_stream)
     tegra_stream_wait_fence(stream->base.last_fence);
     tegra_stream_put_fence(stream->base.last_fence);
     drm_tegra_job_free_v2(stream->job);
+    free(stream->capture_relocs);
     free(stream);
 }
 
+static void tegra_stream_update_hwm_v2(struct tegra_stream_v2 *stream)
+{
+    tegra_stream_update_hwm(&stream->base,
+                            stream->job->ptr - stream->job->start,
+                            stream->job->num_bos);
+}
+
+/* relocations are patched by kernel, hence their words are remembered */
+static void tegra_stream_capture_reloc_v2(struct tegra_stream_v2 *stream)
+{
+    unsigned int max = stream->max_capture_relocs;
+    uint32_t *relocs;
+
+    if (!host1x_capture_enabled())
+        return;
+
+    if (stream->num_capture_relocs == max) {
+        max = max ? max * 2 : 16;
+
+        relocs = realloc(stream->capture_relocs, max * sizeof(*relocs));
+        if (!relocs)
+            return;
+
+        stream->capture_relocs = relocs;
+        stream->max_capture_relocs = max;
+    }
+
+    stream->capture_relocs[stream->num_capture_relocs++] =
+        stream->job->ptr - stream->job->start;
+}
+
+static void tegra_stream_capture_v2(struct tegra_stream_v2 *stream)
+{
+    if (host1x_capture_enabled())
+        host1x_capture_job(stream->job->start,
+                           stream->job->ptr - stream->job->start,
+                           stream->capture_relocs,
+                           stream->num_capture_relocs);
+}
+
 static int tegra_stream_cleanup_v2(struct tegra_stream *base_stream)
 {
     struct tegra_stream_v2 *stream = to_stream_v2(base_stream);
@@ -95,6 +139,8 @@ static int tegra_stream_flush_v2(struct tegra_stream *base_stream)
         goto cleanup;
     }
 
+    tegra_stream_update_hwm_v2(stream);
+
     ret = drm_tegra_job_submit_v2(stream->job,
                                      to_fence_v2(f)->syncobj_handle, ~0ull);
     if (ret) {
@@ -102,6 +148,7 @@ static int tegra_stream_flush_v2(struct tegra_stream *base_stream)
                  ret, strerror(ret));
         ret = -1;
     } else {
+        tegra_stream_capture_v2(stream);
         tegra_stream_wait_fence(f);
     }
 
@@ -118,6 +165,7 @@ tegra_stream_submit_v2(struct tegra_stream *base_stream, bool gr2d)
 {
     struct tegra_stream_v2 *stream = to_stream_v2(base_stream);
     struct tegra_fence *f;
+    VdpTime submit_time;
     int ret;
 
     f = stream->base.last_fence;
@@ -127,25 +175,32 @@ tegra_stream_submit_v2(struct tegra_stream *base_stream, bool gr2d)
         return f;
 
     /* return error if stream is constructed badly */
-    if (stream->base.status != TEGRADRM_STREAM_READY)
+    if (stream->base.status != TEGRADRM_STREAM_READY) {
+        f = NULL;
         goto cleanup;
+    }
 
     f = tegra_stream_create_fence_v2(stream, gr2d);
     if (!f)
         goto cleanup;
 
+    tegra_stream_update_hwm_v2(stream);
+
+    submit_time = get_time();
+
     ret = drm_tegra_job_submit_v2(stream->job,
                                      to_fence_v2(f)->syncobj_handle, ~0ull);
     if (ret) {
         ErrorMsg("drm_tegra_job_submit_v2() failed %d\n", ret);
-#ifdef HAVE_LIBDRM_SYNCOBJ_SUPPORT
-        drmSyncobjDestroy(to_fence_v2(f)->drm_fd,
-                          to_fence_v2(f)->syncobj_handle);
-#endif
-        to_fence_v2(f)->syncobj_handle = 0;
+        tegra_stream_put_fence(f);
+        f = NULL;
     } else {
+        tegra_stream_capture_v2(stream);
         tegra_stream_put_fence(stream->base.last_fence);
         stream->base.last_fence = f;
+
+        engine_stats_submit(f, submit_time,
+                            stream->job->ptr - stream->job->start);
     }
 
 cleanup:
@@ -221,6 +276,7 @@ tegra_stream_create_fence_v2(struct tegra_stream_v2 *stream, bool gr2d)
         return NULL;
     }
 
+    atomic_set(&f->base.refcnt, 1);
     f->drm_fd = stream->drm_fd;
     f->base.wait_fence = tegra_stream_wait_fence_v2;
     f->base.free_fence = tegra_stream_free_fence_v2;
@@ -238,6 +294,7 @@ static int tegra_stream_begin_v2(struct tegra_stream *base_stream,
     stream->base.status = TEGRADRM_STREAM_CONSTRUCT;
     stream->base.op_done_synced = false;
     stream->base.buf_ptr = &stream->job->ptr;
+    stream->num_capture_relocs = 0;
 
     return 0;
 }
@@ -249,6 +306,8 @@ static int tegra_stream_push_reloc_v2(struct tegra_stream *base_stream,
     struct tegra_stream_v2 *stream = to_stream_v2(base_stream);
     int ret;
 
+    tegra_stream_capture_reloc_v2(stream);
+
     ret = drm_tegra_job_push_reloc_v2(stream->job, bo, offset,
                                       DRM_TEGRA_BO_TABLE_WRITE);
     if (ret) {
@@ -285,12 +344,13 @@ static int tegra_stream_prep_v2(struct tegra_stream *base_stream, uint32_t words
 
     if (stream->job->ptr + words >
         stream->job->start + stream->job->num_words) {
-        if (words < 1024)
-            words = 1024;
+        /* grow geometrically to keep amount of reallocations low */
+        if (words < stream->job->num_words)
+            words = stream->job->num_words;
 
         ret = drm_tegra_job_resize_v2(stream->job,
                                       stream->job->num_words + words,
-                                      stream->job->num_bos,
+                                      stream->job->num_bos_max,
                                       true);
         if (ret) {
             stream->base.status = TEGRADRM_STREAM_CONSTRUCTION_FAILED;
@@ -306,12 +366,12 @@ static int tegra_stream_prep_v2(struct tegra_stream *base_stream, uint32_t words
 
 static int
 tegra_stream_push_words_v2(struct tegra_stream *base_stream, const void *addr,
-                           unsigned words, int num_relocs, ...)
+                           unsigned words, const struct tegra_reloc *relocs,
+                           unsigned num_relocs)
 {
     struct tegra_stream_v2 *stream = to_stream_v2(base_stream);
-    struct tegra_reloc reloc_arg;
     uint32_t *pushbuf_ptr;
-    va_list ap;
+    unsigned i;
     int ret;
 
     ret = tegra_stream_prep_v2(base_stream, words);
@@ -330,16 +390,15 @@ tegra_stream_push_words_v2(struct tegra_stream *base_stream, const void *addr,
     memcpy(pushbuf_ptr, addr, words * sizeof(uint32_t));
 
     /* copy relocs */
-    va_start(ap, num_relocs);
-    for (; num_relocs; num_relocs--) {
-        reloc_arg = va_arg(ap, struct tegra_reloc);
-
+    for (i = 0; i < num_relocs; i++) {
         stream->job->ptr  = pushbuf_ptr;
-        stream->job->ptr += reloc_arg.var_offset / sizeof(uint32_t);
+        stream->job->ptr += relocs[i].var_offset / sizeof(uint32_t);
+
+        tegra_stream_capture_reloc_v2(stream);
 
         ret = drm_tegra_job_push_reloc_v2(stream->job,
-                                          reloc_arg.bo,
-                                          reloc_arg.offset,
+                                          relocs[i].bo,
+                                          relocs[i].offset,
                                           DRM_TEGRA_BO_TABLE_WRITE);
         if (ret) {
             stream->base.status = TEGRADRM_STREAM_CONSTRUCTION_FAILED;
@@ -347,7 +406,6 @@ tegra_stream_push_words_v2(struct tegra_stream *base_stream, const void *addr,
             break;
         }
     }
-    va_end(ap);
 
     stream->job->ptr = pushbuf_ptr + words;
 
@@ -386,7 +444,8 @@ static int tegra_stream_sync_v2(struct tegra_stream *base_stream,
 }
 
 int grate_stream_create_v2(struct tegra_stream **pstream,
-                           struct tegra_device *tegra)
+                           struct tegra_device *tegra,
+                           struct drm_tegra_channel *channel)
 {
     struct tegra_stream_v2 *stream_v2;
     struct tegra_stream *stream;
@@ -419,6 +478,8 @@ int grate_stream_create_v2(struct tegra_stream **pstream,
         return -1;
 
     stream = &stream_v2->base;
+    stream->hwm = channel == tegra->gr2d ? &tegra->gr2d_hwm : &tegra->gr3d_hwm;
+    stream->channel = channel;
     stream->status = TEGRADRM_STREAM_FREE;
     stream->destroy = tegra_stream_destroy_v2;
     stream->begin = tegra_stream_begin_v2;
@@ -434,8 +495,9 @@ int grate_stream_create_v2(struct tegra_stream **pstream,
     stream_v2->drm_fd = tegra->drm_fd;
     stream_v2->drm = tegra->drm;
 
-    ret = drm_tegra_job_new_v2(&stream_v2->job, tegra->drm, 16,
-                               65536 /* xxx: 64K should be enough (!?) */);
+    /* size job after the largest one seen on this engine */
+    ret = drm_tegra_job_new_v2(&stream_v2->job, tegra->drm,
+                               stream->hwm->relocs, stream->hwm->words);
     if (ret) {
         ErrorMsg("drm_tegra_job_new_v2() failed %d\n", ret);
         free(stream_v2);
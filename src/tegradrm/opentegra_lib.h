@@ -66,6 +66,14 @@ int drm_tegra_version(struct drm_tegra *drm);
 
 enum drm_tegra_soc_id drm_tegra_get_soc_id(struct drm_tegra *drm);
 
+/*
+ * Allocation intent, never passed to kernel. BO won't be accessed by CPU
+ * nor by asynchronous host1x jobs, only by engines that are done with it
+ * by the time it's freed (like VDE). Such BO is known to be idle once
+ * freed and is reused by the next GPU-only allocation without checking.
+ */
+#define DRM_TEGRA_BO_GPU_ONLY	(1u << 31)
+
 int drm_tegra_bo_new(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 		     uint32_t flags, uint32_t size);
 int drm_tegra_bo_wrap(struct drm_tegra_bo **bop, struct drm_tegra *drm,
@@ -127,6 +135,12 @@ int drm_tegra_channel_close(struct drm_tegra_channel *channel);
 int drm_tegra_job_new(struct drm_tegra_job **jobp,
 		      struct drm_tegra_channel *channel);
 int drm_tegra_job_free(struct drm_tegra_job *job);
+int drm_tegra_job_reset(struct drm_tegra_job *job, bool idle);
+int drm_tegra_job_reserve(struct drm_tegra_job *job, unsigned int num_relocs);
+int drm_tegra_job_get_size(struct drm_tegra_job *job, unsigned int *words,
+			   unsigned int *relocs);
+int drm_tegra_job_read(struct drm_tegra_job *job, uint32_t *words,
+		       uint32_t *reloc_words);
 int drm_tegra_job_submit(struct drm_tegra_job *job,
 			 struct drm_tegra_fence **fencep);
 
@@ -111,13 +111,23 @@ struct drm_tegra_bo_bucket {
 	drmMMListHead list;
 	uint32_t num_entries;
 	uint32_t num_mmap_entries;
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t evictions;
+	uint32_t reuse_interval; /* averaged msecs BO stays cached until reuse */
 	bool sparse;
 };
 
 struct drm_tegra_bo_cache {
 	struct drm_tegra_bo_bucket cache_bucket[14 * 4 * 2];
 	int num_buckets;
+	int sparse_offset;
+	int set_size;
+	bool coarse;
+	uint64_t size;		/* total size of cached BOs */
+	uint64_t max_size;	/* cached BOs size budget */
 	time_t time;
+	time_t stats_time;
 };
 
 struct drm_tegra_bo_mmap_cache {
@@ -144,6 +154,9 @@ struct drm_tegra {
 	bool close;
 	int fd;
 
+	/* cache counters are kept in all builds, only printing is optional */
+	bool debug_bo_cache;
+
 #ifndef NDEBUG
 	bool debug_bo;
 	bool debug_bo_back_guard;
@@ -183,6 +196,7 @@ struct drm_tegra_bo {
 	 */
 	drmMMListHead bo_list;	/* bucket-list entry */
 	time_t free_time;	/* time when added to bucket-list */
+	bool gpu_only;		/* allocated with DRM_TEGRA_BO_GPU_ONLY */
 
 	drmMMListHead mmap_list;	/* mmap cache-list entry */
 	time_t unmap_time;		/* time when added to cache-list */
@@ -207,8 +221,10 @@ void drm_tegra_bo_cache_cleanup(struct drm_tegra *drm, time_t time);
 struct drm_tegra_bo * drm_tegra_bo_cache_alloc(struct drm_tegra *drm,
 					       uint32_t *size, uint32_t flags);
 int drm_tegra_bo_cache_free(struct drm_tegra_bo *bo);
+void drm_tegra_bo_cache_remove(struct drm_tegra_bo *bo);
 void drm_tegra_bo_cache_unmap(struct drm_tegra_bo *bo);
 void *drm_tegra_bo_cache_map(struct drm_tegra_bo *bo);
+void drm_tegra_bo_cache_dump_stats(struct drm_tegra *drm);
 
 struct drm_tegra_bo_bucket *
 drm_tegra_get_bucket(struct drm_tegra *drm, uint32_t size, uint32_t flags);
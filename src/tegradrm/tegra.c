@@ -34,12 +34,16 @@
 
 #include "private.h"
 
+/*
+ * table_lock protects handle and name tables, cache_lock protects BO and
+ * mapping caches. If both are needed, cache_lock must be taken first.
+ */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
 
-/* lookup a buffer, call with table_lock mutex locked */
+/* lookup a buffer, call with cache_lock and table_lock mutexes locked */
 static struct drm_tegra_bo * lookup_bo(void *table, uint32_t key)
 {
-	struct drm_tegra_bo_bucket *bucket;
 	struct drm_tegra_bo *bo;
 	void *value;
 
@@ -53,11 +57,7 @@ static struct drm_tegra_bo * lookup_bo(void *table, uint32_t key)
 		drm_tegra_reset_bo(bo, 0, false);
 
 		/* take out BO from the bucket */
-		DRMLISTDELINIT(&bo->bo_list);
-
-		/* update bucket stats */
-		bucket = drm_tegra_get_bucket(bo->drm, bo->size, bo->flags);
-		bucket->num_entries--;
+		drm_tegra_bo_cache_remove(bo);
 	}
 
 	/* found, increment reference count */
@@ -200,6 +200,7 @@ static void drm_tegra_bo_unmap_guards(struct drm_tegra_bo *bo)
 #endif
 }
 
+/* Called under cache_lock */
 int drm_tegra_bo_free(struct drm_tegra_bo *bo)
 {
 	struct drm_tegra *drm = bo->drm;
@@ -241,11 +242,15 @@ int drm_tegra_bo_free(struct drm_tegra_bo *bo)
 vg_free:
 	VG_BO_FREE(bo);
 
+	pthread_mutex_lock(&table_lock);
+
 	if (bo->name)
 		drmHashDelete(drm->name_table, bo->name);
 
 	drmHashDelete(drm->handle_table, bo->handle);
 
+	pthread_mutex_unlock(&table_lock);
+
 	memset(&args, 0, sizeof(args));
 	args.handle = bo->handle;
 
@@ -268,9 +273,12 @@ vg_free:
 
 static void drm_tegra_setup_debug(struct drm_tegra *drm)
 {
-#ifndef NDEBUG
 	char *str;
 
+	str = getenv("LIBDRM_TEGRA_DEBUG_BO_CACHE");
+	drm->debug_bo_cache = (str && strcmp(str, "1") == 0);
+
+#ifndef NDEBUG
 	str = getenv("LIBDRM_TEGRA_DEBUG_BO");
 	drm->debug_bo = (str && strcmp(str, "1") == 0);
 
@@ -351,7 +359,11 @@ void drm_tegra_close(struct drm_tegra *drm)
 	if (!drm)
 		return;
 
+	pthread_mutex_lock(&cache_lock);
+	drm_tegra_bo_cache_dump_stats(drm);
 	drm_tegra_bo_cache_cleanup(drm, 0);
+	pthread_mutex_unlock(&cache_lock);
+
 	drmHashDestroy(drm->handle_table);
 	drmHashDestroy(drm->name_table);
 
@@ -372,9 +384,9 @@ int drm_tegra_bo_new(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 	if (!drm || size == 0 || !bop)
 		return -EINVAL;
 
-	pthread_mutex_lock(&table_lock);
+	pthread_mutex_lock(&cache_lock);
 	bo = drm_tegra_bo_cache_alloc(drm, &size, flags);
-	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_unlock(&cache_lock);
 
 	if (bo) {
 		DBG_BO(bo, "success from cache\n");
@@ -395,7 +407,7 @@ int drm_tegra_bo_new(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 	bo->drm = drm;
 
 	memset(&args, 0, sizeof(args));
-	args.flags = flags;
+	args.flags = flags & ~DRM_TEGRA_BO_GPU_ONLY;
 	args.size = size;
 
 #ifndef NDEBUG
@@ -412,7 +424,9 @@ retry:
 				  sizeof(args));
 	if (err < 0) {
 		if (!retried) {
+			pthread_mutex_lock(&cache_lock);
 			drm_tegra_bo_cache_cleanup(drm, 0);
+			pthread_mutex_unlock(&cache_lock);
 			retried = true;
 			goto retry;
 		}
@@ -443,6 +457,7 @@ retry:
 	drmHashInsert(drm->handle_table, args.handle, bo);
 	pthread_mutex_unlock(&table_lock);
 out:
+	bo->gpu_only = !!(flags & DRM_TEGRA_BO_GPU_ONLY);
 	*bop = bo;
 
 	return 0;
@@ -457,6 +472,7 @@ int drm_tegra_bo_wrap(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 	if (!drm || !bop)
 		return -EINVAL;
 
+	pthread_mutex_lock(&cache_lock);
 	pthread_mutex_lock(&table_lock);
 
 	/* check handle table to see if BO is already open */
@@ -487,6 +503,7 @@ int drm_tegra_bo_wrap(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 	DBG_BO(bo, "success\n");
 unlock:
 	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_unlock(&cache_lock);
 
 	*bop = bo;
 
@@ -518,12 +535,12 @@ int drm_tegra_bo_unref(struct drm_tegra_bo *bo)
 
 	drm_tegra_bo_check_guards(bo);
 
-	pthread_mutex_lock(&table_lock);
+	pthread_mutex_lock(&cache_lock);
 
 	if (!bo->reuse || drm_tegra_bo_cache_free(bo))
 		err = drm_tegra_bo_free(bo);
 
-	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_unlock(&cache_lock);
 
 	return err;
 }
@@ -605,7 +622,7 @@ int drm_tegra_bo_map(struct drm_tegra_bo *bo, void **ptr)
 	if (!bo)
 		return -EINVAL;
 
-	pthread_mutex_lock(&table_lock);
+	pthread_mutex_lock(&cache_lock);
 
 	if (!bo->map) {
 		err = __drm_tegra_bo_map(bo, &bo->map);
@@ -623,7 +640,7 @@ out:
 	if (ptr)
 		*ptr = bo->map;
 
-	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_unlock(&cache_lock);
 
 	return err;
 }
@@ -635,7 +652,7 @@ int drm_tegra_bo_unmap(struct drm_tegra_bo *bo)
 
 	DBG_BO(bo, "\n");
 
-	pthread_mutex_lock(&table_lock);
+	pthread_mutex_lock(&cache_lock);
 
 	if (bo->mmap_ref == 0)
 		goto unlock;
@@ -648,7 +665,7 @@ int drm_tegra_bo_unmap(struct drm_tegra_bo *bo)
 	drm_tegra_bo_cache_unmap(bo);
 	bo->map = NULL;
 unlock:
-	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_unlock(&cache_lock);
 
 	return 0;
 }
@@ -809,6 +826,7 @@ int drm_tegra_bo_from_name(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 	if (!drm || !name || !bop)
 		return -EINVAL;
 
+	pthread_mutex_lock(&cache_lock);
 	pthread_mutex_lock(&table_lock);
 
 	/* check name table first, to see if BO is already open */
@@ -859,6 +877,7 @@ int drm_tegra_bo_from_name(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 
 unlock:
 	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_unlock(&cache_lock);
 
 	*bop = bo;
 
@@ -920,6 +939,7 @@ int drm_tegra_bo_from_dmabuf(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 	if (!drm || !bop)
 		return -EINVAL;
 
+	pthread_mutex_lock(&cache_lock);
 	pthread_mutex_lock(&table_lock);
 
 	bo = calloc(1, sizeof(*bo));
@@ -960,20 +980,23 @@ int drm_tegra_bo_from_dmabuf(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 
 	VG_BO_ALLOC(bo);
 
-	/* add ourself into the handle table: */
-	drmHashInsert(drm->handle_table, handle, bo);
-
-	/* handle lseek() error */
+	/* handle lseek() error, freeing BO takes table_lock */
 	if (err) {
 		VDBG_BO(bo, "lseek failed %d (%s)\n", err, strerror(-err));
+		pthread_mutex_unlock(&table_lock);
 		drm_tegra_bo_free(bo);
 		bo = NULL;
-	} else {
-		DBG_BO(bo, "success\n");
+		goto unlock_cache;
 	}
 
+	/* add ourself into the handle table: */
+	drmHashInsert(drm->handle_table, handle, bo);
+
+	DBG_BO(bo, "success\n");
 unlock:
 	pthread_mutex_unlock(&table_lock);
+unlock_cache:
+	pthread_mutex_unlock(&cache_lock);
 
 	*bop = bo;
 
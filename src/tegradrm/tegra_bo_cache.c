@@ -30,11 +30,21 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "private.h"
 
+/* retention time of cached BOs, in seconds */
+#define BO_CACHE_MIN_RETENTION		2
+#define BO_CACHE_IDLE_RETENTION		10
+#define BO_CACHE_MAX_RETENTION		300
+
+/* default size budget of cached BOs, in megabytes */
+#define BO_CACHE_DEFAULT_SIZE		64
+
 static void
 add_bucket(struct drm_tegra_bo_cache *cache, int size, bool sparse)
 {
@@ -77,6 +87,112 @@ bucket_free_up(struct drm_tegra *drm, struct drm_tegra_bo_bucket *bucket,
 	return false;
 }
 
+static time_t bucket_retention(struct drm_tegra_bo_bucket *bucket)
+{
+	time_t retention;
+
+	/* nothing was reused from this bucket so far, don't hold BOs long */
+	if (!bucket->hits)
+		return BO_CACHE_IDLE_RETENTION;
+
+	/*
+	 * Keep BOs for twice the time they usually wait to be reused,
+	 * anything that stays longer isn't a part of the working set.
+	 */
+	retention = BO_CACHE_MIN_RETENTION +
+		    (bucket->reuse_interval * 2 + 999) / 1000;
+
+	if (retention > BO_CACHE_MAX_RETENTION)
+		retention = BO_CACHE_MAX_RETENTION;
+
+	return retention;
+}
+
+static void bucket_evict(struct drm_tegra *drm,
+			 struct drm_tegra_bo_bucket *bucket,
+			 struct drm_tegra_bo *bo)
+{
+#ifndef NDEBUG
+	uint32_t size;
+#endif
+	VG_BO_OBTAIN(bo);
+#ifndef NDEBUG
+	size = bo->size;
+#endif
+	DRMLISTDEL(&bo->bo_list);
+	drm_tegra_bo_free(bo);
+#ifndef NDEBUG
+	if (drm->debug_bo) {
+		drm->debug_bos_cached--;
+		drm->debug_bos_cached_size -= size;
+	}
+#endif
+	drm->bo_cache.size -= bucket->size;
+	bucket->num_entries--;
+	bucket->evictions++;
+}
+
+/* Evicts BO that stays in cache for the longest time */
+static bool bo_cache_evict_lru(struct drm_tegra *drm)
+{
+	struct drm_tegra_bo_cache *cache = &drm->bo_cache;
+	struct drm_tegra_bo_bucket *bucket, *lru_bucket = NULL;
+	struct drm_tegra_bo *bo, *lru = NULL;
+	int i;
+
+	for (i = 0; i < cache->num_buckets; i++) {
+		bucket = &cache->cache_bucket[i];
+
+		if (DRMLISTEMPTY(&bucket->list))
+			continue;
+
+		/* bucket-list is sorted by the free time */
+		bo = DRMLISTENTRY(struct drm_tegra_bo, bucket->list.next,
+				  bo_list);
+
+		if (!lru || bo->free_time < lru->free_time) {
+			lru_bucket = bucket;
+			lru = bo;
+		}
+	}
+
+	if (!lru)
+		return false;
+
+	bucket_evict(drm, lru_bucket, lru);
+
+	return true;
+}
+
+void drm_tegra_bo_cache_dump_stats(struct drm_tegra *drm)
+{
+	struct drm_tegra_bo_cache *cache = &drm->bo_cache;
+	struct drm_tegra_bo_bucket *bucket;
+	int i;
+
+	if (!drm->debug_bo_cache)
+		return;
+
+	fprintf(stderr, "%s: cached %" PRIu64 "KB of %" PRIu64 "KB\n",
+		__func__, cache->size / 1024, cache->max_size / 1024);
+
+	for (i = 0; i < cache->num_buckets; i++) {
+		bucket = &cache->cache_bucket[i];
+
+		if (!bucket->hits && !bucket->misses && !bucket->evictions)
+			continue;
+
+		fprintf(stderr,
+			"%s:\tbucket %uKB%s: entries %u hits %u misses %u "
+			"evictions %u reuse interval %ums retention %lds\n",
+			__func__, bucket->size / 1024,
+			bucket->sparse ? " sparse" : "",
+			bucket->num_entries, bucket->hits, bucket->misses,
+			bucket->evictions, bucket->reuse_interval,
+			(long)bucket_retention(bucket));
+	}
+}
+
 /**
  * @coarse: if true, only power-of-two bucket sizes, otherwise
  *    fill in for a bit smoother size curve..
@@ -85,6 +201,8 @@ void drm_tegra_bo_cache_init(struct drm_tegra_bo_cache *cache,
 			     bool coarse, bool sparse)
 {
 	unsigned long size, cache_max_size = 64 * 1024 * 1024;
+	int first = cache->num_buckets;
+	char *str;
 
 	/* OK, so power of two buckets was too wasteful of memory.
 	 * Give 3 other sizes between each power of two, to hopefully
@@ -108,17 +226,30 @@ void drm_tegra_bo_cache_init(struct drm_tegra_bo_cache *cache,
 			add_bucket(cache, size + size * 3 / 4, sparse);
 		}
 	}
+
+	/*
+	 * Both sets are laid out identically, contiguous set goes first.
+	 * This lets drm_tegra_get_bucket() calculate the bucket index.
+	 */
+	assert(sparse == (first != 0));
+
+	if (sparse)
+		cache->sparse_offset = first;
+
+	cache->set_size = cache->num_buckets - first;
+	cache->coarse = coarse;
+
+	str = getenv("LIBDRM_TEGRA_BO_CACHE_SIZE_MB");
+	cache->max_size = str ? strtoul(str, NULL, 10) : BO_CACHE_DEFAULT_SIZE;
+	cache->max_size <<= 20;
 }
 
-/* Frees older cached buffers.  Called under table_lock */
+/* Frees older cached buffers.  Called under cache_lock */
 void drm_tegra_bo_cache_cleanup(struct drm_tegra *drm, time_t time)
 {
 	struct drm_tegra_bo_cache *cache = &drm->bo_cache;
-	time_t delta;
+	time_t retention;
 	int i;
-#ifndef NDEBUG
-	uint32_t size;
-#endif
 
 	if (cache->time == time)
 		return;
@@ -130,84 +261,75 @@ void drm_tegra_bo_cache_cleanup(struct drm_tegra *drm, time_t time)
 		if (time && !bucket_free_up(drm, bucket, false))
 			continue;
 
+		retention = bucket_retention(bucket);
+
 		while (!DRMLISTEMPTY(&bucket->list)) {
 			bo = DRMLISTENTRY(struct drm_tegra_bo,
 					bucket->list.next, bo_list);
 
-			delta = time - bo->free_time;
-
-			/* keep things in cache for at least 30 second: */
-			if (time && delta <= 30)
+			if (time && time - bo->free_time <= retention)
 				break;
 
-			/* keep things in cache longer if not much */
-			if (time && delta < 60 && bucket->num_entries < 5)
-				break;
-
-			if (time && delta < 300 &&
-			    bucket->size * bucket->num_entries < 4 * 1024 * 1024)
-				break;
-
-			VG_BO_OBTAIN(bo);
-#ifndef NDEBUG
-			size = bo->size;
-#endif
-			DRMLISTDEL(&bo->bo_list);
-			drm_tegra_bo_free(bo);
-#ifndef NDEBUG
-			if (drm->debug_bo) {
-				drm->debug_bos_cached--;
-				drm->debug_bos_cached_size -= size;
-			}
-#endif
-			bucket->num_entries--;
+			bucket_evict(drm, bucket, bo);
 		}
 	}
 
 	cache->time = time;
+
+	if (time - cache->stats_time >= 10) {
+		drm_tegra_bo_cache_dump_stats(drm);
+		cache->stats_time = time;
+	}
+}
+
+/*
+ * Returns index of the smallest bucket that fits the size, buckets
+ * sizes are laid out by drm_tegra_bo_cache_init().
+ */
+static int bucket_index(struct drm_tegra_bo_cache *cache, uint32_t size)
+{
+	unsigned int first = cache->coarse ? 2 : 3;
+	unsigned int base, order, shift;
+
+	if (size <= 4096 * 2)
+		return size > 4096;
+
+	if (size <= 4096 * 4)
+		return (cache->coarse || size <= 4096 * 3) ? 2 : 3;
+
+	/* size is within (base, base * 2] range */
+	order = 31 - __builtin_clz((size - 1) >> 14);
+	base = 16384 << order;
+
+	if (cache->coarse)
+		return first + order + 1;
+
+	/* size steps are a quarter of the base */
+	shift = 12 + order;
+
+	return first + order * 4 + ((size - base - 1) >> shift) + 1;
 }
 
 struct drm_tegra_bo_bucket *
 drm_tegra_get_bucket(struct drm_tegra *drm, uint32_t size, uint32_t flags)
 {
 	struct drm_tegra_bo_cache *cache = &drm->bo_cache;
-	bool sparse;
-	int i;
+	int i = bucket_index(cache, size);
+
+	if (i >= cache->set_size) {
+		VDBG_DRM(drm, "failed size %u bytes\n",  size);
+		return NULL;
+	}
 
 #ifndef GRATE_KERNEL_DRM_VERSION
 #define GRATE_KERNEL_DRM_VERSION	99991
 #endif
+	/* it's fine to fall back to contiguous bucket */
 	if (drm->version >= GRATE_KERNEL_DRM_VERSION &&
 	    (flags & DRM_TEGRA_GEM_CREATE_SPARSE))
-		sparse = true;
-	else
-		sparse = false;
-
-	/* check sparse bucket first */
-	if (sparse) {
-		for (i = 0; i < cache->num_buckets; i++) {
-			struct drm_tegra_bo_bucket *bucket = &cache->cache_bucket[i];
-			if (bucket->size >= size && bucket->sparse == true) {
-				return bucket;
-			}
-		}
-	}
-
-	/* it's fine to fall back to contiguous bucket */
+		i += cache->sparse_offset;
 
-	/* hmm, this is what intel does, but I suppose we could calculate our
-	 * way to the correct bucket size rather than looping..
-	 */
-	for (i = 0; i < cache->num_buckets; i++) {
-		struct drm_tegra_bo_bucket *bucket = &cache->cache_bucket[i];
-		if (bucket->size >= size && bucket->sparse == false) {
-			return bucket;
-		}
-	}
-
-	VDBG_DRM(drm, "failed size %u bytes\n",  size);
-
-	return NULL;
+	return &cache->cache_bucket[i];
 }
 
 static struct drm_tegra_bo_bucket * bo_bucket(struct drm_tegra_bo *bo)
@@ -228,31 +350,74 @@ static bool is_idle(struct drm_tegra_bo *bo)
 	return ret;
 }
 
-static struct drm_tegra_bo *find_in_bucket(struct drm_tegra_bo_bucket *bucket,
+static void bucket_remove(struct drm_tegra_bo_cache *cache,
+			  struct drm_tegra_bo_bucket *bucket,
+			  struct drm_tegra_bo *bo)
+{
+	DRMLISTDELINIT(&bo->bo_list);
+	cache->size -= bucket->size;
+	bucket->num_entries--;
+}
+
+/* Takes BO out of the bucket.  Called under cache_lock */
+void drm_tegra_bo_cache_remove(struct drm_tegra_bo *bo)
+{
+	bucket_remove(&bo->drm->bo_cache, bo_bucket(bo), bo);
+}
+
+static struct drm_tegra_bo *find_in_bucket(struct drm_tegra *drm,
+					   struct drm_tegra_bo_bucket *bucket,
 					   uint32_t flags)
 {
 	struct drm_tegra_bo *bo = NULL;
+	struct timespec time;
+	time_t delta;
 
-	/* TODO .. if we had an ALLOC_FOR_RENDER flag like intel, we could
-	 * skip the busy check.. if it is only going to be a render target
-	 * then we probably don't need to stall..
-	 *
-	 * NOTE that intel takes ALLOC_FOR_RENDER bo's from the list tail
-	 * (MRU, since likely to be in GPU cache), rather than head (LRU)..
-	 */
 	if (!DRMLISTEMPTY(&bucket->list)) {
-		bo = DRMLISTENTRY(struct drm_tegra_bo, bucket->list.next,
-				  bo_list);
+		/*
+		 * GPU-only BO is handed to hardware straight away, take the
+		 * most recently freed one (like intel does for ALLOC_FOR_RENDER)
+		 * to let the older ones expire. It's known to be idle only if
+		 * the previous owner was GPU-only too, BOs of pixbufs may be
+		 * freed while GR2D/GR3D jobs are still using them.
+		 */
+		if (flags & DRM_TEGRA_BO_GPU_ONLY) {
+			bo = DRMLISTENTRY(struct drm_tegra_bo,
+					  bucket->list.prev, bo_list);
+			if (!bo->gpu_only)
+				bo = NULL;
+		}
 
-		/* TODO check for compatible flags? */
-		if (is_idle(bo)) {
-			DRMLISTDELINIT(&bo->bo_list);
-			bucket->num_entries--;
-		} else {
-			bo = NULL;
+		/* otherwise take the least recently freed, most likely idle */
+		if (!bo) {
+			bo = DRMLISTENTRY(struct drm_tegra_bo,
+					  bucket->list.next, bo_list);
+
+			/* TODO check for compatible flags? */
+			if (!is_idle(bo))
+				bo = NULL;
 		}
+
+		if (bo)
+			bucket_remove(&drm->bo_cache, bucket, bo);
+	}
+
+	if (!bo) {
+		bucket->misses++;
+		return NULL;
 	}
 
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	delta = time.tv_sec - bo->free_time;
+
+	/*
+	 * Running average of the time BO waits to be reused. It's kept in
+	 * milliseconds, whole seconds would truncate short intervals to 0.
+	 */
+	bucket->reuse_interval = (bucket->reuse_interval * 3 +
+				  delta * 1000) / 4;
+	bucket->hits++;
+
 	return bo;
 }
 
@@ -305,7 +470,7 @@ drm_tegra_bo_cache_alloc(struct drm_tegra *drm,
 	/* see if we can be green and recycle: */
 	if (bucket) {
 		*size = bucket->size;
-		bo = find_in_bucket(bucket, flags);
+		bo = find_in_bucket(drm, bucket, flags);
 		if (bo) {
 			drm_tegra_reset_bo(bo, flags, false);
 
@@ -330,6 +495,7 @@ drm_tegra_bo_cache_alloc(struct drm_tegra *drm,
 int drm_tegra_bo_cache_free(struct drm_tegra_bo *bo)
 {
 	struct drm_tegra *drm = bo->drm;
+	struct drm_tegra_bo_cache *cache = &drm->bo_cache;
 	struct drm_tegra_bo_bucket *bucket;
 	uint32_t size = bo->size;
 
@@ -358,6 +524,12 @@ int drm_tegra_bo_cache_free(struct drm_tegra_bo *bo)
 		}
 #endif
 		bucket->num_entries++;
+		cache->size += bucket->size;
+
+		/* stay within budget by evicting the oldest BOs */
+		while (cache->size > cache->max_size)
+			if (!bo_cache_evict_lru(drm))
+				break;
 
 		return 0;
 	}
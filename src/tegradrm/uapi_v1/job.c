@@ -34,19 +34,40 @@
 
 #include "uapi_v1.h"
 
-int drm_tegra_job_add_reloc(struct drm_tegra_job *job,
-			    const struct drm_tegra_reloc *reloc)
+static int drm_tegra_job_grow(void **array, unsigned int *max,
+			      size_t entry_size, unsigned int count)
 {
-	struct drm_tegra_reloc *relocs;
-	size_t size;
+	void *entries;
+
+	if (count <= *max)
+		return 0;
 
-	size = (job->num_relocs + 1) * sizeof(*reloc);
+	/* grow geometrically to keep amount of reallocations low */
+	if (count < *max * 2)
+		count = *max * 2;
 
-	relocs = realloc(job->relocs, size);
-	if (!relocs)
+	if (count < 8)
+		count = 8;
+
+	entries = realloc(*array, count * entry_size);
+	if (!entries)
 		return -ENOMEM;
 
-	job->relocs = relocs;
+	*array = entries;
+	*max = count;
+
+	return 0;
+}
+
+int drm_tegra_job_add_reloc(struct drm_tegra_job *job,
+			    const struct drm_tegra_reloc *reloc)
+{
+	int err;
+
+	err = drm_tegra_job_grow((void **)&job->relocs, &job->max_relocs,
+				 sizeof(*reloc), job->num_relocs + 1);
+	if (err < 0)
+		return err;
 
 	job->relocs[job->num_relocs++] = *reloc;
 
@@ -56,17 +77,14 @@ int drm_tegra_job_add_reloc(struct drm_tegra_job *job,
 int drm_tegra_job_add_cmdbuf(struct drm_tegra_job *job,
 			     const struct drm_tegra_cmdbuf *cmdbuf)
 {
-	struct drm_tegra_cmdbuf *cmdbufs;
-	size_t size;
-
-	size = (job->num_cmdbufs + 1) * sizeof(*cmdbuf);
+	int err;
 
-	cmdbufs = realloc(job->cmdbufs, size);
-	if (!cmdbufs)
-		return -ENOMEM;
+	err = drm_tegra_job_grow((void **)&job->cmdbufs, &job->max_cmdbufs,
+				 sizeof(*cmdbuf), job->num_cmdbufs + 1);
+	if (err < 0)
+		return err;
 
-	cmdbufs[job->num_cmdbufs++] = *cmdbuf;
-	job->cmdbufs = cmdbufs;
+	job->cmdbufs[job->num_cmdbufs++] = *cmdbuf;
 
 	return 0;
 }
@@ -110,12 +128,130 @@ int drm_tegra_job_free(struct drm_tegra_job *job)
 	return 0;
 }
 
+/*
+ * Prepares job for the next submission, keeping allocated tables and
+ * pushbufs.  Command buffer BO is reused if @idle is true, i.e. hardware
+ * is done with the previous submission, otherwise it is released.
+ */
+int drm_tegra_job_reset(struct drm_tegra_job *job, bool idle)
+{
+	struct drm_tegra_pushbuf_private *pushbuf;
+	int err;
+
+	if (!job)
+		return -EINVAL;
+
+	job->pushbuf = NULL;
+	job->num_cmdbufs = 0;
+	job->num_relocs = 0;
+	job->increments = 0;
+
+	DRMLISTFOREACHENTRY(pushbuf, &job->pushbufs, list) {
+		err = drm_tegra_pushbuf_reset(pushbuf, idle);
+		if (err < 0)
+			return err;
+
+		job->pushbuf = pushbuf;
+	}
+
+	return 0;
+}
+
+int drm_tegra_job_reserve(struct drm_tegra_job *job, unsigned int num_relocs)
+{
+	if (!job)
+		return -EINVAL;
+
+	return drm_tegra_job_grow((void **)&job->relocs, &job->max_relocs,
+				  sizeof(*job->relocs), num_relocs);
+}
+
+/* Returns size of the submitted job */
+int drm_tegra_job_get_size(struct drm_tegra_job *job, unsigned int *words,
+			   unsigned int *relocs)
+{
+	unsigned int i;
+
+	if (!job || !words || !relocs)
+		return -EINVAL;
+
+	*words = 0;
+	*relocs = job->num_relocs;
+
+	for (i = 0; i < job->num_cmdbufs; i++)
+		*words += job->cmdbufs[i].words;
+
+	return 0;
+}
+
+static struct drm_tegra_bo *drm_tegra_job_find_bo(struct drm_tegra_job *job,
+						  uint32_t handle)
+{
+	struct drm_tegra_pushbuf_private *pushbuf;
+	struct drm_tegra_bo *bo;
+
+	DRMLISTFOREACHENTRY(pushbuf, &job->pushbufs, list) {
+		DRMLISTFOREACHENTRY(bo, &pushbuf->bos, push_list) {
+			if (bo->handle == handle)
+				return bo;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Copies words of the submitted job and the word indices of its
+ * relocations, arrays are sized by drm_tegra_job_get_size().
+ */
+int drm_tegra_job_read(struct drm_tegra_job *job, uint32_t *words,
+		       uint32_t *reloc_words)
+{
+	const struct drm_tegra_cmdbuf *cmdbuf;
+	struct drm_tegra_bo *bo;
+	unsigned int i, k, pos = 0;
+	void *ptr;
+	int err;
+
+	if (!job || !words || !reloc_words)
+		return -EINVAL;
+
+	for (i = 0; i < job->num_cmdbufs; i++) {
+		cmdbuf = &job->cmdbufs[i];
+
+		bo = drm_tegra_job_find_bo(job, cmdbuf->handle);
+		if (!bo)
+			return -ENOENT;
+
+		err = drm_tegra_bo_map(bo, &ptr);
+		if (err < 0)
+			return err;
+
+		memcpy(words + pos, (uint8_t *)ptr + cmdbuf->offset,
+		       cmdbuf->words * sizeof(uint32_t));
+
+		drm_tegra_bo_unmap(bo);
+
+		for (k = 0; k < job->num_relocs; k++) {
+			if (job->relocs[k].cmdbuf.handle != cmdbuf->handle)
+				continue;
+
+			reloc_words[k] = pos + (job->relocs[k].cmdbuf.offset -
+						cmdbuf->offset) / sizeof(uint32_t);
+		}
+
+		pos += cmdbuf->words;
+	}
+
+	return 0;
+}
+
 int drm_tegra_job_submit(struct drm_tegra_job *job,
 			 struct drm_tegra_fence **fencep)
 {
 	struct drm_tegra *drm;
 	struct drm_tegra_fence *fence = NULL;
-	struct drm_tegra_syncpt *syncpts;
+	struct drm_tegra_syncpt syncpt;
 	struct drm_tegra_submit args;
 	int err;
 
@@ -138,14 +274,9 @@ int drm_tegra_job_submit(struct drm_tegra_job *job,
 			return -ENOMEM;
 	}
 
-	syncpts = calloc(1, sizeof(*syncpts));
-	if (!syncpts) {
-		free(fence);
-		return -ENOMEM;
-	}
-
-	syncpts[0].id = job->syncpt;
-	syncpts[0].incrs = job->increments;
+	memset(&syncpt, 0, sizeof(syncpt));
+	syncpt.id = job->syncpt;
+	syncpt.incrs = job->increments;
 
 	memset(&args, 0, sizeof(args));
 	args.context = job->channel->context;
@@ -156,7 +287,7 @@ int drm_tegra_job_submit(struct drm_tegra_job *job,
 	args.waitchk_mask = 0;
 	args.timeout = 1000;
 
-	args.syncpts = (uintptr_t)syncpts;
+	args.syncpts = (uintptr_t)&syncpt;
 	args.cmdbufs = (uintptr_t)job->cmdbufs;
 	args.relocs = (uintptr_t)job->relocs;
 	args.waitchks = 0;
@@ -165,7 +296,6 @@ int drm_tegra_job_submit(struct drm_tegra_job *job,
 	err = drmCommandWriteRead(drm->fd, DRM_TEGRA_SUBMIT, &args,
 				  sizeof(args));
 	if (err < 0) {
-		free(syncpts);
 		free(fence);
 		return err;
 	}
@@ -177,7 +307,5 @@ int drm_tegra_job_submit(struct drm_tegra_job *job,
 		*fencep = fence;
 	}
 
-	free(syncpts);
-
 	return 0;
 }
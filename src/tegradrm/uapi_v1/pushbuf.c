@@ -117,6 +117,50 @@ int drm_tegra_pushbuf_free(struct drm_tegra_pushbuf *pushbuf)
 	return 0;
 }
 
+/* Releases command buffers of the previous job, keeping the latest if @idle */
+int drm_tegra_pushbuf_reset(struct drm_tegra_pushbuf_private *pushbuf,
+			    bool idle)
+{
+	struct drm_tegra_bo *bo, *tmp, *keep = NULL;
+	void *ptr;
+	int err;
+
+	/* buffer stays mapped if job wasn't submitted */
+	if (pushbuf->bo) {
+		drm_tegra_bo_unmap(pushbuf->bo);
+		pushbuf->bo = NULL;
+	}
+
+	/* the most recently allocated buffer is at the list head */
+	if (idle && !DRMLISTEMPTY(&pushbuf->bos))
+		keep = DRMLISTENTRY(struct drm_tegra_bo, pushbuf->bos.next,
+				    push_list);
+
+	DRMLISTFOREACHENTRYSAFE(bo, tmp, &pushbuf->bos, push_list) {
+		if (bo == keep)
+			continue;
+
+		DRMLISTDELINIT(&bo->push_list);
+		drm_tegra_bo_unref(bo);
+	}
+
+	if (!keep)
+		return 0;
+
+	err = drm_tegra_bo_map(keep, &ptr);
+	if (err < 0) {
+		DRMLISTDELINIT(&keep->push_list);
+		drm_tegra_bo_unref(keep);
+		return err;
+	}
+
+	pushbuf->start = pushbuf->base.ptr = ptr;
+	pushbuf->end = pushbuf->start + keep->size / sizeof(uint32_t);
+	pushbuf->bo = keep;
+
+	return 0;
+}
+
 /**
  * drm_tegra_pushbuf_prepare() - prepare push buffer for a series of pushes
  * @pushbuf: push buffer
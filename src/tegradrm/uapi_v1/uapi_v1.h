@@ -58,6 +58,8 @@ drm_tegra_pushbuf(struct drm_tegra_pushbuf *pb)
 }
 
 int drm_tegra_pushbuf_queue(struct drm_tegra_pushbuf_private *pushbuf);
+int drm_tegra_pushbuf_reset(struct drm_tegra_pushbuf_private *pushbuf,
+			    bool idle);
 
 struct drm_tegra_job {
 	struct drm_tegra_channel *channel;
@@ -67,9 +69,11 @@ struct drm_tegra_job {
 
 	struct drm_tegra_reloc *relocs;
 	unsigned int num_relocs;
+	unsigned int max_relocs;
 
 	struct drm_tegra_cmdbuf *cmdbufs;
 	unsigned int num_cmdbufs;
+	unsigned int max_cmdbufs;
 
 	struct drm_tegra_pushbuf_private *pushbuf;
 	drmMMListHead pushbufs;
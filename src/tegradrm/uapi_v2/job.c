@@ -169,7 +169,7 @@ int drm_tegra_job_push_reloc_v2(struct drm_tegra_job_v2 *job,
 	if (i == job->num_bos) {
 		if (job->num_bos == job->num_bos_max) {
 			err = drm_tegra_job_resize_v2(
-				job, job->num_words, job->num_bos_max + 8, true);
+				job, job->num_words, job->num_bos_max * 2, true);
 			if (err)
 				return err;
 		}
@@ -186,7 +186,7 @@ int drm_tegra_job_push_reloc_v2(struct drm_tegra_job_v2 *job,
 
 	if (offset == job->num_words) {
 		err = drm_tegra_job_resize_v2(
-			job, job->num_words + 256, job->num_bos_max, true);
+			job, job->num_words * 2, job->num_bos_max, true);
 		if (err)
 			return err;
 	}
@@ -131,50 +131,60 @@ bool tegra_check_xv_atom(tegra_device *dev, char const *atom_name)
     return i < count;
 }
 
-static bool __tegra_xv_apply_csc(tegra_device *dev, tegra_csc *csc)
+static bool tegra_xv_set_csc_word(tegra_device *dev, Atom atom,
+                                  const char *name,
+                                  uint32_t old, uint32_t val)
 {
-    int32_t val, ret;
-
-    if (dev->xv_csc.applied) {
-        if (memcmp(&dev->xv_csc.old.xv, &csc->xv, sizeof(csc->xv)) == 0) {
-            return true;
-        }
-    }
+    int ret;
 
-    dev->xv_csc.applied = false;
+    if (dev->xv_csc.applied && old == val)
+        return true;
 
-    ret = XvSetPortAttribute(dev->display, dev->xv_port,
-                             dev->xv_csc.xvCSC_YOF_KYRGB,
-                             csc->xv.yof_kyrgb);
+    ret = XvSetPortAttribute(dev->display, dev->xv_port, atom, val);
     if (ret != Success) {
-        ErrorMsg("failed to set XV_TEGRA_YOF_KYRGB %d\n", ret);
+        ErrorMsg("failed to set %s %d\n", name, ret);
         return false;
     }
 
-    ret = XvSetPortAttribute(dev->display, dev->xv_port,
-                             dev->xv_csc.xvCSC_KUR_KVR,
-                             csc->xv.kur_kvr);
-    if (ret != Success) {
-        ErrorMsg("failed to set XV_TEGRA_KUR_KVR %d\n", ret);
-        return false;
-    }
+    return true;
+}
 
-    ret = XvSetPortAttribute(dev->display, dev->xv_port,
-                             dev->xv_csc.xvCSC_KUG_KVG,
-                             csc->xv.kug_kvg);
-    if (ret != Success) {
-        ErrorMsg("failed to set XV_TEGRA_KUG_KVG %d\n", ret);
-        return false;
+/*
+ * Only the changed coefficients are sent, requests are asynchronous and
+ * go out with the next flush, together with the frame. Driver support is
+ * verified by reading back the update property only once on init.
+ */
+static bool __tegra_xv_apply_csc(tegra_device *dev, tegra_csc *csc,
+                                 bool verify)
+{
+    struct xv_csc *old = &dev->xv_csc.old.xv;
+    int32_t val, ret;
+
+    if (dev->xv_csc.applied) {
+        if (memcmp(old, &csc->xv, sizeof(csc->xv)) == 0) {
+            return true;
+        }
     }
 
-    ret = XvSetPortAttribute(dev->display, dev->xv_port,
-                             dev->xv_csc.xvCSC_KUB_KVB,
-                             csc->xv.kub_kvb);
-    if (ret != Success) {
-        ErrorMsg("failed to set XV_TEGRA_KUB_KVB %d\n", ret);
+    if (!tegra_xv_set_csc_word(dev, dev->xv_csc.xvCSC_YOF_KYRGB,
+                               "XV_TEGRA_YOF_KYRGB",
+                               old->yof_kyrgb, csc->xv.yof_kyrgb) ||
+        !tegra_xv_set_csc_word(dev, dev->xv_csc.xvCSC_KUR_KVR,
+                               "XV_TEGRA_KUR_KVR",
+                               old->kur_kvr, csc->xv.kur_kvr) ||
+        !tegra_xv_set_csc_word(dev, dev->xv_csc.xvCSC_KUG_KVG,
+                               "XV_TEGRA_KUG_KVG",
+                               old->kug_kvg, csc->xv.kug_kvg) ||
+        !tegra_xv_set_csc_word(dev, dev->xv_csc.xvCSC_KUB_KVB,
+                               "XV_TEGRA_KUB_KVB",
+                               old->kub_kvb, csc->xv.kub_kvb))
+    {
+        dev->xv_csc.applied = false;
         return false;
     }
 
+    dev->xv_csc.applied = false;
+
     ret = XvSetPortAttribute(dev->display, dev->xv_port,
                              dev->xv_csc.xvCSC_update,
                              1);
@@ -184,12 +194,15 @@ static bool __tegra_xv_apply_csc(tegra_device *dev, tegra_csc *csc)
         return false;
     }
 
-    ret = XvGetPortAttribute(dev->display, dev->xv_port,
-                             dev->xv_csc.xvCSC_update, &val);
-    if (ret != Success || !val) {
-        ErrorMsg("failed to get XV_TEGRA_CSC_UPDATE %d val %d\n", ret, val);
-        dev->xv_csc.ready = false;
-        return false;
+    if (verify) {
+        ret = XvGetPortAttribute(dev->display, dev->xv_port,
+                                 dev->xv_csc.xvCSC_update, &val);
+        if (ret != Success || !val) {
+            ErrorMsg("failed to get XV_TEGRA_CSC_UPDATE %d val %d\n",
+                     ret, val);
+            dev->xv_csc.ready = false;
+            return false;
+        }
     }
 
     dev->xv_csc.old.xv = csc->xv;
@@ -242,7 +255,8 @@ bool tegra_xv_initialize_csc(tegra_device *dev)
                 },
             };
 
-            dev->xv_csc.ready = __tegra_xv_apply_csc(dev, &default_csc);
+            dev->xv_csc.ready = __tegra_xv_apply_csc(dev, &default_csc,
+                                                     true);
         }
 
         if (!dev->xv_csc.ready) {
@@ -270,7 +284,7 @@ bool tegra_xv_apply_csc(tegra_device *dev, tegra_csc *csc)
 
     pthread_mutex_lock(&xv_lock);
     if (dev->xv_csc.ready) {
-        ret = __tegra_xv_apply_csc(dev, csc);
+        ret = __tegra_xv_apply_csc(dev, csc, false);
     }
     pthread_mutex_unlock(&xv_lock);
 
@@ -789,6 +803,87 @@ VdpStatus vdp_preemption_callback_register(VdpDevice device,
     return VDP_STATUS_OK;
 }
 
+static struct tegra_stream_pool *
+stream_pool(tegra_device *dev, struct drm_tegra_channel *channel)
+{
+    return channel == dev->gr2d ? &dev->gr2d_streams : &dev->gr3d_streams;
+}
+
+void tegra_stream_pool_init(tegra_device *dev)
+{
+    pthread_mutex_init(&dev->gr3d_streams.lock, NULL);
+    pthread_mutex_init(&dev->gr2d_streams.lock, NULL);
+    dev->gr3d_streams.count = 0;
+    dev->gr2d_streams.count = 0;
+}
+
+static void stream_pool_release(struct tegra_stream_pool *pool)
+{
+    while (pool->count)
+        tegra_stream_destroy(pool->streams[--pool->count]);
+
+    pthread_mutex_destroy(&pool->lock);
+}
+
+void tegra_stream_pool_release(tegra_device *dev)
+{
+    stream_pool_release(&dev->gr3d_streams);
+    stream_pool_release(&dev->gr2d_streams);
+}
+
+/*
+ * Streams are shared by all surfaces and bound to an operation for its
+ * duration. Jobs are submitted without waiting, jobs of one engine are
+ * executed in order and dependencies between the engines are tracked by
+ * the fences of the pixbufs, hence any pooled stream may take the next job.
+ */
+struct tegra_stream *tegra_stream_pool_get(tegra_device *dev,
+                                           struct drm_tegra_channel *channel)
+{
+    struct tegra_stream_pool *pool = stream_pool(dev, channel);
+    struct tegra_stream *stream = NULL;
+    int ret;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count)
+        stream = pool->streams[--pool->count];
+    pthread_mutex_unlock(&pool->lock);
+
+    if (stream)
+        return stream;
+
+    ret = tegra_stream_create(&stream, dev, channel);
+    if (ret) {
+        ErrorMsg("failed to create stream %d\n", ret);
+        return NULL;
+    }
+
+    return stream;
+}
+
+void tegra_stream_pool_put(tegra_device *dev, struct tegra_stream *stream)
+{
+    struct tegra_stream_pool *pool;
+
+    if (!stream)
+        return;
+
+    /* drop a job left behind by a failed operation */
+    if (stream->status != TEGRADRM_STREAM_FREE)
+        tegra_stream_cleanup(stream);
+
+    pool = stream_pool(dev, stream->channel);
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count < STREAM_POOL_SIZE) {
+        pool->streams[pool->count++] = stream;
+        stream = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    tegra_stream_destroy(stream);
+}
+
 void ref_device(tegra_device *dev)
 {
     atomic_inc(&dev->refcnt);
@@ -805,7 +900,11 @@ VdpStatus unref_device(tegra_device *dev)
         XvUngrabPort(dev->display, dev->xv_port, CurrentTime);
     }
 
+    engine_stats_dump();
+    tegra_x11_events_release(dev);
     deinit_v4l2(dev);
+    tegra_scratch_pool_release(dev);
+    tegra_stream_pool_release(dev);
     drm_tegra_channel_close(dev->gr3d);
     drm_tegra_channel_close(dev->gr2d);
     drm_tegra_close(dev->drm);
@@ -982,6 +1081,21 @@ EXPORTED VdpStatus vdp_imp_device_create_x11(Display *display,
         tegra_vdpau_force_dri = true;
     }
 
+    env_str = getenv("VDPAU_TEGRA_CAPTURE");
+    if (env_str && env_str[0]) {
+        host1x_capture_open(env_str);
+    }
+
+    env_str = getenv("VDPAU_TEGRA_ENGINE_STATS");
+    if (env_str && strcmp(env_str, "0")) {
+        engine_stats_init(env_str);
+    }
+
+    env_str = getenv("VDPAU_TEGRA_PRESENT_STATS");
+    if (env_str && strcmp(env_str, "0")) {
+        presentation_stats_init(env_str);
+    }
+
     drm_fd = drmOpen("tegra", "drm");
     if (drm_fd < 0) {
         perror("Failed to open tegra DRM\n");
@@ -1059,8 +1173,14 @@ EXPORTED VdpStatus vdp_imp_device_create_x11(Display *display,
     tegra_devices[i]->gr2d = gr2d;
     tegra_devices[i]->drm = drm;
 
+    tegra_scratch_pool_init(tegra_devices[i]);
+    tegra_stream_pool_init(tegra_devices[i]);
+    tegra_x11_events_init(tegra_devices[i]);
+
     if (initialize_xv(display, tegra_devices[i]) != Success) {
         if (dri_failed) {
+            tegra_scratch_pool_release(tegra_devices[i]);
+            tegra_stream_pool_release(tegra_devices[i]);
             free(tegra_devices[i]);
             tegra_devices[i] = NULL;
             goto err_cleanup;
@@ -35,6 +35,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/poll.h>
 #include <sys/mman.h>
@@ -69,6 +70,7 @@
 #include "shaders/prog.h"
 #include "host1x.h"
 #include "host1x-api.h"
+#include "host1x-capture.h"
 #include "tgr_3d.xml.h"
 #include "util_double_list.h"
 #include "uapi/dma-buf.h"
@@ -95,6 +97,7 @@
 #define MAX_PRESENTATION_QUEUES_NB          128
 #define MAX_V4L2_BUFFERS                    24
 #define MIN_V4L2_BUFFERS                    17
+#define STREAM_POOL_SIZE                    4
 
 #define SURFACE_VIDEO               (1 << 0)
 #define SURFACE_OUTPUT              (1 << 1)
@@ -180,14 +183,12 @@ extern bool tegra_vdpau_debug;
 extern bool tegra_vdpau_force_xv;
 extern bool tegra_vdpau_force_dri;
 extern bool tegra_vdpau_dri_xv_autoswitch;
+extern bool tegra_vdpau_engine_stats;
+extern bool tegra_vdpau_present_stats;
 
 extern VdpCSCMatrix CSC_BT_601;
 extern VdpCSCMatrix CSC_BT_709;
 
-typedef struct {
-    int atomic;
-} atomic_t;
-
 extern pthread_mutex_t global_lock;
 
 typedef struct tegra_csc {
@@ -221,12 +222,15 @@ typedef struct tegra_device {
     struct drm_tegra *drm;
     struct drm_tegra_channel *gr3d;
     struct drm_tegra_channel *gr2d;
+    struct tegra_stream_hwm gr3d_hwm;
+    struct tegra_stream_hwm gr2d_hwm;
     Display *display;
     XvPortID xv_port;
     atomic_t refcnt;
     unsigned int surf_id_itr;
     bool dri2_inited;
     bool dri2_ready;
+    bool dri2_events;
     bool xv_ready;
     bool xv_v2;
     bool disp_composited;
@@ -249,7 +253,29 @@ typedef struct tegra_device {
         bool ready;
     } xv_csc;
 
+    struct tegra_scratch_pool {
+        pthread_mutex_t lock;
+        struct list_head list;
+        unsigned int count;
+    } scratch_pool;
+
+    struct tegra_stream_pool {
+        pthread_mutex_t lock;
+        struct tegra_stream *streams[STREAM_POOL_SIZE];
+        unsigned int count;
+    } gr3d_streams, gr2d_streams;
+
     tegra_device_v4l2 v4l2;
+
+    struct tegra_x11_events {
+        pthread_mutex_t lock;
+        pthread_t thread;
+        Display *display;
+        struct list_head targets;
+        int wake_fd;
+        bool running;
+        bool exit;
+    } x11_events;
 } tegra_device;
 
 struct tegra_surface;
@@ -271,8 +297,6 @@ typedef struct tegra_surface_v4l2 {
 
 typedef struct tegra_surface {
     tegra_device *dev;
-    struct tegra_stream *stream_3d;
-    struct tegra_stream *stream_2d;
 
     bool detached;
     bool destroyed;
@@ -309,7 +333,6 @@ typedef struct tegra_surface {
     VdpTime earliest_presentation_time;
 
     atomic_t refcnt;
-    struct list_head list_item;
     pthread_cond_t idle_cond;
     pthread_mutex_t lock;
 
@@ -379,14 +402,52 @@ struct tegra_pqt_bg_state {
     bool shared;
 };
 
+enum tegra_pqt_path {
+    TEGRA_PQT_PATH_NONE,
+    TEGRA_PQT_PATH_XV_YUV,
+    TEGRA_PQT_PATH_XV_RGB,
+    TEGRA_PQT_PATH_DRI,
+    TEGRA_PQT_PATHS_NB,
+};
+
+/* phases of the display path, timed for presentation statistics */
+enum tegra_pqt_phase {
+    TEGRA_PQT_PHASE_BLIT,
+    TEGRA_PQT_PHASE_PUT,
+    TEGRA_PQT_PHASE_VBLANK,
+    TEGRA_PQT_PHASES_NB,
+};
+
+/* counters of vblank sequence, they aren't in sync with each other */
+enum tegra_pqt_vblank_src {
+    TEGRA_PQT_VBLANK_KMS,
+    TEGRA_PQT_VBLANK_DRI2,
+    TEGRA_PQT_VBLANK_SRCS_NB,
+};
+
+#define TEGRA_PQT_DRI_BUFFERS_NB    3
+
+struct tegra_pqt_dri_buffer {
+    uint32_t name;
+    uint64_t last_use;
+    uint64_t swap_sbc;
+    struct host1x_pixelbuffer *pixbuf;
+    tegra_surface *prep_surf;
+};
+
 typedef struct tegra_pqt {
     tegra_device *dev;
     tegra_surface *disp_surf;
-    struct host1x_pixelbuffer *dri_pixbuf;
+    struct tegra_pqt_dri_buffer dri_bufs[TEGRA_PQT_DRI_BUFFERS_NB];
+    struct tegra_pqt_dri_buffer *dri_back;
+    uint64_t dri_use_cnt;
+    uint64_t dri_sbc_done;
+    bool dri_invalidated;
+    struct list_head dri2_events_entry;
     Drawable drawable;
     GC gc;
     atomic_t refcnt;
-    pthread_t x11_thread;
+    struct list_head x11_events_entry;
     pthread_t disp_thread;
     pthread_cond_t disp_cond;
     pthread_mutex_t disp_lock;
@@ -396,19 +457,71 @@ typedef struct tegra_pqt {
     bool overlapped_current;
     bool overlapped_new;
     bool win_move;
+    bool x11_events_watched;
+    int win_x, win_y;
+    VdpTime overlap_change_time;
+    VdpTime last_transit_time;
+    VdpTime xv_holdoff;
+    VdpTime dri_release_time;
+    enum tegra_pqt_path last_path;
+    VdpTime last_phase[TEGRA_PQT_PHASES_NB];
+    bool last_vblank_waited;
     bool exit;
-    tegra_surface *dri_prep_surf;
     Atom xv_ckey_atom;
     struct tegra_pqt_bg_state bg_old_state;
     struct tegra_pqt_bg_state bg_new_state;
     enum tegra_pqt_display disp_state;
+    VdpTime vblank_time;
+    VdpTime vblank_period;
+    VdpTime vblank_ref_time[TEGRA_PQT_VBLANK_SRCS_NB];
+    uint64_t vblank_ref_seq[TEGRA_PQT_VBLANK_SRCS_NB];
+    int vblank_fd;
+    unsigned int crtc_pipe;
+    TegraXvVdpauInfo xv_info;
+    VdpTime xv_info_time;
+    bool xv_info_valid;
+    tegra_surface *vblank_surf;
+    VdpTime vblank_scanout_time;
 } tegra_pqt;
 
+struct tegra_pq_entry {
+    VdpTime time;
+    uint64_t seqno;
+    tegra_surface *surf;
+};
+
+#define TEGRA_PQ_STATS_BUCKETS  9
+
+struct tegra_pq_stats {
+    VdpTime period_start;
+    unsigned long long queued;
+    unsigned long long presented;
+    unsigned long long skipped;
+    unsigned long long late;
+    unsigned long long path[TEGRA_PQT_PATHS_NB];
+    /* histograms of power-of-two milliseconds buckets */
+    unsigned int lateness[TEGRA_PQ_STATS_BUCKETS];
+    unsigned int latency[TEGRA_PQT_PHASES_NB][TEGRA_PQ_STATS_BUCKETS];
+    VdpTime lateness_sum;
+    VdpTime lateness_max;
+    unsigned long long lateness_cnt;
+    VdpTime latency_sum[TEGRA_PQT_PHASES_NB];
+    VdpTime latency_max[TEGRA_PQT_PHASES_NB];
+    /* deadline of the frame waiting for its vblank event */
+    VdpTime pending_earliest;
+};
+
 typedef struct tegra_pq {
+    unsigned int id;
     tegra_pqt *pqt;
-    struct list_head surf_list;
+    int wake_fd;
+    struct tegra_pq_entry *heap;
+    unsigned int heap_len;
+    unsigned int heap_size;
+    uint64_t seqno;
+    VdpTime latest_time;
+    struct tegra_pq_stats stats;
     pthread_mutex_t lock;
-    pthread_cond_t cond;
     pthread_t disp_thread;
     atomic_t refcnt;
     bool exit;
@@ -471,12 +584,28 @@ void set_presentation_queue_target(VdpPresentationQueueTarget target,
 void pqt_display_surface_to_idle_state(tegra_pqt *pqt);
 void pqt_display_surface(tegra_pqt *pqt, tegra_surface *surf,
                          bool update_status, bool transit, bool vsync);
-void pqt_prepare_dri_surface(tegra_pqt *pqt, tegra_surface *surf);
+void pqt_prepare_dri_surfaces(tegra_pqt *pqt, tegra_surface *next,
+                              tegra_surface *after);
+void pqt_unprepare_dri_surface(tegra_pqt *pqt, tegra_surface *surf);
+VdpTime pqt_predict_vblank(tegra_pqt *pqt, VdpTime time);
+VdpTime pqt_frame_deadline(tegra_pqt *pqt, VdpTime earliest_time);
+VdpTime pqt_handle_vblank_events(tegra_pqt *pqt);
+void tegra_x11_events_init(tegra_device *dev);
+void tegra_x11_events_release(tegra_device *dev);
 
 tegra_pq * __get_presentation_queue(VdpPresentationQueue presentation_queue);
 tegra_pq * get_presentation_queue(VdpPresentationQueue presentation_queue);
 void ref_presentation_queue(tegra_pq *pq);
 VdpStatus unref_presentation_queue(tegra_pq *pq);
+void presentation_stats_init(const char *period);
+void presentation_stats_queued(tegra_pq *pq);
+void presentation_stats_presented(tegra_pq *pq, tegra_surface *surf,
+                                  VdpTime earliest_time);
+void presentation_stats_scanout(tegra_pq *pq, VdpTime scanout_time);
+void presentation_stats_dump(tegra_pq *pq);
+int presentation_queue_wait_surface_idle(tegra_pq *pq, tegra_surface *surf,
+                                         VdpTime deadline,
+                                         VdpTime *first_presentation_time);
 #define put_presentation_queue(__pq) ({ if (__pq) unref_presentation_queue(__pq); })
 void set_presentation_queue(VdpPresentationQueue presentation_queue,
                             tegra_pq *pq);
@@ -509,19 +638,42 @@ bool tegra_xv_initialize_csc(tegra_device *dev);
 void tegra_xv_reset_csc(tegra_device *dev);
 bool tegra_xv_apply_csc(tegra_device *dev, tegra_csc *csc);
 
-int rotate_surface_gr2d(tegra_surface *src_surf,
-                        tegra_surface *dst_surf,
-                        struct host1x_csc_params *csc,
-                        enum host1x_2d_rotate rotate,
-                        unsigned int sx, unsigned int sy,
-                        unsigned int src_width, int src_height,
-                        unsigned int dx, unsigned int dy,
-                        unsigned int dst_width, int dst_height,
-                        bool check_only);
+int rotate_video_surface(tegra_surface *src_surf,
+                         tegra_surface *dst_surf,
+                         struct host1x_csc_params *csc,
+                         enum host1x_2d_rotate rotate,
+                         unsigned int sx, unsigned int sy,
+                         unsigned int src_width, int src_height,
+                         unsigned int dx, unsigned int dy,
+                         unsigned int dst_width, int dst_height,
+                         bool check_only);
+void tegra_scratch_pool_init(tegra_device *dev);
+void tegra_scratch_pool_release(tegra_device *dev);
+void tegra_scratch_pool_expire(tegra_device *dev);
+
+void tegra_stream_pool_init(tegra_device *dev);
+void tegra_stream_pool_release(tegra_device *dev);
+struct tegra_stream *tegra_stream_pool_get(tegra_device *dev,
+                                           struct drm_tegra_channel *channel);
+void tegra_stream_pool_put(tegra_device *dev, struct tegra_stream *stream);
 
 VdpTime get_time(void);
 int tegra_ioctl(int fd, int request, ...);
 
+enum tegra_engine {
+    TEGRA_ENGINE_GR2D,
+    TEGRA_ENGINE_GR3D,
+    TEGRA_ENGINE_VDE,
+    TEGRA_ENGINES_NB,
+};
+
+void engine_stats_init(const char *period);
+void engine_stats_submit(struct tegra_fence *f, VdpTime submit_time,
+                         unsigned int words);
+VdpTime engine_stats_vde_begin(void);
+void engine_stats_vde_end(VdpTime queue_time, unsigned int bytes);
+void engine_stats_dump(void);
+
 void tegra_surface_cache_init(tegra_surface_cache *cache);
 void tegra_surface_cache_release(tegra_surface_cache *cache);
 void tegra_surface_cache_add_surface(tegra_surface_cache *cache,
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Measures CPU time that the driver spends per GR2D call. Jobs are executed
+ * by the software backend within the call, their execution time is taken
+ * from the job timestamps and subtracted, leaving the driver's overhead.
+ */
+
+#include "soft_tegra.h"
+
+struct bench {
+    const char *name;
+    unsigned int loops;
+    int (*run)(void);
+};
+
+static struct drm_tegra *drm;
+static struct tegra_stream *stream;
+static struct host1x_pixelbuffer *rgb_720p;
+static struct host1x_pixelbuffer *rgb_1080p;
+static struct host1x_pixelbuffer *yv12_720p;
+
+/* BT.601, as programmed by the mixer */
+static struct host1x_csc_params csc_bt601 = {
+    .yos = -16,
+    .cyx = 149, .cur = 0, .cvr = 204,
+    .cug = 1 << 8 | 50, .cvg = 1 << 8 | 104,
+    .cub = 258, .cvb = 0,
+};
+
+static struct host1x_pixelbuffer *pixbuf_create(unsigned int width,
+                                                unsigned int height,
+                                                enum pixel_format format)
+{
+    unsigned int pitch = ALIGN(width * PIX_BUF_FORMAT_BYTES(format), 16);
+
+    return host1x_pixelbuffer_create(drm, width, height, pitch,
+                                     format == PIX_BUF_FMT_YV12 ?
+                                          pitch / 2 : 0,
+                                     format, PIX_BUF_LAYOUT_LINEAR);
+}
+
+static int run_fill_small(void)
+{
+    return host1x_gr2d_clear_rect(stream, rgb_1080p, 0xff00ff00,
+                                  8, 8, 16, 16);
+}
+
+static int run_fill_clipped_small(void)
+{
+    return host1x_gr2d_clear_rect_clipped(stream, rgb_1080p, 0xff000000,
+                                          0, 0, 32, 32, 8, 8, 24, 24, true);
+}
+
+static int run_fill_1080p(void)
+{
+    return host1x_gr2d_clear(stream, rgb_1080p, 0xff000000);
+}
+
+static int run_blit_small(void)
+{
+    return host1x_gr2d_blit(stream, rgb_720p, rgb_1080p, IDENTITY,
+                            0, 0, 64, 64, 16, 16);
+}
+
+static int run_blit_720p(void)
+{
+    return host1x_gr2d_blit(stream, rgb_720p, rgb_1080p, IDENTITY,
+                            0, 0, 0, 0, 1280, 720);
+}
+
+static int run_surface_blit_small(void)
+{
+    return host1x_gr2d_surface_blit(stream, yv12_720p, rgb_1080p,
+                                    &csc_bt601,
+                                    0, 0, 16, 16, 0, 0, 24, 24);
+}
+
+static int run_surface_blit_720p_to_1080p(void)
+{
+    return host1x_gr2d_surface_blit(stream, yv12_720p, rgb_1080p,
+                                    &csc_bt601,
+                                    0, 0, 1280, 720, 0, 0, 1920, 1080);
+}
+
+static const struct bench benches[] = {
+    { "fill 16x16",                 2000, run_fill_small },
+    { "clipped fill 32x32",         2000, run_fill_clipped_small },
+    { "fill 1920x1080",             20,   run_fill_1080p },
+    { "blit 16x16",                 2000, run_blit_small },
+    { "blit 1280x720",              20,   run_blit_720p },
+    { "YV12 surface blit 16x16",    2000, run_surface_blit_small },
+    { "YV12 surface blit 720p->1080p", 5, run_surface_blit_720p_to_1080p },
+};
+
+static int run_bench(const struct bench *bench)
+{
+    struct soft_stream_stats stats;
+    VdpTime start, total;
+    double overhead;
+    unsigned int i;
+    int err;
+
+    soft_stream_reset_stats(stream);
+
+    start = get_time();
+
+    for (i = 0; i < bench->loops; i++) {
+        err = bench->run();
+        if (err) {
+            printf("%s: failed %d\n", bench->name, err);
+            return err;
+        }
+    }
+
+    total = get_time() - start;
+
+    soft_stream_get_stats(stream, &stats);
+
+    if (!stats.jobs || stats.failed_jobs) {
+        printf("%s: %lu jobs of %lu failed\n", bench->name,
+               stats.failed_jobs, stats.jobs);
+        return -1;
+    }
+
+    overhead = (double)(total - stats.exec_time) / bench->loops;
+
+    printf("%-32s %6u calls %6lu jobs %4lu words/job "
+           "%9.2f usec/call %9.2f usec/job executed\n",
+           bench->name, bench->loops, stats.jobs, stats.words / stats.jobs,
+           overhead / 1000.0,
+           (double)stats.exec_time / stats.jobs / 1000.0);
+
+    return 0;
+}
+
+int main(void)
+{
+    unsigned int i;
+    int ret = EXIT_SUCCESS;
+    int err;
+
+    err = soft_drm_new(&drm);
+    if (err) {
+        fprintf(stderr, "soft_drm_new() failed %d\n", err);
+        return EXIT_FAILURE;
+    }
+
+    err = soft_stream_create(&stream);
+    if (err) {
+        fprintf(stderr, "soft_stream_create() failed %d\n", err);
+        return EXIT_FAILURE;
+    }
+
+    rgb_720p = pixbuf_create(1280, 720, PIX_BUF_FMT_ARGB8888);
+    rgb_1080p = pixbuf_create(1920, 1080, PIX_BUF_FMT_ARGB8888);
+    yv12_720p = pixbuf_create(1280, 720, PIX_BUF_FMT_YV12);
+
+    if (!rgb_720p || !rgb_1080p || !yv12_720p) {
+        fprintf(stderr, "failed to create pixbufs\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("per-call driver overhead, job execution time excluded\n");
+
+    for (i = 0; i < ARRAY_SIZE(benches); i++) {
+        if (run_bench(&benches[i]))
+            ret = EXIT_FAILURE;
+    }
+
+    host1x_pixelbuffer_free(yv12_720p);
+    host1x_pixelbuffer_free(rgb_1080p);
+    host1x_pixelbuffer_free(rgb_720p);
+    tegra_stream_destroy(stream);
+    soft_drm_close(drm);
+
+    return ret;
+}
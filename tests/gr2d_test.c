@@ -0,0 +1,666 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Checks GR2D operations of the driver, executed by the software backend,
+ * against pixman doing the same operation.
+ */
+
+#include "soft_tegra.h"
+
+static struct drm_tegra *drm;
+static struct tegra_stream *stream;
+static unsigned int failures;
+static uint32_t seed = 0x2d2d2d2d;
+
+static uint32_t rand32(void)
+{
+    /* xorshift32, results must be reproducible */
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    return seed;
+}
+
+static pixman_format_code_t pixman_format(enum pixel_format format)
+{
+    switch (format) {
+    case PIX_BUF_FMT_RGB565:
+        return PIXMAN_r5g6b5;
+    case PIX_BUF_FMT_ARGB8888:
+        return PIXMAN_a8r8g8b8;
+    case PIX_BUF_FMT_ABGR8888:
+        return PIXMAN_a8b8g8r8;
+    default:
+        abort();
+    }
+}
+
+static struct host1x_pixelbuffer *pixbuf_create(unsigned int width,
+                                                unsigned int height,
+                                                enum pixel_format format)
+{
+    struct host1x_pixelbuffer *pixbuf;
+    unsigned int pitch = ALIGN(width * PIX_BUF_FORMAT_BYTES(format), 16);
+
+    pixbuf = host1x_pixelbuffer_create(drm, width, height, pitch,
+                                       format == PIX_BUF_FMT_YV12 ?
+                                            pitch / 2 : 0,
+                                       format, PIX_BUF_LAYOUT_LINEAR);
+    if (!pixbuf) {
+        fprintf(stderr, "failed to create %ux%u pixbuf\n", width, height);
+        exit(EXIT_FAILURE);
+    }
+
+    return pixbuf;
+}
+
+static void *pixbuf_map(struct host1x_pixelbuffer *pixbuf, unsigned int plane)
+{
+    void *map;
+
+    host1x_pixelbuffer_sync(pixbuf);
+    drm_tegra_bo_map(pixbuf->bos[plane], &map);
+
+    return map;
+}
+
+/* wraps BO of a RGB pixbuf, the image is valid as long as pixbuf is */
+static pixman_image_t *pixbuf_image(struct host1x_pixelbuffer *pixbuf)
+{
+    return pixman_image_create_bits(pixman_format(pixbuf->format),
+                                    pixbuf->width, pixbuf->height,
+                                    pixbuf_map(pixbuf, 0), pixbuf->pitch);
+}
+
+static void pixbuf_randomize(struct host1x_pixelbuffer *pixbuf)
+{
+    uint32_t *map = pixbuf_map(pixbuf, 0);
+    unsigned int i;
+
+    for (i = 0; i < pixbuf->pitch * pixbuf->height / 4; i++)
+        map[i] = rand32();
+}
+
+/* smooth content, so that filtering differences stay small */
+static void pixbuf_gradient(struct host1x_pixelbuffer *pixbuf)
+{
+    uint32_t *map = pixbuf_map(pixbuf, 0);
+    unsigned int x, y;
+
+    for (y = 0; y < pixbuf->height; y++)
+        for (x = 0; x < pixbuf->width; x++)
+            map[y * pixbuf->pitch / 4 + x] = 0xff000000 |
+                                             (x * 3) << 16 |
+                                             (y * 4) << 8 |
+                                             (x + y) * 2;
+}
+
+/* copy of pixbuf content that reference operations are applied to */
+static pixman_image_t *ref_image(struct host1x_pixelbuffer *pixbuf)
+{
+    uint32_t *bits = malloc(pixbuf->pitch * pixbuf->height);
+
+    memcpy(bits, pixbuf_map(pixbuf, 0), pixbuf->pitch * pixbuf->height);
+
+    return pixman_image_create_bits(pixman_format(pixbuf->format),
+                                    pixbuf->width, pixbuf->height,
+                                    bits, pixbuf->pitch);
+}
+
+static void ref_image_free(pixman_image_t *ref)
+{
+    void *bits = pixman_image_get_data(ref);
+
+    pixman_image_unref(ref);
+    free(bits);
+}
+
+static void ref_fill(pixman_image_t *ref, const pixman_box32_t *box,
+                     uint32_t color)
+{
+    int bpp = PIXMAN_FORMAT_BPP(pixman_image_get_format(ref));
+
+    if (bpp == 16)
+        color = (color & 0xffff) * 0x10001;
+
+    pixman_fill(pixman_image_get_data(ref),
+                pixman_image_get_stride(ref) / 4, bpp,
+                box->x1, box->y1, box->x2 - box->x1, box->y2 - box->y1,
+                color);
+}
+
+static bool check(const char *name, struct host1x_pixelbuffer *pixbuf,
+                  pixman_image_t *ref, unsigned int tolerance)
+{
+    int bpp = PIXMAN_FORMAT_BPP(pixman_image_get_format(ref));
+    uint8_t *ref_bits = (uint8_t *)pixman_image_get_data(ref);
+    int ref_stride = pixman_image_get_stride(ref);
+    uint8_t *bits = pixbuf_map(pixbuf, 0);
+    unsigned int mismatches = 0;
+    unsigned int max_diff = 0;
+    unsigned int first_x = 0;
+    unsigned int first_y = 0;
+    unsigned int diff;
+    unsigned int x, y;
+
+    for (y = 0; y < pixbuf->height; y++) {
+        for (x = 0; x < pixbuf->width * bpp / 8; x++) {
+            diff = abs(bits[y * pixbuf->pitch + x] -
+                       ref_bits[y * ref_stride + x]);
+
+            /* channels of 16bpp formats aren't byte sized */
+            if (bpp == 16 && diff)
+                diff = 255;
+
+            if (diff > tolerance && !mismatches++) {
+                first_x = x / (bpp / 8);
+                first_y = y;
+            }
+
+            max_diff = max(max_diff, diff);
+        }
+    }
+
+    if (mismatches) {
+        printf("FAIL: %s: %u mismatches, first at %u:%u, max diff %u\n",
+               name, mismatches, first_x, first_y, max_diff);
+        failures++;
+        return false;
+    }
+
+    printf("PASS: %s (max diff %u)\n", name, max_diff);
+
+    return true;
+}
+
+static void test_fill(enum pixel_format format)
+{
+    pixman_box32_t box = { 5, 7, 5 + 50, 7 + 30 };
+    struct host1x_pixelbuffer *dst;
+    pixman_image_t *ref;
+    uint32_t color = rand32();
+    char name[64];
+    int err;
+
+    dst = pixbuf_create(67, 45, format);
+    pixbuf_randomize(dst);
+    ref = ref_image(dst);
+
+    if (PIX_BUF_FORMAT_BYTES(format) == 2)
+        color &= 0xffff;
+
+    snprintf(name, sizeof(name), "fill %ubpp", PIX_BUF_FORMAT_BITS(format));
+
+    err = host1x_gr2d_clear_rect(stream, dst, color, box.x1, box.y1,
+                                 box.x2 - box.x1, box.y2 - box.y1);
+    if (err) {
+        printf("FAIL: %s: error %d\n", name, err);
+        failures++;
+    } else {
+        ref_fill(ref, &box, color);
+        check(name, dst, ref, 0);
+    }
+
+    ref_image_free(ref);
+    host1x_pixelbuffer_free(dst);
+}
+
+static void test_fill_clipped(bool draw_outside)
+{
+    struct host1x_pixelbuffer *dst;
+    pixman_region32_t region, clip;
+    pixman_box32_t *boxes;
+    pixman_image_t *ref;
+    uint32_t color = rand32();
+    const char *name;
+    int i, n;
+    int err;
+
+    name = draw_outside ? "clipped fill, outside" : "clipped fill, inside";
+
+    dst = pixbuf_create(72, 50, PIX_BUF_FMT_ARGB8888);
+    pixbuf_randomize(dst);
+    ref = ref_image(dst);
+
+    err = host1x_gr2d_clear_rect_clipped(stream, dst, color,
+                                         4, 3, 60, 40,
+                                         10, 8, 40, 30,
+                                         draw_outside);
+    if (err) {
+        printf("FAIL: %s: error %d\n", name, err);
+        failures++;
+        goto out;
+    }
+
+    pixman_region32_init_rect(&region, 4, 3, 60, 40);
+    pixman_region32_init_rect(&clip, 10, 8, 40 - 10, 30 - 8);
+
+    if (draw_outside)
+        pixman_region32_subtract(&region, &region, &clip);
+    else
+        pixman_region32_intersect(&region, &region, &clip);
+
+    boxes = pixman_region32_rectangles(&region, &n);
+
+    for (i = 0; i < n; i++)
+        ref_fill(ref, &boxes[i], color);
+
+    pixman_region32_fini(&region);
+    pixman_region32_fini(&clip);
+
+    check(name, dst, ref, 0);
+out:
+    ref_image_free(ref);
+    host1x_pixelbuffer_free(dst);
+}
+
+static void test_blit(void)
+{
+    struct host1x_pixelbuffer *src, *dst;
+    pixman_image_t *src_img, *ref;
+    int err;
+
+    src = pixbuf_create(80, 60, PIX_BUF_FMT_ARGB8888);
+    dst = pixbuf_create(90, 70, PIX_BUF_FMT_ARGB8888);
+    pixbuf_randomize(src);
+    pixbuf_randomize(dst);
+    src_img = pixbuf_image(src);
+    ref = ref_image(dst);
+
+    err = host1x_gr2d_blit(stream, src, dst, IDENTITY, 7, 5, 11, 9, 50, 40);
+    if (err) {
+        printf("FAIL: blit: error %d\n", err);
+        failures++;
+    } else {
+        pixman_image_composite32(PIXMAN_OP_SRC, src_img, NULL, ref,
+                                 7, 5, 0, 0, 11, 9, 50, 40);
+        check("blit", dst, ref, 0);
+    }
+
+    pixman_image_unref(src_img);
+    ref_image_free(ref);
+    host1x_pixelbuffer_free(src);
+    host1x_pixelbuffer_free(dst);
+}
+
+/* copy within a pixbuf behaves like memmove, regardless of direction */
+static void test_blit_overlapping(void)
+{
+    static const struct {
+        unsigned int sx, sy, dx, dy;
+    } cases[] = {
+        { 5, 4, 9, 10 },
+        { 9, 10, 5, 4 },
+        { 9, 4, 5, 10 },
+        { 5, 10, 9, 4 },
+    };
+    struct host1x_pixelbuffer *pixbuf;
+    pixman_image_t *orig, *ref;
+    char name[64];
+    unsigned int i;
+    int err;
+
+    for (i = 0; i < ARRAY_SIZE(cases); i++) {
+        pixbuf = pixbuf_create(80, 60, PIX_BUF_FMT_ARGB8888);
+        pixbuf_randomize(pixbuf);
+        orig = ref_image(pixbuf);
+        ref = ref_image(pixbuf);
+
+        snprintf(name, sizeof(name), "overlapping blit %u:%u -> %u:%u",
+                 cases[i].sx, cases[i].sy, cases[i].dx, cases[i].dy);
+
+        err = host1x_gr2d_blit(stream, pixbuf, pixbuf, IDENTITY,
+                               cases[i].sx, cases[i].sy,
+                               cases[i].dx, cases[i].dy, 60, 40);
+        if (err) {
+            printf("FAIL: %s: error %d\n", name, err);
+            failures++;
+        } else {
+            pixman_image_composite32(PIXMAN_OP_SRC, orig, NULL, ref,
+                                     cases[i].sx, cases[i].sy, 0, 0,
+                                     cases[i].dx, cases[i].dy, 60, 40);
+            check(name, pixbuf, ref, 0);
+        }
+
+        ref_image_free(orig);
+        ref_image_free(ref);
+        host1x_pixelbuffer_free(pixbuf);
+    }
+}
+
+static void test_blit_yflip(void)
+{
+    struct host1x_pixelbuffer *src, *dst;
+    pixman_image_t *src_img, *ref;
+    int err;
+    int y;
+
+    src = pixbuf_create(80, 60, PIX_BUF_FMT_ARGB8888);
+    dst = pixbuf_create(80, 60, PIX_BUF_FMT_ARGB8888);
+    pixbuf_randomize(src);
+    pixbuf_randomize(dst);
+    src_img = pixbuf_image(src);
+    ref = ref_image(dst);
+
+    err = host1x_gr2d_blit(stream, src, dst, IDENTITY, 3, 6, 8, 2, 50, -40);
+    if (err) {
+        printf("FAIL: flipped blit: error %d\n", err);
+        failures++;
+    } else {
+        for (y = 0; y < 40; y++)
+            pixman_image_composite32(PIXMAN_OP_SRC, src_img, NULL, ref,
+                                     3, 6 + y, 0, 0, 8, 2 + 39 - y, 50, 1);
+
+        check("flipped blit", dst, ref, 0);
+    }
+
+    pixman_image_unref(src_img);
+    ref_image_free(ref);
+    host1x_pixelbuffer_free(src);
+    host1x_pixelbuffer_free(dst);
+}
+
+static void test_blit_rot180(void)
+{
+    struct host1x_pixelbuffer *src, *dst;
+    pixman_image_t *src_img, *ref;
+    pixman_transform_t transform;
+    int sx = 8, sy = 6, w = 40, h = 30;
+    int err;
+
+    src = pixbuf_create(64, 48, PIX_BUF_FMT_ARGB8888);
+    dst = pixbuf_create(64, 48, PIX_BUF_FMT_ARGB8888);
+    pixbuf_randomize(src);
+    pixbuf_randomize(dst);
+    src_img = pixbuf_image(src);
+    ref = ref_image(dst);
+
+    err = host1x_gr2d_blit(stream, src, dst, ROT_180, sx, sy, 4, 2, w, h);
+    if (err) {
+        printf("FAIL: rotated blit: error %d\n", err);
+        failures++;
+    } else {
+        pixman_transform_init_identity(&transform);
+        transform.matrix[0][0] = pixman_int_to_fixed(-1);
+        transform.matrix[0][2] = pixman_int_to_fixed(sx + w);
+        transform.matrix[1][1] = pixman_int_to_fixed(-1);
+        transform.matrix[1][2] = pixman_int_to_fixed(sy + h);
+
+        pixman_image_set_transform(src_img, &transform);
+        pixman_image_set_filter(src_img, PIXMAN_FILTER_NEAREST, NULL, 0);
+        pixman_image_composite32(PIXMAN_OP_SRC, src_img, NULL, ref,
+                                 0, 0, 0, 0, 4, 2, w, h);
+
+        check("rotated blit", dst, ref, 0);
+    }
+
+    pixman_image_unref(src_img);
+    ref_image_free(ref);
+    host1x_pixelbuffer_free(src);
+    host1x_pixelbuffer_free(dst);
+}
+
+/* job failure must be reported and mustn't leave a fence on the pixbufs */
+static void test_failed_job(void)
+{
+    struct host1x_pixelbuffer *src, *dst;
+    int err;
+
+    src = pixbuf_create(32, 32, PIX_BUF_FMT_ARGB8888);
+    dst = pixbuf_create(32, 32, PIX_BUF_FMT_ARGB8888);
+
+    /* 90 degree rotation isn't emulated, hence the job fails */
+    err = host1x_gr2d_blit(stream, src, dst, ROT_90, 0, 0, 0, 0, 16, 16);
+
+    if (!err || dst->gr2d_fence || src->gr2d_fence) {
+        printf("FAIL: failed job: err %d, fence %p\n", err, dst->gr2d_fence);
+        failures++;
+    } else {
+        printf("PASS: failed job\n");
+    }
+
+    host1x_pixelbuffer_free(src);
+    host1x_pixelbuffer_free(dst);
+}
+
+/* scales as sampling src at (dst + 0.5) * scale + sx + 0.5 * (1 - scale) */
+static void ref_scale(pixman_image_t *src_img, pixman_image_t *ref,
+                      int sx, int sy, int src_width, int src_height,
+                      int dx, int dy, int dst_width, int dst_height)
+{
+    pixman_transform_t transform;
+    double scale_x = (src_width - 1) / (double)(dst_width - 1);
+    double scale_y = (src_height - 1) / (double)(dst_height - 1);
+
+    pixman_transform_init_identity(&transform);
+    transform.matrix[0][0] = pixman_double_to_fixed(scale_x);
+    transform.matrix[0][2] = pixman_double_to_fixed(sx + 0.5 - 0.5 * scale_x);
+    transform.matrix[1][1] = pixman_double_to_fixed(scale_y);
+    transform.matrix[1][2] = pixman_double_to_fixed(sy + 0.5 - 0.5 * scale_y);
+
+    pixman_image_set_transform(src_img, &transform);
+    pixman_image_set_filter(src_img, PIXMAN_FILTER_BILINEAR, NULL, 0);
+    pixman_image_set_repeat(src_img, PIXMAN_REPEAT_PAD);
+    pixman_image_composite32(PIXMAN_OP_SRC, src_img, NULL, ref,
+                             0, 0, 0, 0, dx, dy, dst_width, dst_height);
+    pixman_image_set_transform(src_img, NULL);
+}
+
+static void test_surface_blit_rgb(enum pixel_format dst_format,
+                                  unsigned int dst_width,
+                                  unsigned int dst_height)
+{
+    struct host1x_pixelbuffer *src, *dst;
+    pixman_image_t *src_img, *ref;
+    bool scaled = dst_width != 48 || dst_height != 32;
+    char name[64];
+    int err;
+
+    src = pixbuf_create(64, 48, PIX_BUF_FMT_ARGB8888);
+    dst = pixbuf_create(120, 90, dst_format);
+    pixbuf_gradient(src);
+    pixbuf_randomize(dst);
+    src_img = pixbuf_image(src);
+    ref = ref_image(dst);
+
+    snprintf(name, sizeof(name), "surface blit 48x32 -> %ux%u %ubpp",
+             dst_width, dst_height, PIX_BUF_FORMAT_BITS(dst_format));
+
+    err = host1x_gr2d_surface_blit(stream, src, dst, &csc_rgb_default,
+                                   4, 6, 48, 32,
+                                   3, 5, dst_width, dst_height);
+    if (err) {
+        printf("FAIL: %s: error %d\n", name, err);
+        failures++;
+    } else {
+        if (scaled)
+            ref_scale(src_img, ref, 4, 6, 48, 32, 3, 5,
+                      dst_width, dst_height);
+        else
+            pixman_image_composite32(PIXMAN_OP_SRC, src_img, NULL, ref,
+                                     4, 6, 0, 0, 3, 5, 48, 32);
+
+        check(name, dst, ref, scaled ? 3 : 0);
+    }
+
+    pixman_image_unref(src_img);
+    ref_image_free(ref);
+    host1x_pixelbuffer_free(src);
+    host1x_pixelbuffer_free(dst);
+}
+
+/* same as what mixer programs for VDPAU CSC matrix */
+static void csc_from_matrix(struct host1x_csc_params *csc,
+                            VdpCSCMatrix const cscmat)
+{
+    csc->yos = -16;
+    csc->cyx = FLOAT_TO_FIXED_s1_7( CLAMP(cscmat[0][0], -1.98f, 1.98f) );
+    csc->cur = FLOAT_TO_FIXED_s2_7( CLAMP(cscmat[0][1], -3.98f, 3.98f) );
+    csc->cvr = FLOAT_TO_FIXED_s2_7( CLAMP(cscmat[0][2], -3.98f, 3.98f) );
+    csc->cug = FLOAT_TO_FIXED_s1_7( CLAMP(cscmat[1][1], -1.98f, 1.98f) );
+    csc->cvg = FLOAT_TO_FIXED_s1_7( CLAMP(cscmat[1][2], -1.98f, 1.98f) );
+    csc->cub = FLOAT_TO_FIXED_s2_7( CLAMP(cscmat[2][1], -3.98f, 3.98f) );
+    csc->cvb = FLOAT_TO_FIXED_s2_7( CLAMP(cscmat[2][2], -3.98f, 3.98f) );
+}
+
+/*
+ * pixman's YV12 is a single buffer: Y plane, then V and U planes with
+ * half of the Y stride.
+ */
+static void test_surface_blit_yv12(unsigned int dst_width,
+                                   unsigned int dst_height)
+{
+    VdpCSCMatrix bt601 = {
+        { 1.164384f, 0.000000f, 1.596027f },
+        { 1.164384f,-0.391762f,-0.812968f },
+        { 1.164384f, 2.017232f, 0.000000f },
+    };
+    const unsigned int width = 64, height = 48;
+    struct host1x_pixelbuffer *src, *dst;
+    struct host1x_csc_params csc;
+    pixman_image_t *src_img, *ref;
+    bool scaled = dst_width != width || dst_height != height;
+    uint8_t *yuv, *planes[3];
+    unsigned int x, y, p;
+    char name[64];
+    int err;
+
+    src = pixbuf_create(width, height, PIX_BUF_FMT_YV12);
+    dst = pixbuf_create(104, 80, PIX_BUF_FMT_ARGB8888);
+    pixbuf_randomize(dst);
+    ref = ref_image(dst);
+
+    yuv = malloc(width * height * 3 / 2);
+    planes[0] = yuv;
+    planes[2] = yuv + width * height;
+    planes[1] = planes[2] + width * height / 4;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            if (scaled)
+                planes[0][y * width + x] = 16 + x * 3 + y;
+            else
+                planes[0][y * width + x] = rand32();
+        }
+    }
+
+    for (p = 1; p < 3; p++) {
+        for (y = 0; y < height / 2; y++) {
+            for (x = 0; x < width / 2; x++) {
+                if (scaled)
+                    planes[p][y * width / 2 + x] = 96 + x * p + y * 2;
+                else
+                    planes[p][y * width / 2 + x] = rand32();
+            }
+        }
+    }
+
+    for (p = 0; p < 3; p++)
+        for (y = 0; y < (p ? height / 2 : height); y++)
+            memcpy((uint8_t *)pixbuf_map(src, p) +
+                        y * (p ? src->pitch_uv : src->pitch),
+                   planes[p] + y * (p ? width / 2 : width),
+                   p ? width / 2 : width);
+
+    src_img = pixman_image_create_bits(PIXMAN_yv12, width, height,
+                                       (uint32_t *)yuv, width);
+
+    csc_from_matrix(&csc, bt601);
+
+    snprintf(name, sizeof(name), "YV12 surface blit %ux%u -> %ux%u",
+             width, height, dst_width, dst_height);
+
+    err = host1x_gr2d_surface_blit(stream, src, dst, &csc,
+                                   0, 0, width, height,
+                                   6, 4, dst_width, dst_height);
+    if (err) {
+        printf("FAIL: %s: error %d\n", name, err);
+        failures++;
+    } else {
+        if (scaled)
+            ref_scale(src_img, ref, 0, 0, width, height, 6, 4,
+                      dst_width, dst_height);
+        else
+            pixman_image_composite32(PIXMAN_OP_SRC, src_img, NULL, ref,
+                                     0, 0, 0, 0, 6, 4, width, height);
+
+        /*
+         * pixman's coefficients differ from BT.601 by up to 1% and it
+         * filters chroma, which is sampled from the nearest block here.
+         */
+        check(name, dst, ref, scaled ? 8 : 4);
+    }
+
+    pixman_image_unref(src_img);
+    free(yuv);
+    ref_image_free(ref);
+    host1x_pixelbuffer_free(src);
+    host1x_pixelbuffer_free(dst);
+}
+
+int main(void)
+{
+    int err;
+
+    err = soft_drm_new(&drm);
+    if (err) {
+        fprintf(stderr, "soft_drm_new() failed %d\n", err);
+        return EXIT_FAILURE;
+    }
+
+    err = soft_stream_create(&stream);
+    if (err) {
+        fprintf(stderr, "soft_stream_create() failed %d\n", err);
+        return EXIT_FAILURE;
+    }
+
+    test_fill(PIX_BUF_FMT_ARGB8888);
+    test_fill(PIX_BUF_FMT_RGB565);
+    test_fill_clipped(false);
+    test_fill_clipped(true);
+    test_blit();
+    test_blit_overlapping();
+    test_blit_yflip();
+    test_blit_rot180();
+    test_failed_job();
+    test_surface_blit_rgb(PIX_BUF_FMT_ARGB8888, 48, 32);
+    test_surface_blit_rgb(PIX_BUF_FMT_ABGR8888, 48, 32);
+    test_surface_blit_rgb(PIX_BUF_FMT_RGB565, 48, 32);
+    test_surface_blit_rgb(PIX_BUF_FMT_ARGB8888, 96, 64);
+    test_surface_blit_rgb(PIX_BUF_FMT_ARGB8888, 30, 20);
+    test_surface_blit_yv12(64, 48);
+    test_surface_blit_yv12(96, 72);
+
+    tegra_stream_destroy(stream);
+
+    if (soft_bo_count()) {
+        printf("FAIL: %u BOs leaked\n", soft_bo_count());
+        failures++;
+    }
+
+    soft_drm_close(drm);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
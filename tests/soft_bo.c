@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include "soft_tegra.h"
+
+static atomic_t bo_count;
+
+int soft_drm_new(struct drm_tegra **drmp)
+{
+    struct drm_tegra *drm;
+
+    drm = calloc(1, sizeof(*drm));
+    if (!drm)
+        return -ENOMEM;
+
+    /* upstream kernel UAPI, grate-only BO flags aren't used */
+    drm->version = 0;
+
+    *drmp = drm;
+
+    return 0;
+}
+
+void soft_drm_close(struct drm_tegra *drm)
+{
+    free(drm);
+}
+
+unsigned int soft_bo_count(void)
+{
+    return atomic_read(&bo_count);
+}
+
+int drm_tegra_version(struct drm_tegra *drm)
+{
+    if (!drm)
+        return -EINVAL;
+
+    return drm->version;
+}
+
+/*
+ * BOs are backed by memfd, like the kernel's shmem-backed GEM objects,
+ * and stay mapped for their whole life.
+ */
+int drm_tegra_bo_new(struct drm_tegra_bo **bop, struct drm_tegra *drm,
+                     uint32_t flags, uint32_t size)
+{
+    struct drm_tegra_bo *bo;
+    int err;
+
+    if (!drm || !bop || !size)
+        return -EINVAL;
+
+    bo = calloc(1, sizeof(*bo));
+    if (!bo)
+        return -ENOMEM;
+
+    bo->fd = memfd_create("soft-tegra-bo", MFD_CLOEXEC);
+    if (bo->fd < 0) {
+        err = -errno;
+        ErrorMsg("memfd_create() failed %d\n", err);
+        goto err_free;
+    }
+
+    if (ftruncate(bo->fd, size) < 0) {
+        err = -errno;
+        ErrorMsg("ftruncate() failed %d\n", err);
+        goto err_close;
+    }
+
+    bo->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   bo->fd, 0);
+    if (bo->map == MAP_FAILED) {
+        err = -errno;
+        ErrorMsg("mmap() failed %d\n", err);
+        goto err_close;
+    }
+
+    bo->size = size;
+    atomic_set(&bo->ref, 1);
+    atomic_inc(&bo_count);
+
+    *bop = bo;
+
+    return 0;
+
+err_close:
+    close(bo->fd);
+err_free:
+    free(bo);
+
+    return err;
+}
+
+struct drm_tegra_bo *drm_tegra_bo_ref(struct drm_tegra_bo *bo)
+{
+    if (bo)
+        atomic_inc(&bo->ref);
+
+    return bo;
+}
+
+int drm_tegra_bo_unref(struct drm_tegra_bo *bo)
+{
+    if (!bo)
+        return -EINVAL;
+
+    if (!atomic_dec_and_test(&bo->ref))
+        return 0;
+
+    munmap(bo->map, bo->size);
+    close(bo->fd);
+    free(bo);
+
+    atomic_dec(&bo_count, 1);
+
+    return 0;
+}
+
+int drm_tegra_bo_map(struct drm_tegra_bo *bo, void **ptr)
+{
+    if (!bo)
+        return -EINVAL;
+
+    if (ptr)
+        *ptr = bo->map;
+
+    return 0;
+}
+
+int drm_tegra_bo_unmap(struct drm_tegra_bo *bo)
+{
+    if (!bo)
+        return -EINVAL;
+
+    return 0;
+}
+
+int drm_tegra_bo_get_size(struct drm_tegra_bo *bo, uint32_t *size)
+{
+    if (!bo)
+        return -EINVAL;
+
+    if (size)
+        *size = bo->size;
+
+    return 0;
+}
@@ -0,0 +1,740 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Executes the subset of GR2D commands that is emitted by host1x-gr2d.c:
+ * solid fill (optionally clipped), copy blit (optionally flipped or
+ * rotated by 180 degrees) and the surface blit of the SB class, which
+ * scales and converts YV12 to RGB.
+ *
+ * Every job starts with a zeroed register file, so a job that relies on
+ * registers programmed by an earlier job fails here instead of working by
+ * accident. Accesses outside of a BO fail the job, like an IOMMU fault
+ * would do on hardware.
+ */
+
+#include "soft_tegra.h"
+
+#define GR2D_NUM_REGS   0x50
+
+enum {
+    GR2D_TRIGGER                = 0x09,
+    GR2D_CMDSEL                 = 0x0c,
+    GR2D_VDDA                   = 0x11,
+    GR2D_VDDAINI                = 0x12,
+    GR2D_HDDA                   = 0x13,
+    GR2D_HDDAINILS              = 0x14,
+    GR2D_CSCFIRST               = 0x15,
+    GR2D_CSCSECOND              = 0x16,
+    GR2D_CSCTHIRD               = 0x17,
+    GR2D_UBA                    = 0x1a,
+    GR2D_VBA                    = 0x1b,
+    GR2D_SBFORMAT               = 0x1c,
+    GR2D_CONTROLSB              = 0x1d,
+    GR2D_CONTROLSECOND          = 0x1e,
+    GR2D_CONTROLMAIN            = 0x1f,
+    GR2D_ROPFADE                = 0x20,
+    GR2D_CLIP_LEFTTOP           = 0x22,
+    GR2D_CLIP_RIGHTBOT          = 0x23,
+    GR2D_DSTBA                  = 0x2b,
+    GR2D_DSTST                  = 0x2e,
+    GR2D_SRCBA                  = 0x31,
+    GR2D_SRCST                  = 0x33,
+    GR2D_SRCFGC                 = 0x35,
+    GR2D_SRCSIZE                = 0x37,
+    GR2D_DSTSIZE                = 0x38,
+    GR2D_SRCPS                  = 0x39,
+    GR2D_DSTPS                  = 0x3a,
+    GR2D_UVSTRIDE               = 0x44,
+    GR2D_TILEMODE               = 0x46,
+    GR2D_VBA_TILE               = 0x4b,
+    GR2D_UBA_TILE               = 0x4c,
+};
+
+/* SBFORMAT color formats */
+enum {
+    SB_FMT_YUV      = 0,
+    SB_FMT_RGB565   = 8,
+    SB_FMT_ABGR8888 = 14,
+    SB_FMT_ARGB8888 = 15,
+};
+
+struct gr2d_regs {
+    uint32_t val[GR2D_NUM_REGS];
+    struct drm_tegra_bo *bo[GR2D_NUM_REGS];
+};
+
+struct gr2d_surface {
+    struct drm_tegra_bo *bo;
+    uint32_t offset;
+    uint32_t stride;
+    unsigned int cpp;
+    bool tiled;
+};
+
+static int gr2d_surface_init(struct gr2d_surface *s,
+                             const struct gr2d_regs *regs,
+                             unsigned int ba, uint32_t stride,
+                             unsigned int cpp, bool tiled)
+{
+    if (!regs->bo[ba]) {
+        ErrorMsg("register 0x%02x isn't relocated\n", ba);
+        return -EFAULT;
+    }
+
+    s->bo = regs->bo[ba];
+    s->offset = regs->val[ba];
+    s->stride = stride;
+    s->cpp = cpp;
+    s->tiled = tiled;
+
+    return 0;
+}
+
+/* 16x16 tiles, tiles of a row are consecutive in memory */
+static uint8_t *gr2d_pixel(const struct gr2d_surface *s, int x, int y)
+{
+    int64_t offset = s->offset;
+
+    if (s->tiled) {
+        if (x < 0 || y < 0)
+            return NULL;
+
+        offset += (int64_t)(y / 16) * s->stride * 16;
+        offset += (x / 16) * 256 * s->cpp;
+        offset += (y % 16) * 16 * s->cpp;
+        offset += (x % 16) * s->cpp;
+    } else {
+        offset += (int64_t)y * s->stride;
+        offset += (int64_t)x * s->cpp;
+    }
+
+    if (offset < 0 || offset + s->cpp > s->bo->size) {
+        ErrorMsg("access of %d:%d is out of BO bounds\n", x, y);
+        return NULL;
+    }
+
+    return (uint8_t *)s->bo->map + offset;
+}
+
+static unsigned int gr2d_cpp(const struct gr2d_regs *regs)
+{
+    /* [17:16] destination color depth (0: 8 bpp, 1: 16 bpp, 2: 32 bpp) */
+    return 1 << ((regs->val[GR2D_CONTROLMAIN] >> 16) & 3);
+}
+
+static int gr2d_fill(const struct gr2d_regs *regs)
+{
+    uint32_t clip0 = regs->val[GR2D_CLIP_LEFTTOP];
+    uint32_t clip1 = regs->val[GR2D_CLIP_RIGHTBOT];
+    uint32_t color = regs->val[GR2D_SRCFGC];
+    unsigned int clip_mode = (regs->val[GR2D_CONTROLSECOND] >> 21) & 3;
+    unsigned int x0 = regs->val[GR2D_DSTPS] & 0xffff;
+    unsigned int y0 = regs->val[GR2D_DSTPS] >> 16;
+    unsigned int width = regs->val[GR2D_DSTSIZE] & 0xffff;
+    unsigned int height = regs->val[GR2D_DSTSIZE] >> 16;
+    unsigned int cpp = gr2d_cpp(regs);
+    struct gr2d_surface dst;
+    unsigned int x, y;
+    uint8_t *p;
+    bool inside;
+    int err;
+
+    err = gr2d_surface_init(&dst, regs, GR2D_DSTBA,
+                            regs->val[GR2D_DSTST], cpp,
+                            regs->val[GR2D_TILEMODE] & (1 << 20));
+    if (err)
+        return err;
+
+    if (clip_mode == 1) {
+        ErrorMsg("clip mode %u isn't emulated\n", clip_mode);
+        return -ENOTSUP;
+    }
+
+    for (y = y0; y < y0 + height; y++) {
+        for (x = x0; x < x0 + width; x++) {
+            /* 2: draw inside of the clip rect, 3: draw outside */
+            if (clip_mode) {
+                inside = x >= (clip0 & 0xffff) && x < (clip1 & 0xffff) &&
+                         y >= (clip0 >> 16) && y < (clip1 >> 16);
+
+                if (inside != (clip_mode == 2))
+                    continue;
+            }
+
+            p = gr2d_pixel(&dst, x, y);
+            if (!p)
+                return -EFAULT;
+
+            memcpy(p, &color, cpp);
+        }
+    }
+
+    return 0;
+}
+
+static int gr2d_blit_rotated(const struct gr2d_regs *regs,
+                             const struct gr2d_surface *src,
+                             const struct gr2d_surface *dst)
+{
+    unsigned int rotate = (regs->val[GR2D_CONTROLSECOND] >> 26) & 7;
+    unsigned int width = (regs->val[GR2D_SRCSIZE] & 0xffff) + 1;
+    unsigned int height = (regs->val[GR2D_SRCSIZE] >> 16) + 1;
+    unsigned int x, y;
+    uint8_t *s, *d;
+
+    /* orientation of flips and 90 degree rotations isn't known */
+    if (rotate != ROT_180) {
+        ErrorMsg("rotation %u isn't emulated\n", rotate);
+        return -ENOTSUP;
+    }
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            s = gr2d_pixel(src, width - 1 - x, height - 1 - y);
+            d = gr2d_pixel(dst, x, y);
+            if (!s || !d)
+                return -EFAULT;
+
+            memcpy(d, s, src->cpp);
+        }
+    }
+
+    return 0;
+}
+
+static int gr2d_blit(const struct gr2d_regs *regs)
+{
+    uint32_t controlmain = regs->val[GR2D_CONTROLMAIN];
+    uint32_t tilemode = regs->val[GR2D_TILEMODE];
+    unsigned int fr_mode = (regs->val[GR2D_CONTROLSECOND] >> 24) & 3;
+    unsigned int width = regs->val[GR2D_DSTSIZE] & 0xffff;
+    unsigned int height = regs->val[GR2D_DSTSIZE] >> 16;
+    int sx = regs->val[GR2D_SRCPS] & 0xffff;
+    int sy = regs->val[GR2D_SRCPS] >> 16;
+    int dx = regs->val[GR2D_DSTPS] & 0xffff;
+    int dy = regs->val[GR2D_DSTPS] >> 16;
+    bool yflip = controlmain & (1 << 14);
+    bool ydir = controlmain & (1 << 10);
+    bool xdir = controlmain & (1 << 9);
+    unsigned int cpp = gr2d_cpp(regs);
+    struct gr2d_surface src, dst;
+    unsigned int i, j;
+    int sx_i, dx_i, sy_j, dy_j;
+    uint8_t *s, *d;
+    int err;
+
+    err = gr2d_surface_init(&src, regs, GR2D_SRCBA, regs->val[GR2D_SRCST],
+                            cpp, tilemode & 1);
+    if (err)
+        return err;
+
+    err = gr2d_surface_init(&dst, regs, GR2D_DSTBA, regs->val[GR2D_DSTST],
+                            cpp, tilemode & (1 << 20));
+    if (err)
+        return err;
+
+    if (fr_mode)
+        return gr2d_blit_rotated(regs, &src, &dst);
+
+    /*
+     * Pixels are copied one by one in the direction given by xdir/ydir,
+     * hence overlapping copies behave like they do on hardware.
+     */
+    for (j = 0; j < height; j++) {
+        sy_j = ydir ? sy - (int)j : sy + (int)j;
+        dy_j = ydir != yflip ? dy - (int)j : dy + (int)j;
+
+        for (i = 0; i < width; i++) {
+            sx_i = xdir ? sx - (int)i : sx + (int)i;
+            dx_i = xdir ? dx - (int)i : dx + (int)i;
+
+            s = gr2d_pixel(&src, sx_i, sy_j);
+            d = gr2d_pixel(&dst, dx_i, dy_j);
+            if (!s || !d)
+                return -EFAULT;
+
+            memcpy(d, s, cpp);
+        }
+    }
+
+    return 0;
+}
+
+static int sb_format_cpp(unsigned int fmt)
+{
+    switch (fmt) {
+    case SB_FMT_RGB565:
+        return 2;
+    case SB_FMT_ABGR8888:
+    case SB_FMT_ARGB8888:
+        return 4;
+    default:
+        return -EINVAL;
+    }
+}
+
+static void sb_unpack(unsigned int fmt, const uint8_t *p, uint8_t rgba[4])
+{
+    uint32_t v = 0;
+
+    memcpy(&v, p, sb_format_cpp(fmt));
+
+    switch (fmt) {
+    case SB_FMT_RGB565:
+        rgba[0] = ((v >> 11) & 0x1f) << 3 | ((v >> 13) & 0x7);
+        rgba[1] = ((v >> 5) & 0x3f) << 2 | ((v >> 9) & 0x3);
+        rgba[2] = (v & 0x1f) << 3 | ((v >> 2) & 0x7);
+        rgba[3] = 0xff;
+        break;
+    case SB_FMT_ABGR8888:
+        rgba[0] = v;
+        rgba[1] = v >> 8;
+        rgba[2] = v >> 16;
+        rgba[3] = v >> 24;
+        break;
+    case SB_FMT_ARGB8888:
+        rgba[0] = v >> 16;
+        rgba[1] = v >> 8;
+        rgba[2] = v;
+        rgba[3] = v >> 24;
+        break;
+    }
+}
+
+static void sb_pack(unsigned int fmt, uint8_t *p, const uint8_t rgba[4])
+{
+    uint32_t v = 0;
+
+    switch (fmt) {
+    case SB_FMT_RGB565:
+        v = (rgba[0] >> 3) << 11 | (rgba[1] >> 2) << 5 | rgba[2] >> 3;
+        break;
+    case SB_FMT_ABGR8888:
+        v = (uint32_t)rgba[3] << 24 | rgba[2] << 16 | rgba[1] << 8 | rgba[0];
+        break;
+    case SB_FMT_ARGB8888:
+        v = (uint32_t)rgba[3] << 24 | rgba[0] << 16 | rgba[1] << 8 | rgba[2];
+        break;
+    }
+
+    memcpy(p, &v, sb_format_cpp(fmt));
+}
+
+/* sign-magnitude, 7 fractional bits */
+static int sb_csc_coef(uint32_t val, unsigned int sign_bit)
+{
+    int c = val & ((1u << sign_bit) - 1);
+
+    return (val & (1u << sign_bit)) ? -c : c;
+}
+
+static uint8_t sb_clamp(int v)
+{
+    return CLAMP(v, 0, 255);
+}
+
+/* position in 1/4096 of pixel to integer part and 8-bit fraction */
+struct sb_sample {
+    int i0, i1;
+    unsigned int frac;
+};
+
+static void sb_sample_pos(struct sb_sample *s, uint32_t pos, unsigned int size,
+                          bool filter)
+{
+    s->i0 = min(pos >> 12, size - 1);
+    s->i1 = min(s->i0 + 1, (int)size - 1);
+    s->frac = filter ? (pos >> 4) & 0xff : 0;
+}
+
+static unsigned int sb_lerp(unsigned int p00, unsigned int p01,
+                            unsigned int p10, unsigned int p11,
+                            const struct sb_sample *sx,
+                            const struct sb_sample *sy)
+{
+    unsigned int top = p00 * (256 - sx->frac) + p01 * sx->frac;
+    unsigned int bot = p10 * (256 - sx->frac) + p11 * sx->frac;
+
+    return (top * (256 - sy->frac) + bot * sy->frac + 32768) >> 16;
+}
+
+static int sb_fetch_rgb(const struct gr2d_surface *src, unsigned int fmt,
+                        const struct sb_sample *sx,
+                        const struct sb_sample *sy, uint8_t rgba[4])
+{
+    uint8_t p[4][4];
+    const uint8_t *ptr[4];
+    unsigned int c;
+
+    ptr[0] = gr2d_pixel(src, sx->i0, sy->i0);
+    ptr[1] = gr2d_pixel(src, sx->i1, sy->i0);
+    ptr[2] = gr2d_pixel(src, sx->i0, sy->i1);
+    ptr[3] = gr2d_pixel(src, sx->i1, sy->i1);
+
+    for (c = 0; c < 4; c++) {
+        if (!ptr[c])
+            return -EFAULT;
+
+        sb_unpack(fmt, ptr[c], p[c]);
+    }
+
+    for (c = 0; c < 4; c++)
+        rgba[c] = sb_lerp(p[0][c], p[1][c], p[2][c], p[3][c], sx, sy);
+
+    return 0;
+}
+
+/*
+ * Luma is filtered, chroma is sampled from the nearest 2x2 block.
+ * Y' = Y + yos, X = cyx * Y' + cuX * (U - 128) + cvX * (V - 128)
+ */
+static int sb_fetch_yuv(const struct gr2d_regs *regs,
+                        const struct gr2d_surface *y_plane,
+                        const struct gr2d_surface *u_plane,
+                        const struct gr2d_surface *v_plane,
+                        const struct sb_sample *sx,
+                        const struct sb_sample *sy, uint8_t rgba[4])
+{
+    uint32_t cscfirst = regs->val[GR2D_CSCFIRST];
+    uint32_t cscsecond = regs->val[GR2D_CSCSECOND];
+    uint32_t cscthird = regs->val[GR2D_CSCTHIRD];
+    const uint8_t *p00, *p01, *p10, *p11, *pu, *pv;
+    int y, u, v;
+
+    p00 = gr2d_pixel(y_plane, sx->i0, sy->i0);
+    p01 = gr2d_pixel(y_plane, sx->i1, sy->i0);
+    p10 = gr2d_pixel(y_plane, sx->i0, sy->i1);
+    p11 = gr2d_pixel(y_plane, sx->i1, sy->i1);
+    pu = gr2d_pixel(u_plane, sx->i0 / 2, sy->i0 / 2);
+    pv = gr2d_pixel(v_plane, sx->i0 / 2, sy->i0 / 2);
+
+    if (!p00 || !p01 || !p10 || !p11 || !pu || !pv)
+        return -EFAULT;
+
+    y = sb_lerp(*p00, *p01, *p10, *p11, sx, sy) + (int8_t)(cscfirst >> 24);
+    u = *pu - 128;
+    v = *pv - 128;
+
+    /* sign bit of cyx doesn't fit into the register, it's always positive */
+    rgba[0] = sb_clamp((y * (int)((cscsecond >> 24) & 0xff) +
+                        u * sb_csc_coef((cscsecond >> 12) & 0x3ff, 9) +
+                        v * sb_csc_coef((cscfirst >> 12) & 0x3ff, 9) +
+                        64) >> 7);
+    rgba[1] = sb_clamp((y * (int)((cscsecond >> 24) & 0xff) +
+                        u * sb_csc_coef(cscsecond & 0x1ff, 8) +
+                        v * sb_csc_coef(cscthird & 0x1ff, 8) +
+                        64) >> 7);
+    rgba[2] = sb_clamp((y * (int)((cscsecond >> 24) & 0xff) +
+                        u * sb_csc_coef(cscfirst & 0x3ff, 9) +
+                        v * sb_csc_coef((cscthird >> 16) & 0x3ff, 9) +
+                        64) >> 7);
+    rgba[3] = 0xff;
+
+    return 0;
+}
+
+static int gr2d_surface_blit(const struct gr2d_regs *regs)
+{
+    uint32_t controlsb = regs->val[GR2D_CONTROLSB];
+    uint32_t tilemode = regs->val[GR2D_TILEMODE];
+    unsigned int src_fmt = regs->val[GR2D_SBFORMAT] & 0xff;
+    unsigned int dst_fmt = (regs->val[GR2D_SBFORMAT] >> 8) & 0xff;
+    unsigned int src_width = regs->val[GR2D_SRCSIZE] & 0xffff;
+    unsigned int src_height = (regs->val[GR2D_SRCSIZE] >> 16) + 1;
+    unsigned int dst_width = regs->val[GR2D_DSTSIZE] & 0xffff;
+    unsigned int dst_height = (regs->val[GR2D_DSTSIZE] >> 16) + 1;
+    uint32_t hdda = regs->val[GR2D_HDDA] & 0x3ffff;
+    uint32_t vdda = regs->val[GR2D_VDDA] & 0x3ffff;
+    uint32_t hini = (regs->val[GR2D_HDDAINILS] & 0xff) << 4;
+    uint32_t vini = (regs->val[GR2D_VDDAINI] & 0xff) << 4;
+    bool yflip = regs->val[GR2D_CONTROLMAIN] & (1 << 14);
+    bool hfilter = ((controlsb >> 20) & 7) != 7;
+    bool vfilter = controlsb & (1 << 18);
+    bool yuv = controlsb & (1 << 5);
+    struct gr2d_surface src, dst, u_plane, v_plane;
+    struct sb_sample sx, sy;
+    unsigned int x, y;
+    uint8_t rgba[4];
+    uint8_t *d;
+    int err;
+
+    if (sb_format_cpp(dst_fmt) != (int)gr2d_cpp(regs)) {
+        ErrorMsg("invalid dst format %u\n", dst_fmt);
+        return -EINVAL;
+    }
+
+    if (yuv != (src_fmt == SB_FMT_YUV) ||
+        (!yuv && sb_format_cpp(src_fmt) < 0)) {
+        ErrorMsg("invalid src format %u\n", src_fmt);
+        return -EINVAL;
+    }
+
+    if (yflip && (tilemode & (1 << 20))) {
+        ErrorMsg("flip of tiled dst isn't emulated\n");
+        return -ENOTSUP;
+    }
+
+    err = gr2d_surface_init(&dst, regs, GR2D_DSTBA, regs->val[GR2D_DSTST],
+                            sb_format_cpp(dst_fmt), tilemode & (1 << 20));
+    if (err)
+        return err;
+
+    err = gr2d_surface_init(&src, regs, GR2D_SRCBA, regs->val[GR2D_SRCST],
+                            yuv ? 1 : sb_format_cpp(src_fmt), tilemode & 1);
+    if (err)
+        return err;
+
+    if (yuv) {
+        err = gr2d_surface_init(&u_plane, regs,
+                                (tilemode & (1 << 4)) ? GR2D_UBA_TILE :
+                                                        GR2D_UBA,
+                                regs->val[GR2D_UVSTRIDE], 1,
+                                tilemode & (1 << 4));
+        if (err)
+            return err;
+
+        err = gr2d_surface_init(&v_plane, regs,
+                                (tilemode & (1 << 4)) ? GR2D_VBA_TILE :
+                                                        GR2D_VBA,
+                                regs->val[GR2D_UVSTRIDE], 1,
+                                tilemode & (1 << 4));
+        if (err)
+            return err;
+    }
+
+    if (!src_width || !dst_width)
+        return 0;
+
+    for (y = 0; y < dst_height; y++) {
+        sb_sample_pos(&sy, vini + y * vdda, src_height, vfilter);
+
+        for (x = 0; x < dst_width; x++) {
+            sb_sample_pos(&sx, hini + x * hdda, src_width, hfilter);
+
+            if (yuv)
+                err = sb_fetch_yuv(regs, &src, &u_plane, &v_plane,
+                                   &sx, &sy, rgba);
+            else
+                err = sb_fetch_rgb(&src, src_fmt, &sx, &sy, rgba);
+            if (err)
+                return err;
+
+            /* with yflip DSTBA points at the last row */
+            d = gr2d_pixel(&dst, x, yflip ? -(int)y : (int)y);
+            if (!d)
+                return -EFAULT;
+
+            sb_pack(dst_fmt, d, rgba);
+        }
+    }
+
+    return 0;
+}
+
+static int gr2d_execute_op(const struct gr2d_regs *regs)
+{
+    if (regs->val[GR2D_CMDSEL] & 1)
+        return gr2d_surface_blit(regs);
+
+    if (regs->val[GR2D_ROPFADE] != 0xcc) {
+        ErrorMsg("ROP 0x%02x isn't emulated\n", regs->val[GR2D_ROPFADE]);
+        return -ENOTSUP;
+    }
+
+    /* [6:6] source solid fill */
+    if (regs->val[GR2D_CONTROLMAIN] & (1 << 6))
+        return gr2d_fill(regs);
+
+    return gr2d_blit(regs);
+}
+
+static struct drm_tegra_bo *find_reloc(const struct soft_reloc *relocs,
+                                       unsigned int num_relocs,
+                                       unsigned int word, uint32_t *offset)
+{
+    unsigned int i;
+
+    for (i = 0; i < num_relocs; i++) {
+        if (relocs[i].word == word) {
+            *offset = relocs[i].offset;
+            return relocs[i].bo;
+        }
+    }
+
+    return NULL;
+}
+
+struct gr2d_state {
+    const uint32_t *words;
+    unsigned int num_words;
+    const struct soft_reloc *relocs;
+    unsigned int num_relocs;
+    struct gr2d_regs *regs;
+    unsigned int ops;
+};
+
+static int gr2d_write_reg(struct gr2d_state *st, unsigned int reg,
+                          uint32_t value, int word)
+{
+    struct gr2d_regs *regs = st->regs;
+    int err;
+
+    /* host1x class words, like sync point waits, are ignored */
+    if (!regs)
+        return 0;
+
+    /* sync point increment */
+    if (reg == 0)
+        return 0;
+
+    if (reg >= GR2D_NUM_REGS) {
+        ErrorMsg("register 0x%02x isn't emulated\n", reg);
+        return -EINVAL;
+    }
+
+    regs->bo[reg] = NULL;
+
+    if (word >= 0)
+        regs->bo[reg] = find_reloc(st->relocs, st->num_relocs, word, &value);
+
+    regs->val[reg] = value;
+
+    if (reg == GR2D_TRIGGER || regs->val[GR2D_TRIGGER] != reg)
+        return 0;
+
+    err = gr2d_execute_op(regs);
+    if (err)
+        return err;
+
+    st->ops++;
+
+    return 0;
+}
+
+static int gr2d_write_data(struct gr2d_state *st, unsigned int reg,
+                           unsigned int *pos)
+{
+    if (*pos >= st->num_words) {
+        ErrorMsg("job is truncated\n");
+        return -EINVAL;
+    }
+
+    *pos += 1;
+
+    return gr2d_write_reg(st, reg, st->words[*pos - 1], *pos - 1);
+}
+
+/* returns number of executed operations */
+int soft_gr2d_execute(const uint32_t *words, unsigned int num_words,
+                      const struct soft_reloc *relocs,
+                      unsigned int num_relocs)
+{
+    struct gr2d_regs regs_2d, regs_sb;
+    struct gr2d_state st;
+    unsigned int pos = 0;
+    unsigned int offset;
+    unsigned int count;
+    unsigned int class;
+    unsigned int i;
+    uint32_t word;
+    int err = 0;
+
+    memset(&regs_2d, 0, sizeof(regs_2d));
+    memset(&regs_sb, 0, sizeof(regs_sb));
+
+    st.words = words;
+    st.num_words = num_words;
+    st.relocs = relocs;
+    st.num_relocs = num_relocs;
+    st.regs = NULL;
+    st.ops = 0;
+
+    while (pos < num_words && !err) {
+        word = words[pos++];
+        offset = (word >> 16) & 0xfff;
+
+        switch (word >> 28) {
+        case 0x0: /* SETCL */
+            class = (word >> 6) & 0x3ff;
+
+            switch (class) {
+            case HOST1X_CLASS_GR2D:
+                st.regs = &regs_2d;
+                break;
+            case HOST1X_CLASS_GR2D_SB:
+                st.regs = &regs_sb;
+                break;
+            case HOST1X_CLASS_HOST1X:
+                st.regs = NULL;
+                break;
+            default:
+                ErrorMsg("class 0x%02x isn't emulated\n", class);
+                return -EINVAL;
+            }
+
+            for (i = 0; i < 6 && !err; i++) {
+                if (word & (1 << i))
+                    err = gr2d_write_data(&st, offset + i, &pos);
+            }
+            break;
+
+        case 0x1: /* INCR */
+            count = word & 0xffff;
+
+            for (i = 0; i < count && !err; i++)
+                err = gr2d_write_data(&st, offset + i, &pos);
+            break;
+
+        case 0x2: /* NONINCR */
+            count = word & 0xffff;
+
+            for (i = 0; i < count && !err; i++)
+                err = gr2d_write_data(&st, offset, &pos);
+            break;
+
+        case 0x3: /* MASK */
+            for (i = 0; i < 16 && !err; i++) {
+                if (word & (1 << i))
+                    err = gr2d_write_data(&st, offset + i, &pos);
+            }
+            break;
+
+        case 0x4: /* IMM */
+            err = gr2d_write_reg(&st, offset, word & 0xffff, -1);
+            break;
+
+        case 0xe: /* EXTEND */
+            break;
+
+        default:
+            ErrorMsg("opcode 0x%x isn't emulated\n", word >> 28);
+            return -EINVAL;
+        }
+    }
+
+    if (err)
+        return err;
+
+    return st.ops;
+}
@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "soft_tegra.h"
+
+/* tegra_stream_push() doesn't check for space, keep some words in reserve */
+#define SOFT_STREAM_SPARE_WORDS    16
+
+bool tegra_vdpau_debug;
+
+struct soft_fence {
+    struct tegra_fence base;
+    struct soft_job_times times;
+};
+
+struct soft_stream {
+    struct tegra_stream base;
+    struct tegra_stream_hwm hwm;
+    struct soft_stream_stats stats;
+    uint32_t *start;
+    uint32_t *ptr;
+    unsigned int num_words;
+    struct soft_reloc *relocs;
+    unsigned int num_relocs;
+    unsigned int max_relocs;
+};
+
+static inline struct soft_stream *to_soft_stream(struct tegra_stream *base)
+{
+    return CONTAINER_OF(base, struct soft_stream, base);
+}
+
+static inline struct soft_fence *to_soft_fence(struct tegra_fence *base)
+{
+    return CONTAINER_OF(base, struct soft_fence, base);
+}
+
+VdpTime get_time(void)
+{
+    struct timespec tp;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &tp) != 0)
+        ErrorMsg("failed\n");
+
+    return (VdpTime)tp.tv_sec * 1000000000ULL + (VdpTime)tp.tv_nsec;
+}
+
+/* jobs are executed on submission, fences are signalled once created */
+static bool soft_stream_wait_fence(struct tegra_fence *f)
+{
+    return true;
+}
+
+static void soft_stream_free_fence(struct tegra_fence *f)
+{
+    free(to_soft_fence(f));
+}
+
+static struct tegra_fence *soft_stream_create_fence(bool gr2d)
+{
+    struct soft_fence *f = calloc(1, sizeof(*f));
+
+    if (!f)
+        return NULL;
+
+    atomic_set(&f->base.refcnt, 1);
+    f->base.wait_fence = soft_stream_wait_fence;
+    f->base.free_fence = soft_stream_free_fence;
+    f->base.gr2d = gr2d;
+
+    return &f->base;
+}
+
+const struct soft_job_times *soft_fence_times(struct tegra_fence *f)
+{
+    if (!f)
+        return NULL;
+
+    return &to_soft_fence(f)->times;
+}
+
+static void soft_stream_destroy(struct tegra_stream *base_stream)
+{
+    struct soft_stream *stream = to_soft_stream(base_stream);
+
+    tegra_stream_put_fence(stream->base.last_fence);
+    free(stream->relocs);
+    free(stream->start);
+    free(stream);
+}
+
+static int soft_stream_cleanup(struct tegra_stream *base_stream)
+{
+    struct soft_stream *stream = to_soft_stream(base_stream);
+
+    stream->ptr = stream->start;
+    stream->num_relocs = 0;
+    stream->base.status = TEGRADRM_STREAM_FREE;
+
+    return 0;
+}
+
+static int soft_stream_execute(struct soft_stream *stream,
+                               struct soft_job_times *times)
+{
+    unsigned int words = stream->ptr - stream->start;
+    int ret;
+
+    tegra_stream_update_hwm(&stream->base, words, stream->num_relocs);
+
+    times->submitted = get_time();
+    times->started = times->submitted;
+
+    ret = soft_gr2d_execute(stream->start, words,
+                            stream->relocs, stream->num_relocs);
+
+    times->completed = get_time();
+
+    stream->stats.exec_time += times->completed - times->started;
+    stream->stats.words += words;
+    stream->stats.jobs++;
+
+    if (ret < 0) {
+        stream->stats.failed_jobs++;
+        ErrorMsg("job execution failed %d\n", ret);
+        return ret;
+    }
+
+    return 0;
+}
+
+static int soft_stream_flush(struct tegra_stream *base_stream)
+{
+    struct soft_stream *stream = to_soft_stream(base_stream);
+    struct soft_job_times times;
+    int ret;
+
+    tegra_stream_put_fence(stream->base.last_fence);
+    stream->base.last_fence = NULL;
+
+    /* reflushing is fine */
+    if (stream->base.status == TEGRADRM_STREAM_FREE)
+        return 0;
+
+    /* return error if stream is constructed badly */
+    if (stream->base.status != TEGRADRM_STREAM_READY) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    ret = soft_stream_execute(stream, &times) ? -1 : 0;
+
+cleanup:
+    soft_stream_cleanup(base_stream);
+
+    return ret;
+}
+
+static struct tegra_fence *
+soft_stream_submit(struct tegra_stream *base_stream, bool gr2d)
+{
+    struct soft_stream *stream = to_soft_stream(base_stream);
+    struct tegra_fence *f;
+
+    f = stream->base.last_fence;
+
+    /* resubmitting is fine */
+    if (stream->base.status == TEGRADRM_STREAM_FREE)
+        return f;
+
+    /* return error if stream is constructed badly */
+    if (stream->base.status != TEGRADRM_STREAM_READY) {
+        f = NULL;
+        goto cleanup;
+    }
+
+    f = soft_stream_create_fence(gr2d);
+    if (!f)
+        goto cleanup;
+
+    if (soft_stream_execute(stream, &to_soft_fence(f)->times)) {
+        tegra_stream_put_fence(f);
+        f = NULL;
+    } else {
+        tegra_stream_put_fence(stream->base.last_fence);
+        stream->base.last_fence = f;
+    }
+
+cleanup:
+    soft_stream_cleanup(base_stream);
+
+    return f;
+}
+
+static int soft_stream_begin(struct tegra_stream *base_stream,
+                             struct drm_tegra_channel *channel)
+{
+    struct soft_stream *stream = to_soft_stream(base_stream);
+
+    stream->base.class_id = 0;
+    stream->base.status = TEGRADRM_STREAM_CONSTRUCT;
+    stream->base.op_done_synced = false;
+    stream->base.buf_ptr = &stream->ptr;
+    stream->ptr = stream->start;
+    stream->num_relocs = 0;
+
+    return 0;
+}
+
+static int soft_stream_prep(struct tegra_stream *base_stream, uint32_t words)
+{
+    struct soft_stream *stream = to_soft_stream(base_stream);
+    unsigned int used = stream->ptr - stream->start;
+    unsigned int num_words;
+    uint32_t *start;
+
+    if (used + words + SOFT_STREAM_SPARE_WORDS <= stream->num_words)
+        return 0;
+
+    /* grow geometrically to keep amount of reallocations low */
+    num_words = max(stream->num_words * 2,
+                    used + words + SOFT_STREAM_SPARE_WORDS);
+
+    start = realloc(stream->start, num_words * sizeof(*start));
+    if (!start) {
+        stream->base.status = TEGRADRM_STREAM_CONSTRUCTION_FAILED;
+        ErrorMsg("failed to grow job to %u words\n", num_words);
+        return -1;
+    }
+
+    stream->start = start;
+    stream->ptr = start + used;
+    stream->num_words = num_words;
+
+    return 0;
+}
+
+static int soft_stream_add_reloc(struct soft_stream *stream,
+                                 unsigned int word,
+                                 struct drm_tegra_bo *bo,
+                                 uint32_t offset)
+{
+    unsigned int max = stream->max_relocs;
+    struct soft_reloc *relocs;
+
+    if (!bo) {
+        stream->base.status = TEGRADRM_STREAM_CONSTRUCTION_FAILED;
+        ErrorMsg("invalid BO\n");
+        return -1;
+    }
+
+    if (stream->num_relocs == max) {
+        max = max ? max * 2 : 16;
+
+        relocs = realloc(stream->relocs, max * sizeof(*relocs));
+        if (!relocs) {
+            stream->base.status = TEGRADRM_STREAM_CONSTRUCTION_FAILED;
+            ErrorMsg("failed to grow relocs to %u\n", max);
+            return -1;
+        }
+
+        stream->relocs = relocs;
+        stream->max_relocs = max;
+    }
+
+    relocs = &stream->relocs[stream->num_relocs++];
+    relocs->word = word;
+    relocs->bo = bo;
+    relocs->offset = offset;
+
+    return 0;
+}
+
+static int soft_stream_push_reloc(struct tegra_stream *base_stream,
+                                  struct drm_tegra_bo *bo,
+                                  unsigned offset)
+{
+    struct soft_stream *stream = to_soft_stream(base_stream);
+    int ret;
+
+    ret = soft_stream_prep(base_stream, 1);
+    if (ret)
+        return ret;
+
+    ret = soft_stream_add_reloc(stream, stream->ptr - stream->start,
+                                bo, offset);
+    if (ret)
+        return ret;
+
+    *stream->ptr++ = 0xdeadbeef;
+
+    return 0;
+}
+
+static int soft_stream_push_words(struct tegra_stream *base_stream,
+                                  const void *addr, unsigned words,
+                                  const struct tegra_reloc *relocs,
+                                  unsigned num_relocs)
+{
+    struct soft_stream *stream = to_soft_stream(base_stream);
+    unsigned int base;
+    unsigned int i;
+    int ret;
+
+    ret = soft_stream_prep(base_stream, words);
+    if (ret)
+        return ret;
+
+    /* class id should be set explicitly, for simplicity. */
+    if (stream->base.class_id == 0) {
+        stream->base.status = TEGRADRM_STREAM_CONSTRUCTION_FAILED;
+        ErrorMsg("HOST1X class not specified\n");
+        return -1;
+    }
+
+    base = stream->ptr - stream->start;
+    memcpy(stream->ptr, addr, words * sizeof(uint32_t));
+
+    for (i = 0; i < num_relocs; i++) {
+        ret = soft_stream_add_reloc(stream,
+                                    base + relocs[i].var_offset / 4,
+                                    relocs[i].bo, relocs[i].offset);
+        if (ret)
+            return ret;
+    }
+
+    stream->ptr += words;
+
+    return 0;
+}
+
+static int soft_stream_end(struct tegra_stream *base_stream)
+{
+    struct soft_stream *stream = to_soft_stream(base_stream);
+
+    if (!stream->base.op_done_synced)
+        tegra_stream_push(base_stream,
+                          HOST1X_OPCODE_IMM(0, DRM_TEGRA_SYNCPT_COND_OP_DONE << 8));
+
+    stream->base.status = TEGRADRM_STREAM_READY;
+    stream->base.op_done_synced = false;
+
+    return 0;
+}
+
+static int soft_stream_sync(struct tegra_stream *base_stream,
+                            enum drm_tegra_syncpt_cond cond,
+                            bool keep_class)
+{
+    int ret;
+
+    ret = soft_stream_prep(base_stream, 1);
+    if (ret)
+        return ret;
+
+    /* jobs are executed in order, waits aren't needed */
+    tegra_stream_push(base_stream, HOST1X_OPCODE_IMM(0, cond << 8));
+
+    if (cond == DRM_TEGRA_SYNCPT_COND_OP_DONE)
+        base_stream->op_done_synced = true;
+
+    return 0;
+}
+
+void soft_stream_get_stats(struct tegra_stream *base_stream,
+                           struct soft_stream_stats *stats)
+{
+    *stats = to_soft_stream(base_stream)->stats;
+}
+
+void soft_stream_reset_stats(struct tegra_stream *base_stream)
+{
+    memset(&to_soft_stream(base_stream)->stats, 0,
+           sizeof(struct soft_stream_stats));
+}
+
+int soft_stream_create(struct tegra_stream **pstream)
+{
+    struct soft_stream *soft;
+    struct tegra_stream *stream;
+
+    soft = calloc(1, sizeof(*soft));
+    if (!soft)
+        return -ENOMEM;
+
+    stream = &soft->base;
+    stream->hwm = &soft->hwm;
+    stream->status = TEGRADRM_STREAM_FREE;
+    stream->destroy = soft_stream_destroy;
+    stream->begin = soft_stream_begin;
+    stream->end = soft_stream_end;
+    stream->cleanup = soft_stream_cleanup;
+    stream->flush = soft_stream_flush;
+    stream->submit = soft_stream_submit;
+    stream->push_reloc = soft_stream_push_reloc;
+    stream->push_words = soft_stream_push_words;
+    stream->prep = soft_stream_prep;
+    stream->sync = soft_stream_sync;
+
+    /* begin() hands out buf_ptr without prep, start with some space */
+    if (soft_stream_prep(stream, 0)) {
+        free(soft);
+        return -ENOMEM;
+    }
+
+    *pstream = stream;
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) GRATE-DRIVER project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Software stand-in for the Tegra DRM device. BOs live in memfd memory and
+ * GR2D jobs are executed by the CPU, so that the driver's GR2D paths can be
+ * checked and benchmarked on machines without Tegra hardware.
+ */
+
+#ifndef SOFT_TEGRA_H
+#define SOFT_TEGRA_H
+
+#include "vdpau_tegra.h"
+
+struct drm_tegra {
+    int version;
+};
+
+struct drm_tegra_bo {
+    atomic_t ref;
+    uint32_t size;
+    void *map;
+    int fd;
+};
+
+/* relocation of a job word, patched with the BO address on execution */
+struct soft_reloc {
+    unsigned int word;
+    struct drm_tegra_bo *bo;
+    uint32_t offset;
+};
+
+/* timestamps of a job, taken with get_time() */
+struct soft_job_times {
+    VdpTime submitted;
+    VdpTime started;
+    VdpTime completed;
+};
+
+struct soft_stream_stats {
+    unsigned long jobs;
+    unsigned long failed_jobs;
+    unsigned long words;
+    /* time spent executing jobs in software */
+    VdpTime exec_time;
+};
+
+int soft_drm_new(struct drm_tegra **drmp);
+void soft_drm_close(struct drm_tegra *drm);
+
+/* number of BOs that are currently allocated, for leak checks */
+unsigned int soft_bo_count(void);
+
+int soft_stream_create(struct tegra_stream **pstream);
+void soft_stream_get_stats(struct tegra_stream *stream,
+                           struct soft_stream_stats *stats);
+void soft_stream_reset_stats(struct tegra_stream *stream);
+const struct soft_job_times *soft_fence_times(struct tegra_fence *f);
+
+int soft_gr2d_execute(const uint32_t *words, unsigned int num_words,
+                      const struct soft_reloc *relocs,
+                      unsigned int num_relocs);
+
+#endif